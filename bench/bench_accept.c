@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "http/http.h"
+
+// 新建连接速率：一个监听套接字和一个事件循环 vs 每个事件循环一个 SO_REUSEPORT 监听套接字，
+// 每个请求都新建连接并由服务器关闭，客户端线程数为 CPU 核数的两倍
+
+#define DURATION 2.0        // 每种方式运行的秒数
+#define BASE_PORT 18380
+
+static atomic_long done;
+static atomic_long failed;
+static atomic_int running;
+static int port;
+
+static const char REQUEST[] = "GET /ping HTTP/1.1\r\nHost: bench\r\nConnection: close\r\n\r\n";
+
+static void route_ping(HttpRequest *request, HttpResponse *response){
+    http_response_write_static(response, "pong", 4);
+}
+
+static double now_sec(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief 连接、发送请求、读到服务器关闭
+ * @return 成功返回0,失败返回-1
+ */
+static int one_request(){
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0){
+        return -1;
+    }
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = inet_addr("127.0.0.1"),
+    };
+    int rs = -1;
+    if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0
+        && send(fd, REQUEST, sizeof(REQUEST) - 1, MSG_NOSIGNAL) == sizeof(REQUEST) - 1){
+        char buf[512];
+        ssize_t n, total = 0;
+        while ((n = recv(fd, buf, sizeof(buf), 0)) > 0)
+        {
+            total += n;
+        }
+        rs = n == 0 && total > 0 ? 0 : -1;
+    }
+    close(fd);
+    return rs;
+}
+
+static void *client(void *arg){
+    while (atomic_load_explicit(&running, memory_order_relaxed))
+    {
+        if(one_request() == 0){
+            atomic_fetch_add_explicit(&done, 1, memory_order_relaxed);
+        }else{
+            atomic_fetch_add_explicit(&failed, 1, memory_order_relaxed);
+        }
+    }
+    return NULL;
+}
+
+static void *server_run(void *arg){
+    http_server_start((HttpServer *)arg);
+    return NULL;
+}
+
+/**
+ * @brief 启动服务器，等到可以连接
+ * @return 成功返回0,失败返回-1
+ */
+static int wait_ready(){
+    for(int i = 0; i < 200; i++){
+        if(one_request() == 0){
+            return 0;
+        }
+        usleep(10000);
+    }
+    return -1;
+}
+
+/**
+ * @brief 一种监听方式的连接速率
+ * @return 每秒完成的连接数, 失败返回-1
+ */
+static double run(HttpListenMode mode, int loops, int clients){
+    HttpServer *svr = http_server_new();
+    http_server_init(svr, "127.0.0.1", port);
+    http_server_set_listeners(svr, mode, loops);
+    http_server_route_add(svr, HTTP_METHOD_GET, "/ping", route_ping);
+
+    pthread_t server_thread;
+    pthread_create(&server_thread, NULL, server_run, svr);
+    if(wait_ready() != 0){
+        fprintf(stderr, "server on port %d not ready\n", port);
+        exit(1);
+    }
+
+    atomic_store(&done, 0);
+    atomic_store(&failed, 0);
+    atomic_store(&running, 1);
+    pthread_t *threads = malloc(sizeof(pthread_t) * clients);
+    double start = now_sec();
+    for(int i = 0; i < clients; i++){
+        pthread_create(&threads[i], NULL, client, NULL);
+    }
+    usleep((useconds_t)(DURATION * 1e6));
+    atomic_store(&running, 0);
+    for(int i = 0; i < clients; i++){
+        pthread_join(threads[i], NULL);
+    }
+    double rate = atomic_load(&done) / (now_sec() - start);
+    free(threads);
+
+    http_server_stop(svr);
+    pthread_join(server_thread, NULL);
+    http_server_destroy(svr);
+    if(atomic_load(&failed) > 0){
+        printf("  (%ld failed)\n", atomic_load(&failed));
+    }
+    // 服务器先关闭连接，TIME_WAIT 留在服务器端口上，每种方式换一个端口
+    port++;
+    return rate;
+}
+
+int main(int argc, char **argv){
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int loops = argc > 1 ? atoi(argv[1]) : (int)cpus;
+    int clients = cpus * 2;
+    port = BASE_PORT;
+
+    printf("%ld cpus, %d loops, %d clients, %.0fs each\n\n", cpus, loops, clients, DURATION);
+    printf("%-28s %14s\n", "mode", "conn/s");
+    double single = run(HTTP_LISTEN_SINGLE, 1, clients);
+    printf("%-28s %14.0f\n", "1 listener", single);
+    double hash = run(HTTP_LISTEN_REUSEPORT, loops, clients);
+    printf("%-28s %14.0f  x%.2f\n", "SO_REUSEPORT", hash, hash / single);
+    double cpu = run(HTTP_LISTEN_REUSEPORT_CPU, loops, clients);
+    printf("%-28s %14.0f  x%.2f\n", "SO_REUSEPORT + CPU steering", cpu, cpu / single);
+    return 0;
+}
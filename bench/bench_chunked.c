@@ -0,0 +1,298 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "http/http.h"
+#include "http/parser.h"
+#include "http/chunked.h"
+
+// 分块 body 的解码吞吐：缓冲方式在读缓冲中原地解码，流式方式把块数据复制到 handler 的缓冲，
+// 块从很小到很大，以同样数据量的 memcpy 作为上限参考。开始前检查服务器对分块和 Content-Length 同时出现的处理
+
+#define BODY_SIZE (64 << 20)
+#define READ_SIZE 16384     // 模拟每次 recv 读到的数据量
+#define USER_BUF 65536      // 流式读取时 handler 的缓冲大小
+#define PORT 18470
+
+static double now_sec(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief 按固定块大小编码，带一个扩展，结尾带尾部请求头
+ */
+static char *encode(const char *body, size_t len, size_t chunk, size_t *out_len){
+    size_t chunks = (len + chunk - 1) / chunk;
+    char *out = malloc(len + chunks * 32 + 64);
+    char *p = out;
+    for(size_t i = 0; i < len; i += chunk){
+        size_t n = len - i < chunk ? len - i : chunk;
+        p += sprintf(p, "%zx;ext=1\r\n", n);
+        memcpy(p, body + i, n);
+        p += n;
+        *p++ = '\r';
+        *p++ = '\n';
+    }
+    p += sprintf(p, "0\r\nX-Checksum: 1\r\n\r\n");
+    *out_len = p - out;
+    return out;
+}
+
+/**
+ * @brief 与事件循环相同：每读到一段就在缓冲中原地解码，块数据前移拼接，剩余部分移到已解码部分之后
+ * @return 解码后的长度, 出错返回-1
+ */
+static long decode_inplace(char *buf, const char *wire, size_t wire_len){
+    HttpChunkedParser parser;
+    http_chunked_init(&parser, BODY_SIZE);
+    size_t out = 0, rlen = 0, sent = 0;
+    int rs = HTTP_PARSE_AGAIN;
+    while (rs == HTTP_PARSE_AGAIN && sent < wire_len)
+    {
+        size_t n = wire_len - sent < READ_SIZE ? wire_len - sent : READ_SIZE;
+        memcpy(buf + rlen, wire + sent, n);     // recv
+        sent += n;
+        rlen += n;
+
+        size_t pos = out;
+        while (pos < rlen)
+        {
+            if(parser.remaining > 0){
+                size_t k = rlen - pos < parser.remaining ? rlen - pos : parser.remaining;
+                if(out != pos){
+                    memmove(buf + out, buf + pos, k);
+                }
+                out += k;
+                pos += k;
+                http_chunked_consume(&parser, k);
+                continue;
+            }
+            size_t consumed;
+            rs = http_chunked_execute(&parser, buf + pos, rlen - pos, &consumed);
+            pos += consumed;
+            if(rs != HTTP_PARSE_AGAIN){
+                break;
+            }
+        }
+        memmove(buf + out, buf + pos, rlen - pos);
+        rlen -= pos - out;
+    }
+    return rs == HTTP_PARSE_DONE ? (long)out : -1;
+}
+
+/**
+ * @brief 与 http_request_read_body 相同：分块头在读缓冲中解析，块数据复制到 handler 的缓冲
+ * @return 解码后的长度, 出错返回-1
+ */
+static long decode_stream(char *rbuf, char *user, const char *wire, size_t wire_len, unsigned long *check){
+    HttpChunkedParser parser;
+    http_chunked_init(&parser, BODY_SIZE);
+    size_t rpos = 0, rlen = 0, sent = 0;
+    long total = 0;
+    for(;;){
+        size_t buffered = rlen - rpos;
+        if(parser.remaining > 0){
+            size_t n = USER_BUF < parser.remaining ? USER_BUF : parser.remaining;
+            if(buffered > 0){
+                n = n < buffered ? n : buffered;
+                memcpy(user, rbuf + rpos, n);
+                rpos += n;
+            }else{
+                // 块数据直接 recv 到 handler 的缓冲
+                n = n < wire_len - sent ? n : wire_len - sent;
+                memcpy(user, wire + sent, n);
+                sent += n;
+            }
+            http_chunked_consume(&parser, n);
+            *check += (unsigned char)user[n - 1];
+            total += n;
+            continue;
+        }
+        if(buffered > 0){
+            size_t consumed;
+            int rs = http_chunked_execute(&parser, rbuf + rpos, buffered, &consumed);
+            rpos += consumed;
+            if(rs == HTTP_PARSE_DONE) return total;
+            if(rs == HTTP_PARSE_ERROR) return -1;
+            continue;
+        }
+        if(sent == wire_len){
+            return -1;
+        }
+        size_t n = wire_len - sent < READ_SIZE ? wire_len - sent : READ_SIZE;
+        memcpy(rbuf, wire + sent, n);
+        sent += n;
+        rpos = 0;
+        rlen = n;
+    }
+}
+
+static void route_len(HttpRequest *request, HttpResponse *response){
+    size_t len = 0;
+    http_request_body(request, &len);
+    char *body = http_request_alloc(request, 32);
+    snprintf(body, 32, "%zu", len);
+    http_response_write(response, body);
+}
+
+static void *server_run(void *arg){
+    http_server_start((HttpServer *)arg);
+    return NULL;
+}
+
+/**
+ * @brief 发送一个请求，读到服务器关闭或超时
+ * @return 读到的长度, 连接失败返回-1; *closed 表示服务器是否关闭了连接
+ */
+static int exchange(const char *request, char *buf, size_t cap, int *closed){
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(PORT),
+        .sin_addr.s_addr = inet_addr("127.0.0.1"),
+    };
+    if(fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0){
+        if(fd >= 0){
+            close(fd);
+        }
+        return -1;
+    }
+    struct timeval timeout = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    send(fd, request, strlen(request), MSG_NOSIGNAL);
+
+    size_t total = 0;
+    ssize_t n = 0;
+    while (total < cap - 1 && (n = recv(fd, buf + total, cap - 1 - total, 0)) > 0)
+    {
+        total += n;
+    }
+    *closed = n == 0;
+    close(fd);
+    buf[total] = '\0';
+    return (int)total;
+}
+
+/**
+ * @brief 分块 body 和 Content-Length 同时出现时返回 400 并关闭连接，分块 body 中的内容不能作为下一个请求处理
+ * @return 全部符合返回0, 否则返回-1
+ */
+static int check_framing(){
+    static const struct {
+        const char *name;
+        const char *request;
+        const char *status;
+        int close;
+    } cases[] = {
+        { "chunked", "POST /len HTTP/1.1\r\nHost: bench\r\nTransfer-Encoding: chunked\r\n\r\n"
+                     "5\r\nhello\r\n0\r\n\r\n", "HTTP/1.1 200", 0 },
+        { "chunked + Content-Length: 0", "POST /len HTTP/1.1\r\nHost: bench\r\nTransfer-Encoding: chunked\r\n"
+                     "Content-Length: 0\r\n\r\n27\r\nGET /len HTTP/1.1\r\nHost: bench\r\nX: \r\n\r\n\r\n0\r\n\r\n",
+                     "HTTP/1.1 400", 1 },
+        { "Content-Length: 0 + chunked", "POST /len HTTP/1.1\r\nHost: bench\r\nContent-Length: 0\r\n"
+                     "Transfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n0\r\n\r\n", "HTTP/1.1 400", 1 },
+        { "chunked + Content-Length: 5", "POST /len HTTP/1.1\r\nHost: bench\r\nTransfer-Encoding: chunked\r\n"
+                     "Content-Length: 5\r\n\r\n5\r\nhello\r\n0\r\n\r\n", "HTTP/1.1 400", 1 },
+    };
+
+    HttpServer *svr = http_server_new();
+    http_server_init(svr, "127.0.0.1", PORT);
+    http_server_route_add(svr, HTTP_METHOD_POST, "/len", route_len);
+    pthread_t server_thread;
+    pthread_create(&server_thread, NULL, server_run, svr);
+
+    int rs = 0;
+    char buf[4096];
+    for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++){
+        int closed = 0;
+        int n = -1;
+        for(int k = 0; k < 200 && (n = exchange(cases[i].request, buf, sizeof(buf), &closed)) < 0; k++){
+            usleep(10000);
+        }
+        // 只能有一个返回，关闭连接的情况下服务器必须主动关闭
+        char *second = n > 0 ? strstr(buf + 1, "HTTP/1.1 ") : NULL;
+        if(n <= 0 || strncmp(buf, cases[i].status, strlen(cases[i].status)) != 0
+            || second != NULL || closed != cases[i].close){
+            fprintf(stderr, "framing check \"%s\" failed: expected %s%s, got:\n%s\n", cases[i].name,
+                    cases[i].status, cases[i].close ? " and close" : "", n > 0 ? buf : "(nothing)");
+            rs = -1;
+        }
+    }
+
+    http_server_stop(svr);
+    pthread_join(server_thread, NULL);
+    http_server_destroy(svr);
+    if(rs == 0){
+        printf("framing checks passed\n");
+    }
+    return rs;
+}
+
+int main(){
+    if(check_framing() != 0){
+        return 1;
+    }
+
+    static const size_t sizes[] = {16, 256, 4096, 65536, 1 << 20};
+    char *body = malloc(BODY_SIZE);
+    for(size_t i = 0; i < BODY_SIZE; i++){
+        body[i] = (char)(i * 131 + (i >> 9));
+    }
+    char *buf = malloc(BODY_SIZE + READ_SIZE);
+    char *rbuf = malloc(READ_SIZE);
+    char *user = malloc(USER_BUF);
+    unsigned long check = 0;
+
+    double start = now_sec();
+    int rounds = 5;
+    for(int r = 0; r < rounds; r++){
+        memcpy(buf, body, BODY_SIZE);
+        check += (unsigned char)buf[r];
+    }
+    double copy = (double)BODY_SIZE * rounds / (now_sec() - start) / 1e9;
+    printf("memcpy %.2f GB/s (%d MB body, %d byte reads)\n\n", copy, BODY_SIZE >> 20, READ_SIZE);
+
+    printf("%8s %10s %14s %14s\n", "chunk", "overhead", "inplace", "stream");
+    for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++){
+        size_t wire_len;
+        char *wire = encode(body, BODY_SIZE, sizes[i], &wire_len);
+
+        if(decode_inplace(buf, wire, wire_len) != BODY_SIZE || memcmp(buf, body, BODY_SIZE) != 0){
+            fprintf(stderr, "inplace decode failed at chunk %zu\n", sizes[i]);
+            return 1;
+        }
+        start = now_sec();
+        for(int r = 0; r < rounds; r++){
+            check += decode_inplace(buf, wire, wire_len);
+        }
+        double inplace = (double)BODY_SIZE * rounds / (now_sec() - start) / 1e9;
+
+        start = now_sec();
+        for(int r = 0; r < rounds; r++){
+            if(decode_stream(rbuf, user, wire, wire_len, &check) != BODY_SIZE){
+                fprintf(stderr, "stream decode failed at chunk %zu\n", sizes[i]);
+                return 1;
+            }
+        }
+        double stream = (double)BODY_SIZE * rounds / (now_sec() - start) / 1e9;
+
+        printf("%8zu %9.1f%% %9.2f GB/s %9.2f GB/s\n", sizes[i],
+            100.0 * (wire_len - BODY_SIZE) / BODY_SIZE, inplace, stream);
+        free(wire);
+    }
+    printf("(check=%lu)\n", check);
+
+    free(body);
+    free(buf);
+    free(rbuf);
+    free(user);
+    return 0;
+}
@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "util/map.h"
+
+// 原先不带种子的 djb2 map vs 带随机种子的 wyhash map：普通 key 的查找速度，以及构造的碰撞 key 的插入/查找
+
+#define LOOKUPS 2000000
+#define NORMAL_KEYS 1000
+#define ATTACK_KEYS 5000
+
+static double now_sec(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ====================================================================
+// ============================ LEGACY ================================
+// ====================================================================
+
+/**
+ * @brief 原先的 rxi map，逐字节的 djb2-xor，没有种子
+ */
+typedef struct LegacyNode {
+    unsigned hash;
+    int value;
+    struct LegacyNode *next;
+} LegacyNode;
+
+typedef struct LegacyMap {
+    LegacyNode **buckets;
+    unsigned nbuckets, nnodes;
+} LegacyMap;
+
+static unsigned legacy_hash(const char *str){
+    unsigned hash = 5381;
+    while (*str) {
+        hash = ((hash << 5) + hash) ^ *str++;
+    }
+    return hash;
+}
+
+static LegacyNode *legacy_find(LegacyMap *m, const char *key, unsigned hash){
+    if(m->nbuckets == 0) return NULL;
+    for(LegacyNode *node = m->buckets[hash & (m->nbuckets - 1)]; node; node = node->next){
+        if(node->hash == hash && !strcmp((char *)(node + 1), key)){
+            return node;
+        }
+    }
+    return NULL;
+}
+
+static int *legacy_get(LegacyMap *m, const char *key){
+    LegacyNode *node = legacy_find(m, key, legacy_hash(key));
+    return node ? &node->value : NULL;
+}
+
+static void legacy_set(LegacyMap *m, const char *key, int value){
+    unsigned hash = legacy_hash(key);
+    LegacyNode *node = legacy_find(m, key, hash);
+    if(node){
+        node->value = value;
+        return;
+    }
+    if(m->nnodes >= m->nbuckets){
+        unsigned nbuckets = m->nbuckets ? m->nbuckets << 1 : 1;
+        LegacyNode **buckets = calloc(nbuckets, sizeof(LegacyNode *));
+        for(unsigned i = 0; i < m->nbuckets; i++){
+            LegacyNode *next;
+            for(LegacyNode *n = m->buckets[i]; n; n = next){
+                next = n->next;
+                n->next = buckets[n->hash & (nbuckets - 1)];
+                buckets[n->hash & (nbuckets - 1)] = n;
+            }
+        }
+        free(m->buckets);
+        m->buckets = buckets;
+        m->nbuckets = nbuckets;
+    }
+    size_t ksize = strlen(key) + 1;
+    node = malloc(sizeof(LegacyNode) + ksize);
+    memcpy(node + 1, key, ksize);
+    node->hash = hash;
+    node->value = value;
+    node->next = m->buckets[hash & (m->nbuckets - 1)];
+    m->buckets[hash & (m->nbuckets - 1)] = node;
+    m->nnodes++;
+}
+
+static void legacy_deinit(LegacyMap *m){
+    for(unsigned i = 0; i < m->nbuckets; i++){
+        LegacyNode *next;
+        for(LegacyNode *n = m->buckets[i]; n; n = next){
+            next = n->next;
+            free(n);
+        }
+    }
+    free(m->buckets);
+}
+
+// ====================================================================
+// ============================ ATTACK ================================
+// ====================================================================
+
+static const char ALPHABET[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_";
+#define SUFFIX_LEN 3
+#define SUFFIX_COUNT (64 * 64 * 64)
+#define PREFIX_LEN 8
+
+/**
+ * @brief djb2-xor 每一步 h = h*33 ^ c 都可逆，从目标值倒推所有 3 字节后缀，
+ *        再枚举前缀正向计算，命中后缀表即得到一个碰撞 key (中间相遇)
+ */
+static char **make_collisions(int count, unsigned target){
+    unsigned inv33 = 33;
+    for(int i = 0; i < 5; i++) inv33 *= 2 - 33 * inv33;
+
+    // 后缀表：倒推出的中间值 -> 后缀编号，开放寻址；前面加一个按高24位的位图过滤
+    unsigned table_size = SUFFIX_COUNT * 4;
+    unsigned *mids = malloc(sizeof(unsigned) * table_size);
+    int *ids = malloc(sizeof(int) * table_size);
+    unsigned char *filter = calloc(1 << 21, 1);
+    memset(ids, -1, sizeof(int) * table_size);
+    for(int id = 0; id < SUFFIX_COUNT; id++){
+        unsigned h = target;
+        for(int k = SUFFIX_LEN - 1; k >= 0; k--){
+            h = (h ^ (unsigned char)ALPHABET[(id >> (6 * (SUFFIX_LEN - 1 - k))) & 63]) * inv33;
+        }
+        unsigned slot = (h * 2654435761u) & (table_size - 1);
+        while (ids[slot] >= 0) slot = (slot + 1) & (table_size - 1);
+        mids[slot] = h;
+        ids[slot] = id;
+        filter[h >> 11] |= 1 << ((h >> 8) & 7);
+    }
+
+    char **keys = malloc(sizeof(char *) * count);
+    int found = 0;
+    char key[PREFIX_LEN + SUFFIX_LEN + 1];
+    unsigned head = 0;
+    for(uint64_t n = 0; found < count; n++){
+        // 前缀的最后一个字符变化最快，前面部分的值每 64 次才重新计算
+        if((n & 63) == 0){
+            head = 5381;
+            for(int k = 0; k < PREFIX_LEN - 1; k++){
+                key[k] = ALPHABET[(n >> (6 * (PREFIX_LEN - k - 1))) & 63];
+                head = head * 33 ^ (unsigned char)key[k];
+            }
+        }
+        key[PREFIX_LEN - 1] = ALPHABET[n & 63];
+        unsigned h = head * 33 ^ (unsigned char)key[PREFIX_LEN - 1];
+        if(!(filter[h >> 11] & (1 << ((h >> 8) & 7)))){
+            continue;
+        }
+        unsigned slot = (h * 2654435761u) & (table_size - 1);
+        for(; ids[slot] >= 0; slot = (slot + 1) & (table_size - 1)){
+            if(mids[slot] != h) continue;
+            int id = ids[slot];
+            // 后缀编号的高位是第一个字符
+            for(int k = 0; k < SUFFIX_LEN; k++){
+                key[PREFIX_LEN + k] = ALPHABET[(id >> (6 * (SUFFIX_LEN - 1 - k))) & 63];
+            }
+            key[PREFIX_LEN + SUFFIX_LEN] = '\0';
+            keys[found++] = strdup(key);
+            break;
+        }
+    }
+    free(mids);
+    free(ids);
+    free(filter);
+    return keys;
+}
+
+static char **make_random_keys(int count, int len){
+    char **keys = malloc(sizeof(char *) * count);
+    for(int i = 0; i < count; i++){
+        keys[i] = malloc(len + 1);
+        for(int k = 0; k < len; k++){
+            keys[i][k] = ALPHABET[rand() & 63];
+        }
+        keys[i][len] = '\0';
+    }
+    return keys;
+}
+
+static void free_keys(char **keys, int count){
+    for(int i = 0; i < count; i++) free(keys[i]);
+    free(keys);
+}
+
+// ====================================================================
+// ============================= BENCH ================================
+// ====================================================================
+
+/**
+ * @brief 插入全部 key rounds 次，再按 order 查找，返回 ns/op
+ */
+static void bench_legacy(char **keys, int count, int rounds, const int *order, int lookups,
+                         double *insert_ns, double *lookup_ns, long *check){
+    LegacyMap m = {0};
+    double start = now_sec();
+    for(int round = 0; round < rounds; round++){
+        legacy_deinit(&m);
+        m = (LegacyMap){0};
+        for(int i = 0; i < count; i++) legacy_set(&m, keys[i], i);
+    }
+    *insert_ns = (now_sec() - start) * 1e9 / ((double)rounds * count);
+    start = now_sec();
+    for(int i = 0; i < lookups; i++) *check += *legacy_get(&m, keys[order[i]]);
+    *lookup_ns = (now_sec() - start) * 1e9 / lookups;
+    legacy_deinit(&m);
+}
+
+static void bench_map(char **keys, int count, int rounds, const int *order, int lookups,
+                      double *insert_ns, double *lookup_ns, long *check){
+    map_int_t m;
+    map_init(&m);
+    double start = now_sec();
+    for(int round = 0; round < rounds; round++){
+        map_deinit(&m);
+        map_init(&m);
+        for(int i = 0; i < count; i++) map_set(&m, keys[i], i);
+    }
+    *insert_ns = (now_sec() - start) * 1e9 / ((double)rounds * count);
+    start = now_sec();
+    for(int i = 0; i < lookups; i++) *check += *map_get(&m, keys[order[i]]);
+    *lookup_ns = (now_sec() - start) * 1e9 / lookups;
+    map_deinit(&m);
+}
+
+static int *make_order(int count, int lookups){
+    int *order = malloc(sizeof(int) * lookups);
+    for(int i = 0; i < lookups; i++) order[i] = rand() % count;
+    return order;
+}
+
+int main(){
+    static const int lengths[] = {8, 16, 32, 64, 256};
+    long check = 0;
+    double li, ll, mi, ml;
+    srand(42);
+
+    printf("normal keys (%d keys, %d lookups)\n", NORMAL_KEYS, LOOKUPS);
+    printf("%6s %14s %14s %14s %14s\n", "len", "djb2 insert", "djb2 get", "wyhash insert", "wyhash get");
+    int *order = make_order(NORMAL_KEYS, LOOKUPS);
+    for(size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++){
+        char **keys = make_random_keys(NORMAL_KEYS, lengths[i]);
+        bench_legacy(keys, NORMAL_KEYS, 50, order, LOOKUPS, &li, &ll, &check);
+        bench_map(keys, NORMAL_KEYS, 50, order, LOOKUPS, &mi, &ml, &check);
+        printf("%6d %11.1f ns %11.1f ns %11.1f ns %11.1f ns\n", lengths[i], li, ll, mi, ml);
+        free_keys(keys, NORMAL_KEYS);
+    }
+    free(order);
+
+    // 碰撞攻击：所有 key 的 djb2 值相同，原先的 map 退化为一条链表
+    double start = now_sec();
+    char **attack = make_collisions(ATTACK_KEYS, 0x5eed1234u);
+    printf("\ncollision attack (%d keys with djb2 hash 0x%08x, generated in %.2fs)\n",
+        ATTACK_KEYS, legacy_hash(attack[0]), now_sec() - start);
+    for(int i = 1; i < ATTACK_KEYS; i++){
+        if(legacy_hash(attack[i]) != legacy_hash(attack[0])){
+            fprintf(stderr, "bad collision key %s\n", attack[i]);
+            return 1;
+        }
+    }
+    char **normal = make_random_keys(ATTACK_KEYS, PREFIX_LEN + SUFFIX_LEN);
+    int lookups = LOOKUPS / 20;
+    order = make_order(ATTACK_KEYS, lookups);
+
+    printf("%-10s %14s %14s\n", "keys", "insert", "get");
+    bench_legacy(normal, ATTACK_KEYS, 10, order, lookups, &li, &ll, &check);
+    printf("%-10s %11.1f ns %11.1f ns\n", "djb2 rand", li, ll);
+    bench_legacy(attack, ATTACK_KEYS, 1, order, lookups, &li, &ll, &check);
+    printf("%-10s %11.1f ns %11.1f ns\n", "djb2 atk", li, ll);
+    bench_map(normal, ATTACK_KEYS, 10, order, lookups, &mi, &ml, &check);
+    printf("%-10s %11.1f ns %11.1f ns\n", "wyhash rand", mi, ml);
+    bench_map(attack, ATTACK_KEYS, 10, order, lookups, &mi, &ml, &check);
+    printf("%-10s %11.1f ns %11.1f ns\n", "wyhash atk", mi, ml);
+    printf("(check=%ld)\n", check);
+
+    free(order);
+    free_keys(normal, ATTACK_KEYS);
+    free_keys(attack, ATTACK_KEYS);
+    return 0;
+}
@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "util/map.h"
+
+// 原先的链式哈希 map vs 开放寻址 map：插入、命中、未命中、遍历，表的大小从请求头到大路由表
+
+#define OPS 4000000
+
+static double now_sec(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ====================================================================
+// ============================ LEGACY ================================
+// ====================================================================
+
+/**
+ * @brief 原先的 rxi map：每个条目一个节点，冲突用链表串起来
+ */
+typedef struct LegacyNode {
+    unsigned hash;
+    void *value;
+    struct LegacyNode *next;
+} LegacyNode;
+
+typedef struct LegacyMap {
+    LegacyNode **buckets;
+    unsigned nbuckets, nnodes;
+} LegacyMap;
+
+static unsigned legacy_hash(const char *str){
+    unsigned hash = 5381;
+    while (*str) {
+        hash = ((hash << 5) + hash) ^ *str++;
+    }
+    return hash;
+}
+
+static LegacyNode **legacy_getref(LegacyMap *m, const char *key){
+    unsigned hash = legacy_hash(key);
+    if(m->nbuckets > 0){
+        LegacyNode **next = &m->buckets[hash & (m->nbuckets - 1)];
+        while (*next) {
+            if((*next)->hash == hash && !strcmp((char *)(*next + 1), key)){
+                return next;
+            }
+            next = &(*next)->next;
+        }
+    }
+    return NULL;
+}
+
+static void legacy_resize(LegacyMap *m, unsigned nbuckets){
+    LegacyNode *nodes = NULL, *node, *next;
+    for(unsigned i = 0; i < m->nbuckets; i++){
+        for(node = m->buckets[i]; node; node = next){
+            next = node->next;
+            node->next = nodes;
+            nodes = node;
+        }
+    }
+    m->buckets = realloc(m->buckets, sizeof(*m->buckets) * nbuckets);
+    m->nbuckets = nbuckets;
+    memset(m->buckets, 0, sizeof(*m->buckets) * nbuckets);
+    for(node = nodes; node; node = next){
+        next = node->next;
+        unsigned n = node->hash & (nbuckets - 1);
+        node->next = m->buckets[n];
+        m->buckets[n] = node;
+    }
+}
+
+static void *legacy_get(LegacyMap *m, const char *key){
+    LegacyNode **next = legacy_getref(m, key);
+    return next ? (*next)->value : NULL;
+}
+
+static void legacy_set(LegacyMap *m, const char *key, int value){
+    LegacyNode **next = legacy_getref(m, key);
+    if(next){
+        memcpy((*next)->value, &value, sizeof(value));
+        return;
+    }
+    int ksize = strlen(key) + 1;
+    int voffset = ksize + ((sizeof(void *) - ksize) % sizeof(void *));
+    LegacyNode *node = malloc(sizeof(*node) + voffset + sizeof(value));
+    memcpy(node + 1, key, ksize);
+    node->hash = legacy_hash(key);
+    node->value = ((char *)(node + 1)) + voffset;
+    memcpy(node->value, &value, sizeof(value));
+    if(m->nnodes >= m->nbuckets){
+        legacy_resize(m, m->nbuckets > 0 ? m->nbuckets << 1 : 1);
+    }
+    unsigned n = node->hash & (m->nbuckets - 1);
+    node->next = m->buckets[n];
+    m->buckets[n] = node;
+    m->nnodes++;
+}
+
+static const char *legacy_next(LegacyMap *m, unsigned *bucketidx, LegacyNode **node){
+    if(*node && (*node)->next){
+        *node = (*node)->next;
+        return (char *)(*node + 1);
+    }
+    while (++*bucketidx < m->nbuckets)
+    {
+        if((*node = m->buckets[*bucketidx]) != NULL){
+            return (char *)(*node + 1);
+        }
+    }
+    return NULL;
+}
+
+static void legacy_deinit(LegacyMap *m){
+    for(unsigned i = 0; i < m->nbuckets; i++){
+        LegacyNode *node = m->buckets[i], *next;
+        for(; node; node = next){
+            next = node->next;
+            free(node);
+        }
+    }
+    free(m->buckets);
+}
+
+// ====================================================================
+// ============================= BENCH ================================
+// ====================================================================
+
+typedef struct BenchResult {
+    double insert, hit, miss, iter;     // ns/op
+    long check;
+} BenchResult;
+
+static char **keys, **misses;
+static int *order;
+
+static void make_keys(int count){
+    char buf[64];
+    keys = malloc(sizeof(char *) * count);
+    misses = malloc(sizeof(char *) * count);
+    for(int i = 0; i < count; i++){
+        // 形如路由和请求头的 key
+        snprintf(buf, sizeof(buf), "/api/v%d/resource-%d/list", i % 7, i);
+        keys[i] = strdup(buf);
+        snprintf(buf, sizeof(buf), "/api/v%d/resource-%d/miss", i % 7, i);
+        misses[i] = strdup(buf);
+    }
+    order = malloc(sizeof(int) * OPS);
+    srand(42);
+    for(int i = 0; i < OPS; i++){
+        order[i] = rand() % count;
+    }
+}
+
+static void free_keys(int count){
+    for(int i = 0; i < count; i++){
+        free(keys[i]);
+        free(misses[i]);
+    }
+    free(keys);
+    free(misses);
+    free(order);
+}
+
+static BenchResult bench_legacy(int count){
+    BenchResult r = {0};
+    int rounds = OPS / count;
+    double start = now_sec();
+    for(int round = 0; round < rounds; round++){
+        LegacyMap m = {0};
+        for(int i = 0; i < count; i++) legacy_set(&m, keys[i], i);
+        r.check += m.nnodes;
+        legacy_deinit(&m);
+    }
+    r.insert = (now_sec() - start) * 1e9 / ((double)rounds * count);
+
+    LegacyMap m = {0};
+    for(int i = 0; i < count; i++) legacy_set(&m, keys[i], i);
+
+    start = now_sec();
+    for(int i = 0; i < OPS; i++){
+        int *v = legacy_get(&m, keys[order[i]]);
+        r.check += *v;
+    }
+    r.hit = (now_sec() - start) * 1e9 / OPS;
+
+    start = now_sec();
+    for(int i = 0; i < OPS; i++){
+        r.check += legacy_get(&m, misses[order[i]]) == NULL;
+    }
+    r.miss = (now_sec() - start) * 1e9 / OPS;
+
+    start = now_sec();
+    for(int round = 0; round < rounds; round++){
+        unsigned bucketidx = -1;
+        LegacyNode *node = NULL;
+        const char *key;
+        while ((key = legacy_next(&m, &bucketidx, &node)) != NULL)
+        {
+            r.check += key[0];
+        }
+    }
+    r.iter = (now_sec() - start) * 1e9 / ((double)rounds * count);
+    legacy_deinit(&m);
+    return r;
+}
+
+static BenchResult bench_map(int count){
+    BenchResult r = {0};
+    int rounds = OPS / count;
+    double start = now_sec();
+    for(int round = 0; round < rounds; round++){
+        map_int_t m;
+        map_init(&m);
+        for(int i = 0; i < count; i++) map_set(&m, keys[i], i);
+        r.check += m.base.nnodes;
+        map_deinit(&m);
+    }
+    r.insert = (now_sec() - start) * 1e9 / ((double)rounds * count);
+
+    map_int_t m;
+    map_init(&m);
+    for(int i = 0; i < count; i++) map_set(&m, keys[i], i);
+
+    start = now_sec();
+    for(int i = 0; i < OPS; i++){
+        int *v = map_get(&m, keys[order[i]]);
+        r.check += *v;
+    }
+    r.hit = (now_sec() - start) * 1e9 / OPS;
+
+    start = now_sec();
+    for(int i = 0; i < OPS; i++){
+        r.check += map_get(&m, misses[order[i]]) == NULL;
+    }
+    r.miss = (now_sec() - start) * 1e9 / OPS;
+
+    start = now_sec();
+    for(int round = 0; round < rounds; round++){
+        map_iter_t iter = map_iter(&m);
+        const char *key;
+        while ((key = map_next(&m, &iter)) != NULL)
+        {
+            r.check += key[0];
+        }
+    }
+    r.iter = (now_sec() - start) * 1e9 / ((double)rounds * count);
+    map_deinit(&m);
+    return r;
+}
+
+static void bench_print(const char *name, int count, BenchResult r){
+    printf("%-7s %7d %10.1f %10.1f %10.1f %10.1f  (check=%ld)\n",
+        name, count, r.insert, r.hit, r.miss, r.iter, r.check);
+}
+
+int main(){
+    static const int sizes[] = {16, 1000, 100000};
+
+    printf("%-7s %7s %10s %10s %10s %10s   ns/op\n", "map", "keys", "insert", "hit", "miss", "iter");
+    for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++){
+        int count = sizes[i];
+        make_keys(count);
+        BenchResult legacy = bench_legacy(count);
+        BenchResult swiss = bench_map(count);
+        bench_print("legacy", count, legacy);
+        bench_print("swiss", count, swiss);
+        printf("speedup insert %.2fx hit %.2fx miss %.2fx iter %.2fx\n\n",
+            legacy.insert / swiss.insert, legacy.hit / swiss.hit,
+            legacy.miss / swiss.miss, legacy.iter / swiss.iter);
+        free_keys(count);
+    }
+    return 0;
+}
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "http/parser.h"
+#include "http/scan.h"
+#include "util/map.h"
+#include "util/util_string.h"
+
+// 对比状态机解析器和原先逐行 malloc + strncpy + sscanf + map 的解析方式，
+// 以及状态机在标量/SSE4.2/AVX2 扫描实现下的差异
+
+#define ITERATIONS 200000
+#define MAX_LINE_SIZE 8192
+#define MAX_HEADER_SIZE 8192
+#define MAX_BODY_SIZE 1048576
+
+static const char *REQ_SMALL =
+    "GET /test HTTP/1.1\r\n"
+    "Host: 127.0.0.1:8088\r\n"
+    "User-Agent: curl/7.88.1\r\n"
+    "Accept: */*\r\n"
+    "\r\n";
+
+static const char *REQ_BROWSER =
+    "GET /api/v1/users/1024/profile?fields=name,avatar&lang=zh-CN HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "\r\n";
+
+static char *req_cookie;  // 大 Cookie 请求，运行时生成
+
+// ====================================================================
+// ============================ LEGACY ================================
+// ====================================================================
+
+static void legacy_add_header(map_str_t *map, const char *key, char *value){
+    char **old = (char **)map_get(map, key);
+    if(old == NULL){
+        size_t len = strlen(value)+1;
+        map_set(map, key, memcpy(malloc(len), value, len));
+        return;
+    }
+    char *old_val = *old;
+    char *new = str_append(*old, value);
+    free(old_val);
+    old_val = new;
+    new = str_append(new, ";");
+    free(old_val);
+    map_set(map, key, new);
+}
+
+static void legacy_clear(map_str_t *map){
+    map_iter_t iter = map_iter();
+    const char *key;
+    while ((key = map_next(map, &iter)) != NULL)
+    {
+        free(*map_get(map, key));
+    }
+    map_deinit(map);
+}
+
+static char *legacy_take_line(char *buf, size_t *pos, size_t header_len, size_t *len){
+    char *start = buf + *pos;
+    char *lf = memchr(start, '\n', header_len - *pos);
+    if(lf == NULL) return NULL;
+    *pos += lf - start + 1;
+    if(lf > start && *(lf-1) == '\r') lf--;
+    *lf = '\0';
+    *len = lf - start;
+    return start;
+}
+
+/**
+ * @brief 原先的解析流程：事件循环逐行扫描找到请求头结尾，工作线程逐行复制并写入 map
+ */
+static int legacy_parse(char *buf, size_t len){
+    // 事件循环中的扫描
+    size_t scan = 0, header_len = 0;
+    while (header_len == 0)
+    {
+        char *lf = memchr(buf + scan, '\n', len - scan);
+        if(lf == NULL) return -1;
+        size_t line_len = lf - (buf + scan);
+        if(line_len > 0 && *(lf-1) == '\r') line_len--;
+        if(scan > 0 && line_len == 0) header_len = lf - buf + 1;
+        scan = lf - buf + 1;
+    }
+
+    // 工作线程中的解析
+    char method[8], version[9];
+    map_str_t header;
+    map_init(&header);
+    size_t pos = 0, line_len;
+    char *line = legacy_take_line(buf, &pos, header_len, &line_len);
+    char *path = calloc(line_len+1, 1);
+    if(sscanf(line, "%7s %8191s %8s", method, path, version) < 2){
+        free(path);
+        return -1;
+    }
+    while ((line = legacy_take_line(buf, &pos, header_len, &line_len)) != NULL && line_len > 0)
+    {
+        char *entry = malloc(line_len+1);
+        strncpy(entry, line, line_len);
+        entry[line_len] = '\0';
+        char *col = strchr(entry, ':');
+        if(col){
+            *col = '\0';
+            char *value = col+1;
+            while (*value == ' ') value++;
+            legacy_add_header(&header, entry, value);
+        }
+        free(entry);
+    }
+    int count = header.base.nnodes;
+    legacy_clear(&header);
+    free(path);
+    return count;
+}
+
+// ====================================================================
+// ============================ PARSER ================================
+// ====================================================================
+
+/**
+ * @brief 状态机解析，并像 http_request_init 一样把切片原地截断
+ */
+static int parser_parse(char *buf, size_t len){
+    HttpParser parser;
+    http_parser_init(&parser);
+    if(http_parser_execute(&parser, buf, len, MAX_LINE_SIZE + MAX_HEADER_SIZE, MAX_BODY_SIZE) != HTTP_PARSE_DONE){
+        return -1;
+    }
+
+    HttpSlice names[HTTP_PARSER_MAX_HEADERS], values[HTTP_PARSER_MAX_HEADERS];
+    buf[parser.method.off + parser.method.len] = '\0';
+    buf[parser.path.off + parser.path.len] = '\0';
+    buf[parser.version.off + parser.version.len] = '\0';
+    for(int i = 0; i < parser.header_count; i++){
+        names[i] = http_span_slice(buf, parser.headers[i].name);
+        values[i] = http_span_slice(buf, parser.headers[i].value);
+        buf[parser.headers[i].name.off + parser.headers[i].name.len] = '\0';
+        buf[parser.headers[i].value.off + parser.headers[i].value.len] = '\0';
+    }
+    return parser.header_count + (names[0].len & 0) + (values[0].len & 0);
+}
+
+// ====================================================================
+// ============================= BENCH ================================
+// ====================================================================
+
+static double now_sec(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double bench_run(int (*fn)(char *, size_t), char *buf, const char *req, size_t len, long *check){
+    *check = 0;
+    double start = now_sec();
+    for(int i = 0; i < ITERATIONS; i++){
+        memcpy(buf, req, len);
+        *check += fn(buf, len);
+    }
+    return now_sec() - start;
+}
+
+static void bench_print(const char *name, const char *label, size_t len, double elapsed, long check){
+    printf("%-8s %-7s %6zu bytes  %8.1f ns/req  %8.1f MB/s  (headers=%ld)\n",
+        name, label, len, elapsed * 1e9 / ITERATIONS, len * (double)ITERATIONS / elapsed / 1e6, check / ITERATIONS);
+}
+
+static void bench(const char *name, const char *req){
+    static const HttpScanLevel levels[3] = { HTTP_SCAN_SCALAR, HTTP_SCAN_SSE42, HTTP_SCAN_AVX2 };
+    static const char *labels[3] = { "scalar", "sse4.2", "avx2" };
+    size_t len = strlen(req);
+    char *buf = malloc(len);
+    long check;
+
+    double legacy = bench_run(legacy_parse, buf, req, len, &check);
+    bench_print(name, "legacy", len, legacy, check);
+
+    double scalar = 0, best = 0;
+    for(int l = 0; l < 3; l++){
+        if(http_scan_set_level(levels[l]) != 0){
+            printf("%-8s %-7s unsupported\n", name, labels[l]);
+            continue;
+        }
+        double elapsed = bench_run(parser_parse, buf, req, len, &check);
+        bench_print(name, labels[l], len, elapsed, check);
+        if(l == 0) scalar = elapsed;
+        best = elapsed;
+    }
+    printf("%-8s speedup vs legacy %.2fx, simd vs scalar %.2fx\n\n", name, legacy / best, scalar / best);
+    free(buf);
+}
+
+int main(){
+    // 4KB Cookie
+    const char *head = "GET /cart HTTP/1.1\r\nHost: shop.example.com\r\nCookie: ";
+    size_t cookie_len = 4096;
+    req_cookie = malloc(strlen(head) + cookie_len + 64);
+    strcpy(req_cookie, head);
+    char *p = req_cookie + strlen(head);
+    for(size_t i = 0; i < cookie_len; i++){
+        *p++ = (i % 40 == 39) ? ';' : (i % 40 == 0 ? ' ' : 'a' + i % 26);
+    }
+    strcpy(p, "\r\nAccept: */*\r\n\r\n");
+
+    // 40个中等长度的请求头
+    char *req_many = malloc(64 * 1024);
+    p = req_many + sprintf(req_many, "POST /upload HTTP/1.1\r\nHost: api.example.com\r\n");
+    for(int i = 0; i < 40; i++){
+        p += sprintf(p, "X-Trace-Attribute-%02d: service=gateway;region=ap-east-1;span=%08x%08x\r\n", i, i * 2654435761u, ~i);
+    }
+    strcpy(p, "\r\n");
+
+    bench("small", REQ_SMALL);
+    bench("browser", REQ_BROWSER);
+    bench("cookie", req_cookie);
+    bench("many", req_many);
+
+    free(req_cookie);
+    free(req_many);
+    return 0;
+}
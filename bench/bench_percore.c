@@ -0,0 +1,241 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "http/http.h"
+
+// 按核数扩展：每核独立模式下事件循环数从1增加到 CPU 核数，每个事件循环对应一个客户端线程，
+// 每个客户端线程在 CONNS 个长连接上轮流发送请求; 同样的核数再用共用线程池的方式对比。
+// 按 CPU 分配的方式每个可用的 CPU 一个事件循环，服务器线程的 CPU 亲和性限制为前 loops 个 CPU，客户端线程不限制
+
+#define DURATION 2.0        // 每种配置运行的秒数
+#define CONNS 16            // 每个客户端线程的连接数
+#define BASE_PORT 18420
+
+static atomic_long done;
+static atomic_long failed;
+static atomic_int running;
+static int port;
+static size_t response_len;     // 每个返回的长度，所有返回相同
+
+static const char REQUEST[] = "GET /ping HTTP/1.1\r\nHost: bench\r\n\r\n";
+
+static void route_ping(HttpRequest *request, HttpResponse *response){
+    http_response_write_static(response, "pong", 4);
+}
+
+static double now_sec(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int connect_server(){
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0){
+        return -1;
+    }
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = inet_addr("127.0.0.1"),
+    };
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief 读完一个返回
+ * @return 成功返回0,失败返回-1
+ */
+static int read_response(int fd){
+    char buf[512];
+    size_t total = 0;
+    while (total < response_len)
+    {
+        size_t want = response_len - total;
+        ssize_t n = recv(fd, buf, want < sizeof(buf) ? want : sizeof(buf), 0);
+        if(n <= 0){
+            return -1;
+        }
+        total += n;
+    }
+    return 0;
+}
+
+static void *client(void *arg){
+    int fds[CONNS];
+    for(int i = 0; i < CONNS; i++){
+        fds[i] = connect_server();
+    }
+    while (atomic_load_explicit(&running, memory_order_relaxed))
+    {
+        // 每个连接一个请求在途，所有连接都发出后再依次读取
+        for(int i = 0; i < CONNS; i++){
+            if(fds[i] >= 0 && send(fds[i], REQUEST, sizeof(REQUEST) - 1, MSG_NOSIGNAL) != sizeof(REQUEST) - 1){
+                close(fds[i]);
+                fds[i] = -1;
+            }
+        }
+        long ok = 0, bad = 0;
+        for(int i = 0; i < CONNS; i++){
+            if(fds[i] >= 0 && read_response(fds[i]) == 0){
+                ok++;
+                continue;
+            }
+            bad++;
+            if(fds[i] >= 0){
+                close(fds[i]);
+            }
+            fds[i] = connect_server();
+        }
+        atomic_fetch_add_explicit(&done, ok, memory_order_relaxed);
+        atomic_fetch_add_explicit(&failed, bad, memory_order_relaxed);
+    }
+    for(int i = 0; i < CONNS; i++){
+        if(fds[i] >= 0){
+            close(fds[i]);
+        }
+    }
+    return NULL;
+}
+
+static cpu_set_t all_cpus;     // 开始时的 CPU 亲和性
+
+/**
+ * @brief 当前线程只使用 all_cpus 中的前 n 个 CPU, n <= 0 时恢复全部
+ */
+static void limit_cpus(int n){
+    cpu_set_t set = all_cpus;
+    if(n > 0){
+        CPU_ZERO(&set);
+        for(int c = 0; c < CPU_SETSIZE && n > 0; c++){
+            if(CPU_ISSET(c, &all_cpus)){
+                CPU_SET(c, &set);
+                n--;
+            }
+        }
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void *server_run(void *arg){
+    http_server_start((HttpServer *)arg);
+    return NULL;
+}
+
+/**
+ * @brief 等到服务器可以连接，并记录返回的长度
+ * @return 成功返回0,失败返回-1
+ */
+static int wait_ready(){
+    for(int i = 0; i < 200; i++){
+        int fd = connect_server();
+        if(fd >= 0){
+            char buf[512];
+            ssize_t n = 0;
+            if(send(fd, REQUEST, sizeof(REQUEST) - 1, MSG_NOSIGNAL) == sizeof(REQUEST) - 1){
+                n = recv(fd, buf, sizeof(buf), 0);
+            }
+            close(fd);
+            if(n > 0){
+                response_len = n;
+                return 0;
+            }
+        }
+        usleep(10000);
+    }
+    return -1;
+}
+
+/**
+ * @brief 一种配置的吞吐量
+ * @return 每秒完成的请求数
+ */
+static double run(HttpListenMode mode, int loops){
+    HttpServer *svr = http_server_new();
+    http_server_init(svr, "127.0.0.1", port);
+    http_server_set_listeners(svr, mode, loops);
+    http_server_set_keepalive(svr, 0, 5000);
+    http_server_route_add(svr, HTTP_METHOD_GET, "/ping", route_ping);
+
+    // 服务器线程继承创建时的亲和性，之后创建的客户端线程不受限制
+    pthread_t server_thread;
+    limit_cpus(loops);
+    pthread_create(&server_thread, NULL, server_run, svr);
+    limit_cpus(0);
+    if(wait_ready() != 0){
+        fprintf(stderr, "server on port %d not ready\n", port);
+        exit(1);
+    }
+
+    atomic_store(&done, 0);
+    atomic_store(&failed, 0);
+    atomic_store(&running, 1);
+    pthread_t *threads = malloc(sizeof(pthread_t) * loops);
+    double start = now_sec();
+    for(int i = 0; i < loops; i++){
+        pthread_create(&threads[i], NULL, client, NULL);
+    }
+    usleep((useconds_t)(DURATION * 1e6));
+    atomic_store(&running, 0);
+    for(int i = 0; i < loops; i++){
+        pthread_join(threads[i], NULL);
+    }
+    double rate = atomic_load(&done) / (now_sec() - start);
+    free(threads);
+
+    http_server_stop(svr);
+    pthread_join(server_thread, NULL);
+    http_server_destroy(svr);
+    if(atomic_load(&failed) > 0){
+        printf("  (%ld failed)\n", atomic_load(&failed));
+    }
+    port++;
+    return rate;
+}
+
+int main(int argc, char **argv){
+    pthread_getaffinity_np(pthread_self(), sizeof(all_cpus), &all_cpus);
+    long cpus = CPU_COUNT(&all_cpus);
+    int max_loops = argc > 1 ? atoi(argv[1]) : (int)cpus;
+    if(max_loops < 1 || max_loops > cpus){
+        max_loops = (int)cpus;
+    }
+    port = BASE_PORT;
+
+    printf("%ld cpus, up to %d loops, %d connections per client thread, %.0fs each\n\n",
+           cpus, max_loops, CONNS, DURATION);
+    printf("%6s %14s %9s %11s %16s\n", "loops", "per-core req/s", "speedup", "efficiency", "thread pool req/s");
+    // 1, 2, 4, ... 最后是 max_loops
+    double base = 0;
+    int loops = 1;
+    for(;;){
+        double rate = run(HTTP_LISTEN_PER_CORE, loops);
+        double pool = run(HTTP_LISTEN_REUSEPORT_CPU, loops);
+        if(base == 0){
+            base = rate;
+        }
+        printf("%6d %14.0f %8.2fx %10.0f%% %16.0f\n", loops, rate, rate / base, rate / base / loops * 100, pool);
+        if(loops >= max_loops){
+            break;
+        }
+        loops = loops * 2 < max_loops ? loops * 2 : max_loops;
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "http/http.h"
+
+// 同名查询参数: "?a&a&a..." 中 a 的个数每次加倍，解析时间应同样加倍; 同时检查 http_request_query_all 返回的数量
+
+#define ROUNDS 200          // 每种数量的请求数
+#define MIN_KEYS 250
+#define MAX_KEYS 4000       // 请求行不超过 8KB
+#define PORT 18460
+
+static void route_count(HttpRequest *request, HttpResponse *response){
+    char **values = http_request_query_all(request, "a");
+    int count = 0;
+    while (values != NULL && values[count] != NULL) count++;
+    char *body = http_request_alloc(request, 16);
+    snprintf(body, 16, "%d", count);
+    http_response_write(response, body);
+}
+
+static double now_sec(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int connect_server(){
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0){
+        return -1;
+    }
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(PORT),
+        .sin_addr.s_addr = inet_addr("127.0.0.1"),
+    };
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief 发送请求，读到服务器关闭，取出返回的数量
+ * @return 返回的数量, 失败返回-1
+ */
+static int query(const char *request, size_t len){
+    int fd = connect_server();
+    if(fd < 0){
+        return -1;
+    }
+    char buf[1024];
+    size_t total = 0;
+    if(send(fd, request, len, MSG_NOSIGNAL) == (ssize_t)len){
+        ssize_t n;
+        while (total < sizeof(buf) - 1 && (n = recv(fd, buf + total, sizeof(buf) - 1 - total, 0)) > 0)
+        {
+            total += n;
+        }
+    }
+    close(fd);
+    buf[total] = '\0';
+    char *body = strstr(buf, "\r\n\r\n");
+    return body ? atoi(body + 4) : -1;
+}
+
+static void *server_run(void *arg){
+    http_server_start((HttpServer *)arg);
+    return NULL;
+}
+
+int main(){
+    HttpServer *svr = http_server_new();
+    http_server_init(svr, "127.0.0.1", PORT);
+    http_server_route_add(svr, HTTP_METHOD_GET, "/count", route_count);
+    pthread_t server_thread;
+    pthread_create(&server_thread, NULL, server_run, svr);
+
+    char *request = malloc(MAX_KEYS * 2 + 128);
+    int ready = 0;
+    for(int i = 0; i < 200 && !ready; i++){
+        ready = query("GET /count HTTP/1.1\r\nHost: bench\r\nConnection: close\r\n\r\n", 55) >= 0;
+        if(!ready){
+            usleep(10000);
+        }
+    }
+    if(!ready){
+        fprintf(stderr, "server on port %d not ready\n", PORT);
+        return 1;
+    }
+
+    printf("%8s %14s %8s\n", "keys", "us/request", "ratio");
+    double last = 0;
+    int failed = 0;
+    for(int keys = MIN_KEYS; keys <= MAX_KEYS; keys *= 2){
+        int len = sprintf(request, "GET /count?");
+        for(int i = 0; i < keys; i++){
+            len += sprintf(request + len, i ? "&a" : "a");
+        }
+        len += sprintf(request + len, " HTTP/1.1\r\nHost: bench\r\nConnection: close\r\n\r\n");
+
+        double start = now_sec();
+        for(int i = 0; i < ROUNDS; i++){
+            int count = query(request, len);
+            if(count != keys){
+                fprintf(stderr, "%d keys: got %d values\n", keys, count);
+                failed = 1;
+                break;
+            }
+        }
+        double us = (now_sec() - start) / ROUNDS * 1e6;
+        printf("%8d %14.1f %7.2fx\n", keys, us, last > 0 ? us / last : 1.0);
+        last = us;
+    }
+    free(request);
+
+    http_server_stop(svr);
+    pthread_join(server_thread, NULL);
+    http_server_destroy(svr);
+    return failed;
+}
@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "queue/queue.h"
+
+// 队列竞争：原先加锁的环形队列 vs 无锁 MPMC 队列(单个/批量)，一半线程生产一半线程消费
+
+#define ITEMS 2000000
+#define CAPACITY 1024
+#define BULK 16
+
+static double now_sec(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ====================================================================
+// ============================ LEGACY ================================
+// ====================================================================
+
+/**
+ * @brief 原先的队列：一个互斥锁保护的环形数组
+ */
+typedef struct LegacyQueue {
+    void **data;
+    int front, rear, size, capacity;
+    pthread_mutex_t mutex;
+} LegacyQueue;
+
+static LegacyQueue *legacy_new(int capacity){
+    LegacyQueue *queue = calloc(1, sizeof(LegacyQueue));
+    queue->data = malloc(sizeof(void *) * capacity);
+    queue->capacity = capacity;
+    pthread_mutex_init(&queue->mutex, NULL);
+    return queue;
+}
+
+static void legacy_destroy(LegacyQueue *queue){
+    pthread_mutex_destroy(&queue->mutex);
+    free(queue->data);
+    free(queue);
+}
+
+static int legacy_enqueue(LegacyQueue *queue, void *entry){
+    pthread_mutex_lock(&queue->mutex);
+    if(queue->size == queue->capacity){
+        pthread_mutex_unlock(&queue->mutex);
+        return -1;
+    }
+    queue->data[queue->rear] = entry;
+    queue->rear = (queue->rear + 1) % queue->capacity;
+    queue->size++;
+    pthread_mutex_unlock(&queue->mutex);
+    return 0;
+}
+
+static int legacy_dequeue(LegacyQueue *queue, void **entry){
+    pthread_mutex_lock(&queue->mutex);
+    if(queue->size == 0){
+        pthread_mutex_unlock(&queue->mutex);
+        *entry = NULL;
+        return -1;
+    }
+    *entry = queue->data[queue->front];
+    queue->front = (queue->front + 1) % queue->capacity;
+    queue->size--;
+    pthread_mutex_unlock(&queue->mutex);
+    return 0;
+}
+
+// ====================================================================
+// ============================= BENCH ================================
+// ====================================================================
+
+typedef enum { MODE_LEGACY, MODE_MPMC, MODE_BULK } BenchMode;
+
+typedef struct BenchArg {
+    BenchMode mode;
+    void *queue;
+    long count;         // 本线程需要生产或消费的条目数
+    long sum;           // 消费到的条目之和，用于校验
+} BenchArg;
+
+static void *producer(void *p){
+    BenchArg *arg = p;
+    void *batch[BULK];
+    for(long i = 1; i <= arg->count; ){
+        if(arg->mode == MODE_LEGACY){
+            while (legacy_enqueue(arg->queue, (void *)i) != 0) sched_yield();
+            i++;
+        }else if(arg->mode == MODE_MPMC){
+            while (queue_enqueue(arg->queue, (void *)i) != 0) sched_yield();
+            i++;
+        }else{
+            int n = 0;
+            for(; n < BULK && i + n <= arg->count; n++) batch[n] = (void *)(i + n);
+            for(int done = 0; done < n; ){
+                int k = queue_enqueue_bulk(arg->queue, batch + done, n - done);
+                if(k == 0) sched_yield();
+                done += k;
+            }
+            i += n;
+        }
+    }
+    return NULL;
+}
+
+static void *consumer(void *p){
+    BenchArg *arg = p;
+    void *batch[BULK];
+    for(long got = 0; got < arg->count; ){
+        if(arg->mode == MODE_BULK){
+            long want = arg->count - got < BULK ? arg->count - got : BULK;
+            int n = queue_dequeue_bulk(arg->queue, batch, (int)want);
+            if(n == 0){
+                sched_yield();
+                continue;
+            }
+            for(int k = 0; k < n; k++) arg->sum += (long)batch[k];
+            got += n;
+        }else{
+            void *entry;
+            int rs = arg->mode == MODE_LEGACY ? legacy_dequeue(arg->queue, &entry)
+                                              : queue_dequeue(arg->queue, &entry);
+            if(rs != 0){
+                sched_yield();
+                continue;
+            }
+            arg->sum += (long)entry;
+            got++;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief threads/2 个生产者和 threads/2 个消费者，共传递 ITEMS 个条目
+ * @return 每秒传递的条目数(百万)
+ */
+static double bench_run(BenchMode mode, int threads){
+    int pairs = threads / 2;
+    long per = ITEMS / pairs;
+    void *queue = mode == MODE_LEGACY ? (void *)legacy_new(CAPACITY) : (void *)queue_new(CAPACITY);
+
+    pthread_t tids[threads];
+    BenchArg args[threads];
+    double start = now_sec();
+    for(int i = 0; i < threads; i++){
+        args[i] = (BenchArg){ .mode = mode, .queue = queue, .count = per, .sum = 0 };
+        pthread_create(&tids[i], NULL, i < pairs ? producer : consumer, &args[i]);
+    }
+    long sum = 0;
+    for(int i = 0; i < threads; i++){
+        pthread_join(tids[i], NULL);
+        sum += args[i].sum;
+    }
+    double elapsed = now_sec() - start;
+
+    if(sum != pairs * (per * (per + 1) / 2)){
+        fprintf(stderr, "checksum mismatch: mode=%d threads=%d\n", mode, threads);
+        exit(1);
+    }
+
+    if(mode == MODE_LEGACY){
+        legacy_destroy(queue);
+    }else{
+        queue_destroy(queue, 0);
+    }
+    return pairs * per / elapsed / 1e6;
+}
+
+int main(){
+    static const int thread_counts[] = {2, 8, 32};
+
+    printf("items=%d capacity=%d bulk=%d\n", ITEMS, CAPACITY, BULK);
+    printf("%8s %14s %14s %14s\n", "threads", "mutex Mop/s", "mpmc Mop/s", "bulk Mop/s");
+    for(size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++){
+        int threads = thread_counts[i];
+        printf("%8d %14.2f %14.2f %14.2f\n", threads,
+            bench_run(MODE_LEGACY, threads), bench_run(MODE_MPMC, threads), bench_run(MODE_BULK, threads));
+    }
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "http/router.h"
+#include "util/map.h"
+
+// 对比前缀树路由、冻结后的完美哈希表和原先 "METHOD path" 字符串作为 key 的 map 查找
+
+#define ROUTES 3000
+#define ITERATIONS 2000000
+
+static const char *RESOURCES[] = {
+    "users", "orders", "products", "carts", "payments", "invoices", "shipments", "reviews",
+    "coupons", "stores", "categories", "inventory", "refunds", "sessions", "tokens",
+};
+#define RESOURCE_COUNT (int)(sizeof(RESOURCES) / sizeof(RESOURCES[0]))
+
+static char *static_paths[ROUTES];  // 静态路由
+static char *param_paths[ROUTES];   // 对应的参数路由的请求路径
+
+static double now_sec(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief 原先的查找方式：每个请求拼接 key 再查 map
+ */
+static void *legacy_match(map_void_t *routes, const char *method, const char *path){
+    char *routeTmp = "%s %s";
+    int l = snprintf(NULL, 0, routeTmp, method, path);
+    char route[l+1];
+    sprintf(route, routeTmp, method, path);
+    void **val = map_get(routes, route);
+    return val ? *val : NULL;
+}
+
+int main(){
+    map_void_t legacy;
+    map_init(&legacy);
+    HttpRouter *router = http_router_new();
+
+    char buf[256];
+    for(int i = 0; i < ROUTES; i++){
+        const char *res = RESOURCES[i % RESOURCE_COUNT];
+        int version = i / RESOURCE_COUNT;
+
+        // 静态: /api/v12/orders/list
+        snprintf(buf, sizeof(buf), "/api/v%d/%s/list", version, res);
+        static_paths[i] = strdup(buf);
+        void *handle = (void *)(long)(i + 1);
+        http_router_add(router, HTTP_GET, buf, handle);
+
+        snprintf(buf, sizeof(buf), "GET /api/v%d/%s/list", version, res);
+        map_set(&legacy, buf, handle);
+
+        // 参数: /api/v12/orders/:id/detail
+        snprintf(buf, sizeof(buf), "/api/v%d/%s/:id/detail", version, res);
+        http_router_add(router, HTTP_GET, buf, handle);
+        snprintf(buf, sizeof(buf), "/api/v%d/%s/%d/detail", version, res, i * 7919);
+        param_paths[i] = strdup(buf);
+    }
+
+    // 请求顺序打乱，避免总是命中同一条缓存行
+    int *order = malloc(sizeof(int) * ITERATIONS);
+    srand(42);
+    for(int i = 0; i < ITERATIONS; i++){
+        order[i] = rand() % ROUTES;
+    }
+
+    long check = 0;
+    double start = now_sec();
+    for(int i = 0; i < ITERATIONS; i++){
+        check += (long)legacy_match(&legacy, "GET", static_paths[order[i]]);
+    }
+    double legacy_ns = (now_sec() - start) * 1e9 / ITERATIONS;
+    printf("legacy map     static  %8.1f ns/lookup  (check=%ld)\n", legacy_ns, check);
+
+    HttpRouteParams params;
+    check = 0;
+    start = now_sec();
+    for(int i = 0; i < ITERATIONS; i++){
+        const char *path = static_paths[order[i]];
+        check += (long)http_router_match(router, HTTP_GET, path, strlen(path), &params);
+    }
+    double router_ns = (now_sec() - start) * 1e9 / ITERATIONS;
+    printf("radix router   static  %8.1f ns/lookup  (check=%ld)\n", router_ns, check);
+
+    check = 0;
+    start = now_sec();
+    for(int i = 0; i < ITERATIONS; i++){
+        const char *path = param_paths[order[i]];
+        check += (long)http_router_match(router, HTTP_GET, path, strlen(path), &params) + params.count;
+    }
+    double param_ns = (now_sec() - start) * 1e9 / ITERATIONS;
+    printf("radix router   :param  %8.1f ns/lookup  (check=%ld)\n", param_ns, check);
+
+    double freeze_start = now_sec();
+    if(http_router_freeze(router) != 0){
+        printf("freeze failed\n");
+        return 1;
+    }
+    double freeze_ms = (now_sec() - freeze_start) * 1e3;
+
+    check = 0;
+    start = now_sec();
+    for(int i = 0; i < ITERATIONS; i++){
+        const char *path = static_paths[order[i]];
+        check += (long)http_router_match(router, HTTP_GET, path, strlen(path), &params);
+    }
+    double frozen_ns = (now_sec() - start) * 1e9 / ITERATIONS;
+    printf("frozen table   static  %8.1f ns/lookup  (check=%ld, freeze %.1f ms)\n", frozen_ns, check, freeze_ms);
+
+    check = 0;
+    start = now_sec();
+    for(int i = 0; i < ITERATIONS; i++){
+        const char *path = param_paths[order[i]];
+        check += (long)http_router_match(router, HTTP_GET, path, strlen(path), &params) + params.count;
+    }
+    printf("frozen + tree  :param  %8.1f ns/lookup  (check=%ld)\n", (now_sec() - start) * 1e9 / ITERATIONS, check);
+
+    printf("routes=%d, static speedup radix %.2fx, frozen %.2fx\n", ROUTES * 2, legacy_ns / router_ns, legacy_ns / frozen_ns);
+
+    for(int i = 0; i < ROUTES; i++){
+        free(static_paths[i]);
+        free(param_paths[i]);
+    }
+    free(order);
+    http_router_destroy(router);
+    map_deinit(&legacy);
+    return 0;
+}
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "thread_pool/thread_pool.h"
+
+// 线程池扩展性：原先全局锁的线程池 vs 工作窃取线程池，线程数从1到CPU核数
+
+#define TASKS 200000
+#define TASK_WORK 2000      // 每个任务的计算量
+#define SPAWN_FANOUT 16     // 工作线程中再提交的子任务数
+
+static atomic_long done;
+static volatile unsigned long sink;
+
+static void *work_task(void *arg){
+    unsigned long x = (unsigned long)arg;
+    for(int i = 0; i < TASK_WORK; i++){
+        x = x * 6364136223846793005ul + 1442695040888963407ul;
+    }
+    sink = x;
+    atomic_fetch_add_explicit(&done, 1, memory_order_relaxed);
+    return NULL;
+}
+
+static double now_sec(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void wait_done(long target){
+    while (atomic_load(&done) < target)
+    {
+        sched_yield();
+    }
+}
+
+// ====================================================================
+// ============================ LEGACY ================================
+// ====================================================================
+
+/**
+ * @brief 原先的线程池：一个全局锁 + 条件变量 + 环形队列，执行任务时仍持有锁
+ */
+typedef struct LegacyPool {
+    pthread_t *threads;
+    int thread_count;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    void *(**handles)(void *);
+    void **args;
+    int cap, front, rear;
+    int shutdown;
+} LegacyPool;
+
+static void *legacy_thread(void *p){
+    LegacyPool *pool = p;
+    for(;;){
+        pthread_mutex_lock(&pool->mutex);
+        while (pool->front == pool->rear && !pool->shutdown)
+        {
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+        }
+        if(pool->shutdown){
+            pthread_mutex_unlock(&pool->mutex);
+            break;
+        }
+        void *(*handle)(void *) = pool->handles[pool->front];
+        void *arg = pool->args[pool->front];
+        pool->front = (pool->front + 1) % pool->cap;
+        handle(arg);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+    return NULL;
+}
+
+static LegacyPool *legacy_new(int threads, int cap){
+    LegacyPool *pool = calloc(1, sizeof(LegacyPool));
+    pool->threads = malloc(sizeof(pthread_t) * threads);
+    pool->thread_count = threads;
+    pool->handles = malloc(sizeof(void *) * cap);
+    pool->args = malloc(sizeof(void *) * cap);
+    pool->cap = cap;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    for(int i = 0; i < threads; i++){
+        pthread_create(&pool->threads[i], NULL, legacy_thread, pool);
+    }
+    return pool;
+}
+
+static int legacy_add(LegacyPool *pool, void *(*handle)(void *), void *arg){
+    pthread_mutex_lock(&pool->mutex);
+    if((pool->rear + 1) % pool->cap == pool->front){
+        pthread_mutex_unlock(&pool->mutex);
+        return -1;
+    }
+    pool->handles[pool->rear] = handle;
+    pool->args[pool->rear] = arg;
+    pool->rear = (pool->rear + 1) % pool->cap;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+    return 0;
+}
+
+static void legacy_destroy(LegacyPool *pool){
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+    for(int i = 0; i < pool->thread_count; i++){
+        pthread_join(pool->threads[i], NULL);
+    }
+    free(pool->threads);
+    free(pool->handles);
+    free(pool->args);
+    free(pool);
+}
+
+// ====================================================================
+// ============================= BENCH ================================
+// ====================================================================
+
+static double bench_legacy(int threads){
+    LegacyPool *pool = legacy_new(threads, 1024);
+    atomic_store(&done, 0);
+    double start = now_sec();
+    for(long i = 0; i < TASKS; i++){
+        while (legacy_add(pool, work_task, (void *)i) != 0)
+        {
+            sched_yield();
+        }
+    }
+    wait_done(TASKS);
+    double elapsed = now_sec() - start;
+    legacy_destroy(pool);
+    return elapsed;
+}
+
+static double bench_pool(int threads){
+    ThreadPool *pool = threadpool_new(threads, 1024, NULL);
+    atomic_store(&done, 0);
+    double start = now_sec();
+    for(long i = 0; i < TASKS; i++){
+        while (threadpool_add_task(pool, work_task, (void *)i) != 0)
+        {
+            sched_yield();
+        }
+    }
+    wait_done(TASKS);
+    double elapsed = now_sec() - start;
+    threadpool_destroy(pool);
+    return elapsed;
+}
+
+static ThreadPool *spawn_pool;
+
+/**
+ * @brief 在工作线程中提交子任务，子任务进入本线程队列，由空闲线程窃取
+ */
+static void *spawn_task(void *arg){
+    long base = (long)arg;
+    for(int i = 0; i < SPAWN_FANOUT; i++){
+        while (threadpool_add_task(spawn_pool, work_task, (void *)(base + i)) != 0)
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static double bench_spawn(int threads){
+    spawn_pool = threadpool_new(threads, 1024, NULL);
+    atomic_store(&done, 0);
+    double start = now_sec();
+    for(long i = 0; i < TASKS / SPAWN_FANOUT; i++){
+        while (threadpool_add_task(spawn_pool, spawn_task, (void *)(i * SPAWN_FANOUT)) != 0)
+        {
+            sched_yield();
+        }
+    }
+    wait_done(TASKS);
+    double elapsed = now_sec() - start;
+    threadpool_destroy(spawn_pool);
+    return elapsed;
+}
+
+int main(int argc, char **argv){
+    // 可以指定最大线程数，默认为CPU核数
+    int cpus = argc > 1 ? atoi(argv[1]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(cpus < 1) cpus = 1;
+
+    printf("cpus=%d tasks=%d\n", cpus, TASKS);
+    printf("%8s %14s %14s %14s\n", "threads", "legacy Mt/s", "steal Mt/s", "spawn Mt/s");
+    for(int threads = 1; ; threads = threads * 2 > cpus && threads < cpus ? cpus : threads * 2){
+        double legacy = bench_legacy(threads);
+        double steal = bench_pool(threads);
+        double spawn = bench_spawn(threads);
+        printf("%8d %14.3f %14.3f %14.3f\n", threads,
+            TASKS / legacy / 1e6, TASKS / steal / 1e6, TASKS / spawn / 1e6);
+        if(threads >= cpus) break;
+    }
+    return 0;
+}
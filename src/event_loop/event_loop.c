@@ -0,0 +1,364 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "event_loop.h"
+
+#define EVENT_LOOP_MAX_EVENTS 256
+
+// =========================================================================
+// ==============================  TASK  ===================================
+// =========================================================================
+
+/**
+ * @brief 跨线程投递的任务
+ */
+typedef struct EventTask {
+    EventTaskHandle handle;
+    void *arg;
+    struct EventTask *next;
+} EventTask;
+
+// =========================================================================
+// ============================  EVENT LOOP  ===============================
+// =========================================================================
+
+/**
+ * @brief 已注册的文件描述符
+ */
+typedef struct EventWatcher {
+    int events;          // 关注的事件, EVENT_NONE 表示未注册
+    EventHandle handle;
+    void *arg;
+} EventWatcher;
+
+typedef struct EventLoop {
+    int epoll_fd;
+    int wakeup_fd;              // eventfd, 用于唤醒 epoll_wait
+    int setsize;
+    EventWatcher *watchers;     // 以 fd 为下标
+
+    pthread_mutex_t task_mutex; // 保护 tasks
+    EventTask *task_head;
+    EventTask *task_tail;
+
+    pthread_t thread;           // 运行事件循环的线程, started 之后有效，之后不再改变
+    int started;
+    EventTask *local_head;      // 事件循环线程自己投递的任务，不加锁，也不需要唤醒
+    EventTask *local_tail;
+
+    EventTaskHandle tick_handle; // 周期任务
+    void *tick_arg;
+    int tick_interval;           // 毫秒
+    long long tick_next;
+
+    EventTaskHandle prepare_handle; // 每轮等待前执行
+    void *prepare_arg;
+
+    long long now;               // 本轮循环的时间缓存，毫秒
+
+    atomic_int stop;             // 可能由其他线程或信号处理函数设置
+} EventLoop;
+
+/**
+ * @brief 单调时钟，毫秒
+ */
+static long long _event_loop_clock_ms(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief 创建事件循环
+ * @param setsize 能够管理的最大文件描述符值(不含)
+ * @return 失败返回NULL
+ */
+EventLoop *event_loop_new(int setsize){
+    EventLoop *loop = malloc(sizeof(EventLoop));
+    if(loop == NULL){
+        return NULL;
+    }
+    memset(loop, 0, sizeof(EventLoop));
+
+    loop->watchers = calloc(setsize, sizeof(EventWatcher));
+    if(loop->watchers == NULL){
+        free(loop);
+        return NULL;
+    }
+    loop->setsize = setsize;
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(loop->epoll_fd < 0){
+        free(loop->watchers);
+        free(loop);
+        return NULL;
+    }
+
+    loop->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(loop->wakeup_fd < 0){
+        close(loop->epoll_fd);
+        free(loop->watchers);
+        free(loop);
+        return NULL;
+    }
+
+    struct epoll_event ev = {
+        .events = EPOLLIN | EPOLLET,
+        .data.fd = loop->wakeup_fd,
+    };
+    if(epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wakeup_fd, &ev) < 0){
+        close(loop->wakeup_fd);
+        close(loop->epoll_fd);
+        free(loop->watchers);
+        free(loop);
+        return NULL;
+    }
+
+    pthread_mutex_init(&loop->task_mutex, NULL);
+    loop->now = _event_loop_clock_ms();
+    return loop;
+}
+
+/**
+ * @brief 销毁事件循环，不会关闭已注册的文件描述符
+ */
+void event_loop_destroy(EventLoop *loop){
+    if(loop == NULL) return;
+
+    EventTask *lists[] = { loop->task_head, loop->local_head };
+    for(int i = 0; i < 2; i++){
+        EventTask *task = lists[i];
+        while (task)
+        {
+            EventTask *next = task->next;
+            free(task);
+            task = next;
+        }
+    }
+    loop->task_head = loop->task_tail = NULL;
+    loop->local_head = loop->local_tail = NULL;
+
+    pthread_mutex_destroy(&loop->task_mutex);
+    close(loop->wakeup_fd);
+    close(loop->epoll_fd);
+    free(loop->watchers);
+    free(loop);
+}
+
+/**
+ * @brief 以边缘触发方式注册文件描述符
+ */
+int event_loop_add(EventLoop *loop, int fd, int events, EventHandle handle, void *arg){
+    if(fd < 0 || fd >= loop->setsize || handle == NULL){
+        return -1;
+    }
+
+    struct epoll_event ev = {
+        .events = EPOLLET,
+        .data.fd = fd,
+    };
+    if(events & EVENT_READABLE) ev.events |= EPOLLIN;
+    if(events & EVENT_WRITABLE) ev.events |= EPOLLOUT;
+
+    if(epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0){
+        return -1;
+    }
+
+    EventWatcher *w = &loop->watchers[fd];
+    w->events = events;
+    w->handle = handle;
+    w->arg = arg;
+    return 0;
+}
+
+/**
+ * @brief 取消注册文件描述符
+ */
+int event_loop_del(EventLoop *loop, int fd){
+    if(fd < 0 || fd >= loop->setsize){
+        return -1;
+    }
+
+    EventWatcher *w = &loop->watchers[fd];
+    w->events = EVENT_NONE;
+    w->handle = NULL;
+    w->arg = NULL;
+    return epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+/**
+ * @brief 投递一个任务到事件循环线程执行，线程安全
+ */
+int event_loop_post(EventLoop *loop, EventTaskHandle handle, void *arg){
+    EventTask *task = malloc(sizeof(EventTask));
+    if(task == NULL){
+        return -1;
+    }
+    task->handle = handle;
+    task->arg = arg;
+    task->next = NULL;
+
+    // 事件循环线程投递给自己时，本轮事件处理完后执行，不会和其他线程竞争
+    if(loop->started && pthread_equal(loop->thread, pthread_self())){
+        if(loop->local_tail){
+            loop->local_tail->next = task;
+        }else{
+            loop->local_head = task;
+        }
+        loop->local_tail = task;
+        return 0;
+    }
+
+    pthread_mutex_lock(&loop->task_mutex);
+    int need_wakeup = loop->task_head == NULL;
+    if(loop->task_tail){
+        loop->task_tail->next = task;
+    }else{
+        loop->task_head = task;
+    }
+    loop->task_tail = task;
+    pthread_mutex_unlock(&loop->task_mutex);
+
+    // 队列从空变为非空时才需要唤醒，其余情况事件循环必然会处理到
+    if(need_wakeup){
+        uint64_t one = 1;
+        write(loop->wakeup_fd, &one, sizeof(one));
+    }
+    return 0;
+}
+
+/**
+ * @brief 执行所有已投递的任务
+ */
+static void _event_loop_run_tasks(EventLoop *loop){
+    uint64_t count;
+    while (read(loop->wakeup_fd, &count, sizeof(count)) > 0);
+
+    pthread_mutex_lock(&loop->task_mutex);
+    EventTask *task = loop->task_head;
+    loop->task_head = loop->task_tail = NULL;
+    pthread_mutex_unlock(&loop->task_mutex);
+
+    while (task)
+    {
+        EventTask *next = task->next;
+        task->handle(task->arg);
+        free(task);
+        task = next;
+    }
+}
+
+/**
+ * @brief 执行事件循环线程投递给自己的任务，执行中投递的留到下一轮
+ */
+static void _event_loop_run_local(EventLoop *loop){
+    EventTask *task = loop->local_head;
+    loop->local_head = loop->local_tail = NULL;
+    while (task)
+    {
+        EventTask *next = task->next;
+        task->handle(task->arg);
+        free(task);
+        task = next;
+    }
+}
+
+/**
+ * @brief 设置周期任务，只能在事件循环线程调用
+ */
+void event_loop_set_tick(EventLoop *loop, int interval_ms, EventTaskHandle handle, void *arg){
+    loop->tick_handle = handle;
+    loop->tick_arg = arg;
+    loop->tick_interval = interval_ms;
+    loop->tick_next = loop->now + interval_ms;
+}
+
+/**
+ * @brief 设置每轮循环等待事件前执行的任务
+ */
+void event_loop_set_prepare(EventLoop *loop, EventTaskHandle handle, void *arg){
+    loop->prepare_handle = handle;
+    loop->prepare_arg = arg;
+}
+
+/**
+ * @brief 本轮循环开始时的单调时间，毫秒
+ */
+long long event_loop_now(EventLoop *loop){
+    return loop->now;
+}
+
+/**
+ * @brief 运行事件循环，直到 event_loop_stop 被调用
+ */
+int event_loop_run(EventLoop *loop){
+    struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+    loop->thread = pthread_self();
+    loop->started = 1;
+
+    while (!atomic_load_explicit(&loop->stop, memory_order_relaxed))
+    {
+        if(loop->prepare_handle != NULL){
+            loop->prepare_handle(loop->prepare_arg);
+        }
+
+        int timeout = -1;
+        if(loop->local_head != NULL){
+            timeout = 0;
+        }else if(loop->tick_handle != NULL){
+            long long wait = loop->tick_next - loop->now;
+            timeout = wait > 0 ? (int)wait : 0;
+        }
+
+        int n = epoll_wait(loop->epoll_fd, events, EVENT_LOOP_MAX_EVENTS, timeout);
+        loop->now = _event_loop_clock_ms();
+        if(n < 0){
+            if(errno == EINTR) continue;
+            return -1;
+        }
+
+        for(int i = 0; i < n; i++){
+            int fd = events[i].data.fd;
+            if(fd == loop->wakeup_fd){
+                _event_loop_run_tasks(loop);
+                continue;
+            }
+
+            EventWatcher *w = &loop->watchers[fd];
+            if(w->handle == NULL){
+                continue; // 本轮中已被取消注册
+            }
+
+            int mask = EVENT_NONE;
+            if(events[i].events & EPOLLIN) mask |= EVENT_READABLE;
+            if(events[i].events & EPOLLOUT) mask |= EVENT_WRITABLE;
+            if(events[i].events & (EPOLLERR | EPOLLHUP)) mask |= EVENT_ERROR;
+            w->handle(loop, fd, mask, w->arg);
+        }
+        _event_loop_run_local(loop);
+
+        if(loop->tick_handle != NULL && loop->now >= loop->tick_next){
+            loop->tick_next = loop->now + loop->tick_interval;
+            loop->tick_handle(loop->tick_arg);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 停止事件循环，线程安全
+ */
+void event_loop_stop(EventLoop *loop){
+    atomic_store_explicit(&loop->stop, 1, memory_order_relaxed);
+    uint64_t one = 1;
+    write(loop->wakeup_fd, &one, sizeof(one));
+}
@@ -0,0 +1,93 @@
+#ifndef EVENT_LOOP_H_
+#define EVENT_LOOP_H_
+
+// Description: Header file for event_loop (epoll 边缘触发反应器)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EVENT_NONE 0
+#define EVENT_READABLE 1
+#define EVENT_WRITABLE 2
+#define EVENT_ERROR 4
+
+/**
+ * @brief 事件循环
+ */
+typedef struct EventLoop EventLoop;
+
+/**
+ * @brief 文件描述符就绪回调
+ * @param events EVENT_READABLE | EVENT_WRITABLE | EVENT_ERROR 的组合
+ */
+typedef void(*EventHandle)(EventLoop *loop, int fd, int events, void *arg);
+
+/**
+ * @brief 投递到事件循环线程执行的任务
+ */
+typedef void(*EventTaskHandle)(void *arg);
+
+/**
+ * @brief 创建事件循环
+ * @param setsize 能够管理的最大文件描述符值(不含)
+ * @return 失败返回NULL
+ */
+EventLoop *event_loop_new(int setsize);
+
+/**
+ * @brief 销毁事件循环，不会关闭已注册的文件描述符
+ */
+void event_loop_destroy(EventLoop *loop);
+
+/**
+ * @brief 以边缘触发方式注册文件描述符，只能在事件循环线程调用
+ * @param events EVENT_READABLE | EVENT_WRITABLE
+ * @return 成功返回0,失败返回-1
+ */
+int event_loop_add(EventLoop *loop, int fd, int events, EventHandle handle, void *arg);
+
+/**
+ * @brief 取消注册文件描述符，只能在事件循环线程调用
+ * @return 成功返回0,失败返回-1
+ */
+int event_loop_del(EventLoop *loop, int fd);
+
+/**
+ * @brief 投递一个任务到事件循环线程执行，线程安全; 事件循环线程投递给自己时不加锁，在本轮事件处理完后执行
+ * @return 成功返回0,失败返回-1
+ */
+int event_loop_post(EventLoop *loop, EventTaskHandle handle, void *arg);
+
+/**
+ * @brief 设置周期任务，只能在事件循环线程调用
+ * @param interval_ms 执行间隔，毫秒
+ */
+void event_loop_set_tick(EventLoop *loop, int interval_ms, EventTaskHandle handle, void *arg);
+
+/**
+ * @brief 设置每轮循环等待事件前执行的任务，如批量提交本轮产生的异步 I/O，只能在事件循环线程调用
+ */
+void event_loop_set_prepare(EventLoop *loop, EventTaskHandle handle, void *arg);
+
+/**
+ * @brief 本轮循环开始时的单调时间，毫秒，只能在事件循环线程调用
+ */
+long long event_loop_now(EventLoop *loop);
+
+/**
+ * @brief 运行事件循环，直到 event_loop_stop 被调用
+ * @return 正常退出返回0,出错返回-1
+ */
+int event_loop_run(EventLoop *loop);
+
+/**
+ * @brief 停止事件循环，线程安全
+ */
+void event_loop_stop(EventLoop *loop);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EVENT_LOOP_H_ */
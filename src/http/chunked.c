@@ -0,0 +1,210 @@
+#include <string.h>
+
+#include "chunked.h"
+
+/**
+ * @brief 解析状态
+ */
+enum {
+    C_SIZE = 0,     // 块长度的十六进制数字
+    C_EXT,          // 块长度之后的扩展, 直到 \r
+    C_SIZE_LF,      // 分块头的 \r 之后
+    C_DATA,         // 块数据，由调用者取走
+    C_DATA_CR,      // 块数据之后的 \r
+    C_DATA_LF,
+    C_TRAILER_START,    // 尾部请求头的行首
+    C_TRAILER,
+    C_TRAILER_LF,
+    C_END_LF,       // 结尾空行的 \r 之后
+    C_DONE,
+};
+
+/**
+ * @brief 十六进制数字的值
+ * @return 不是十六进制数字返回-1
+ */
+static inline int _http_hex_value(unsigned char c){
+    if(c >= '0' && c <= '9') return c - '0';
+    c |= 0x20;
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+/**
+ * @brief 初始化
+ */
+void http_chunked_init(HttpChunkedParser *parser, long max_total){
+    memset(parser, 0, sizeof(HttpChunkedParser));
+    parser->state = C_SIZE;
+    parser->max_total = max_total;
+}
+
+/**
+ * @brief 一个分块头解析完，检查总长度
+ * @return 成功返回0, 超过限制返回-1
+ */
+static int _http_chunked_on_size(HttpChunkedParser *parser){
+    if(parser->size > (size_t)(parser->max_total - parser->total)){
+        parser->too_large = 1;
+        return -1;
+    }
+    parser->total += parser->size;
+    parser->remaining = parser->size;
+    parser->state = parser->size > 0 ? C_DATA : C_TRAILER_START;
+    return 0;
+}
+
+/**
+ * @brief 解析分块头、块结尾和尾部请求头，遇到块数据或数据用完时停下
+ */
+int http_chunked_execute(HttpChunkedParser *parser, const char *data, size_t len, size_t *consumed){
+    size_t i = 0;
+    int rs = HTTP_PARSE_AGAIN;
+    if(parser->state == C_DONE){
+        *consumed = 0;
+        return HTTP_PARSE_DONE;
+    }
+
+    for(; i < len && parser->state != C_DATA; i++){
+        unsigned char c = data[i];
+        switch (parser->state)
+        {
+            case C_SIZE: {
+                // 一次读完连续的数字
+                int v;
+                while ((v = _http_hex_value(c)) >= 0)
+                {
+                    // 超过 size_t 的长度一定超过限制
+                    if(parser->size > ((size_t)-1 >> 4)){
+                        parser->too_large = 1;
+                        goto error;
+                    }
+                    parser->size = (parser->size << 4) | v;
+                    parser->digits++;
+                    if(++i == len){
+                        goto out;
+                    }
+                    c = data[i];
+                }
+                if(parser->digits == 0){
+                    goto error;
+                }
+                if(c == '\r'){
+                    parser->state = C_SIZE_LF;
+                }else if(c == ';' || c == ' ' || c == '\t'){
+                    parser->extra = 0;
+                    parser->state = C_EXT;
+                }else{
+                    goto error;
+                }
+                break;
+            }
+
+            case C_EXT: {
+                // 扩展不使用，找到行尾即可，扩展通常很短，逐字节查找比 memchr 快
+                size_t start = i;
+                while (i < len && data[i] != '\r' && data[i] != '\n')
+                {
+                    i++;
+                }
+                parser->extra += i - start;
+                if(parser->extra > HTTP_CHUNKED_MAX_EXT){
+                    goto error;
+                }
+                if(i == len){
+                    goto out;
+                }
+                if(data[i] == '\n'){
+                    goto error;
+                }
+                parser->state = C_SIZE_LF;
+                break;
+            }
+
+            case C_SIZE_LF:
+                if(c != '\n' || _http_chunked_on_size(parser) != 0){
+                    goto error;
+                }
+                parser->extra = 0;
+                break;
+
+            case C_DATA_CR:
+                if(c != '\r'){
+                    goto error;
+                }
+                parser->state = C_DATA_LF;
+                // 块结尾和下一个分块头通常在一起
+                if(i + 1 < len && data[i + 1] == '\n'){
+                    i++;
+                    parser->size = 0;
+                    parser->digits = 0;
+                    parser->state = C_SIZE;
+                }
+                break;
+
+            case C_DATA_LF:
+                if(c != '\n'){
+                    goto error;
+                }
+                parser->size = 0;
+                parser->digits = 0;
+                parser->state = C_SIZE;
+                break;
+
+            case C_TRAILER_START:
+                if(c == '\r'){
+                    parser->state = C_END_LF;
+                    break;
+                }
+                parser->state = C_TRAILER;
+                // fall through
+            case C_TRAILER:
+                if(c == '\r'){
+                    parser->state = C_TRAILER_LF;
+                }else if(c == '\n'){
+                    goto error;
+                }
+                if(++parser->extra > HTTP_CHUNKED_MAX_TRAILER){
+                    goto error;
+                }
+                break;
+
+            case C_TRAILER_LF:
+                if(c != '\n'){
+                    goto error;
+                }
+                parser->state = C_TRAILER_START;
+                break;
+
+            case C_END_LF:
+                if(c != '\n'){
+                    goto error;
+                }
+                parser->state = C_DONE;
+                i++;
+                rs = HTTP_PARSE_DONE;
+                goto out;
+
+            default:
+                goto error;
+        }
+    }
+
+out:
+    *consumed = i;
+    return rs;
+
+error:
+    *consumed = i;
+    return HTTP_PARSE_ERROR;
+}
+
+/**
+ * @brief 调用者取走了 n 字节块数据
+ */
+void http_chunked_consume(HttpChunkedParser *parser, size_t n){
+    parser->remaining -= n;
+    if(parser->remaining == 0){
+        parser->state = C_DATA_CR;
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef HTTP_CHUNKED_H_
+#define HTTP_CHUNKED_H_
+
+// Description: Header file for chunked (分块传输编码的增量解析，只解析分块头，块数据由调用者直接取走)
+
+#include <stddef.h>
+
+#include "parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HTTP_CHUNKED_MAX_EXT 1024       // 一个分块头中扩展部分的最大长度
+#define HTTP_CHUNKED_MAX_TRAILER 8192   // 尾部请求头的最大总长度
+
+/**
+ * @brief 分块解析状态，可以在多次读取之间恢复，任意位置断开都可以继续
+ */
+typedef struct HttpChunkedParser {
+    int state;
+    int digits;         // 当前块长度的十六进制位数
+    size_t size;        // 当前块的长度
+    size_t remaining;   // 当前块还没有取走的数据长度, >0 时停在块数据处
+    size_t extra;       // 当前分块头扩展或尾部请求头的已读长度
+    long total;         // 已解析的数据总长度
+    long max_total;     // 数据总长度的最大值
+    int too_large;      // 出错的原因是超过 max_total
+} HttpChunkedParser;
+
+/**
+ * @brief 初始化
+ * @param max_total 数据总长度的最大值
+ */
+void http_chunked_init(HttpChunkedParser *parser, long max_total);
+
+/**
+ * @brief 解析分块头、块结尾和尾部请求头，遇到块数据或数据用完时停下。
+ *        扩展和尾部请求头校验长度后丢弃
+ * @param consumed 输出已解析的字节数
+ * @return HTTP_PARSE_DONE body 结束, HTTP_PARSE_AGAIN 需要更多数据或停在块数据处(remaining > 0),
+ *         HTTP_PARSE_ERROR 格式非法或超过限制
+ */
+int http_chunked_execute(HttpChunkedParser *parser, const char *data, size_t len, size_t *consumed);
+
+/**
+ * @brief 调用者取走了 n 字节块数据，n 不能超过 remaining
+ */
+void http_chunked_consume(HttpChunkedParser *parser, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HTTP_CHUNKED_H_ */
@@ -0,0 +1,104 @@
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "headers.h"
+
+#define LOWER(c) ((unsigned char)((c) - 'A') < 26 ? (c) | 0x20 : (c))
+
+/**
+ * @brief 初始化
+ */
+void http_headers_init(HttpHeaders *headers, Arena *arena){
+    headers->spill = NULL;
+    headers->count = 0;
+    headers->cap = HTTP_HEADERS_INLINE;
+    headers->arena = arena;
+}
+
+/**
+ * @brief 名称按小写计算的哈希 (FNV-1a)
+ */
+unsigned int http_header_hash(const char *name, size_t len){
+    unsigned int hash = 2166136261u;
+    for(size_t i = 0; i < len; i++){
+        hash = (hash ^ LOWER((unsigned char)name[i])) * 16777619u;
+    }
+    return hash;
+}
+
+#ifdef __SSE2__
+/**
+ * @brief 把 16 个字节中的大写字母转为小写
+ */
+static inline __m128i _http_header_lower16(__m128i v){
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+#endif
+
+/**
+ * @brief 不区分大小写比较 len 个字节，一次比较16个
+ * @return 相同返回1, 否则返回0
+ */
+int http_header_name_eq(const char *a, const char *b, size_t len){
+    size_t i = 0;
+#ifdef __SSE2__
+    for(; i + 16 <= len; i += 16){
+        __m128i x = _http_header_lower16(_mm_loadu_si128((const __m128i *)(a + i)));
+        __m128i y = _http_header_lower16(_mm_loadu_si128((const __m128i *)(b + i)));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xffff){
+            return 0;
+        }
+    }
+#endif
+    for(; i < len; i++){
+        unsigned char x = a[i], y = b[i];
+        if(LOWER(x) != LOWER(y)){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief 追加一个请求头，超过内联数量时整体移到内存池，之后按两倍扩容
+ * @return 成功返回0, 内存不足返回-1
+ */
+int http_headers_add(HttpHeaders *headers, HttpSlice name, HttpSlice value){
+    if(headers->count == headers->cap){
+        int cap = headers->cap * 2;
+        HttpHeader *spill = arena_alloc(headers->arena, sizeof(HttpHeader) * cap);
+        if(spill == NULL){
+            return -1;
+        }
+        memcpy(spill, http_headers_at(headers, 0), sizeof(HttpHeader) * headers->count);
+        headers->spill = spill;
+        headers->cap = cap;
+    }
+
+    HttpHeader *header = (HttpHeader *)http_headers_at(headers, headers->count);
+    header->name = name;
+    header->value = value;
+    header->hash = http_header_hash(name.data, name.len);
+    headers->count++;
+    return 0;
+}
+
+/**
+ * @brief 从 from 开始查找名称相同(不区分大小写)的请求头，先比较哈希
+ * @return 下标，没有时返回-1
+ */
+int http_headers_find(const HttpHeaders *headers, const char *name, size_t len, int from){
+    unsigned int hash = http_header_hash(name, len);
+    const HttpHeader *items = http_headers_at(headers, 0);
+    for(int i = from; i < headers->count; i++){
+        if(items[i].hash == hash && items[i].name.len == len
+            && http_header_name_eq(items[i].name.data, name, len)){
+            return i;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,77 @@
+#ifndef HTTP_HEADERS_H_
+#define HTTP_HEADERS_H_
+
+// Description: Header file for headers (请求头容器，少量时内联存放，名称不区分大小写)
+
+#include <stddef.h>
+
+#include "parser.h"
+#include "../util/arena.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HTTP_HEADERS_INLINE 16  // 超过这个数量才从内存池申请
+
+/**
+ * @brief 请求头，名称和值都指向连接的读缓冲
+ */
+typedef struct HttpHeader {
+    HttpSlice name;
+    HttpSlice value;
+    unsigned int hash;  // 名称按小写计算的哈希
+} HttpHeader;
+
+/**
+ * @brief 请求头列表，按请求中的顺序保存，同名的头分别保存
+ */
+typedef struct HttpHeaders {
+    HttpHeader *spill;  // 超过内联数量后所有条目都在这里，在 arena 中
+    int count;
+    int cap;
+    Arena *arena;
+    HttpHeader items[HTTP_HEADERS_INLINE];
+} HttpHeaders;
+
+/**
+ * @brief 初始化
+ * @param arena 溢出时使用的内存池
+ */
+void http_headers_init(HttpHeaders *headers, Arena *arena);
+
+/**
+ * @brief 追加一个请求头，不复制名称和值
+ * @return 成功返回0, 内存不足返回-1
+ */
+int http_headers_add(HttpHeaders *headers, HttpSlice name, HttpSlice value);
+
+/**
+ * @brief 从 from 开始查找名称相同(不区分大小写)的请求头
+ * @return 下标，没有时返回-1
+ */
+int http_headers_find(const HttpHeaders *headers, const char *name, size_t len, int from);
+
+/**
+ * @brief 第 index 个请求头
+ */
+static inline const HttpHeader *http_headers_at(const HttpHeaders *headers, int index){
+    return headers->spill ? &headers->spill[index] : &headers->items[index];
+}
+
+/**
+ * @brief 名称按小写计算的哈希
+ */
+unsigned int http_header_hash(const char *name, size_t len);
+
+/**
+ * @brief 不区分大小写比较 len 个字节
+ * @return 相同返回1, 否则返回0
+ */
+int http_header_name_eq(const char *a, const char *b, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HTTP_HEADERS_H_ */
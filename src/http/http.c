@@ -1,130 +1,223 @@
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <limits.h>
 #include <unistd.h>     
 #include <errno.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <linux/filter.h>
 
 #include "http.h"
+#include "parser.h"
+#include "headers.h"
+#include "chunked.h"
+#include "router.h"
+#include "scan.h"
+#include "../event_loop/event_loop.h"
 #include "../thread_pool/thread_pool.h"
+#include "../uring/uring.h"
+#include "../util/arena.h"
 #include "../util/map.h"
-#include "../util/util_string.h"
 
 #define MAX_LINE_SIZE 8192
 #define MAX_HEADER_SIZE 8192
 #define MAX_BODY_SIZE 1048576
 
-// ====================================================================
-// ============================ COMMON ================================
-// ====================================================================
-/**
- * @brief 设置头部信息，直接覆盖原先数据
- */
-static void _http_set_header(map_str_t *map, const char *key, char *value){
-    size_t len = sizeof(char) * strlen(value)+1;
-    char *tmp = malloc(len);
-    memset(tmp,0,len);
-    map_set(map, key, memcpy(tmp, value, len));
-}
+#define READ_BUFFER_SIZE 8192
+#define REQUEST_ARENA_SIZE 4096  // 每个连接的请求内存池块大小
+#define MAX_CONNECTIONS 65536
+
+#define KEEPALIVE_MAX_REQUESTS 100
+#define KEEPALIVE_TIMEOUT 5000   // 毫秒
+#define CONN_SWEEP_INTERVAL 1000 // 毫秒
+#define MAX_DRAIN_SIZE 262144   // handler 没有读完的流式 body 超过这个长度时关闭连接，不再丢弃读完
+#define CHUNKED_READ_SPACE 1024 // 流式读取分块 body 时，读缓冲在请求头之后至少保留的空间
+#define STREAM_TIMEOUT 30000    // 毫秒, 流式读写等待客户端的最长时间
+#define PIPELINE_MAX 16         // 流水线中一批最多同时处理的请求数
+#define CACHE_LINE_SIZE 64
+#define WORKER_RESTART_DELAY 1000   // 毫秒, 工作进程启动后这么快就退出时，等到这个时间再重新启动
+
+#define URING_ENTRIES 1024      // 每个事件循环的 io_uring 提交队列长度
+#define URING_CQ_ENTRIES 8192
+#define URING_BUF_GROUP 0
+#define URING_BUF_COUNT 256     // 接收缓冲环中的缓冲数，每个 READ_BUFFER_SIZE 字节
 
 /**
- * @brief 添加头部信息
+ * @brief io_uring 操作的 user_data: 低3位是操作类型，其余是连接或事件循环的指针
  */
-static void _http_add_header(map_str_t *map, const char *key, char *value){
-    char **old = (char **)map_get(map, key);
-    if(old == NULL)
-    {
-        _http_set_header(map, key, value);
-        return;
-    }
-    char *old_val = *old;
-    char *new = str_append(*old, value);
-    free(old_val);
-    old_val = new;
-    
-    new = str_append(new, ";");
-    free(old_val);
-    map_set(map, key, new);
-    
-}
+enum {
+    URING_OP_IGNORE = 0,    // 不需要处理结果
+    URING_OP_ACCEPT,        // HttpShard 的多次接受
+    URING_OP_RECV,          // HttpConnection 的接收
+    URING_OP_SEND,          // HttpConnection 的发送
+    URING_OP_CLOSE,         // 关闭固定文件，高位是它在表中的位置
+};
+#define URING_OP_BITS 3
+#define URING_OP_MASK ((1ULL << URING_OP_BITS) - 1)
 
+// ====================================================================
+// ========================== CONNECTION ==============================
+// ====================================================================
 
 /**
- * @brief 设置头部信息
+ * @brief 连接状态
  */
-static char *_http_get_header(map_str_t *map, const char *key){
-    char **val = (char **)map_get(map, key);
-    if(val == NULL){
-        return "";
-    }
-    return *val;
-}
+typedef enum HttpConnState {
+    HTTP_CONN_READING,      // 事件循环读取请求中
+    HTTP_CONN_PROCESSING,   // 请求已完整，工作线程处理中
+    HTTP_CONN_WRITING,      // 事件循环发送剩余返回数据中
+    HTTP_CONN_CLOSED,
+} HttpConnState;
 
 /**
- * @brief 清理头部信息
- * 
- * @param map 
+ * @brief 一次请求和它的返回。流水线中同一批的请求各有一个，由不同工作线程同时处理，互不共享可写数据
  */
-static void _http_clear_header(map_str_t *map){
-    map_iter_t iter = map_iter();
-    const char *key;
-    while ((key = map_next(map, &iter)) != NULL)
-    {
-        char **val = (char **)map_get(map, key);
-        if(val != NULL){
-            free(*val);
-            *val = NULL;
-        }
-    }
-}
+typedef struct HttpExchange {
+    struct HttpConnection *conn;
+    HttpParser *parser;     // 请求头解析结果，区间相对 start
+    size_t start;           // 请求在读缓冲中的起始位置
+    size_t header_len;      // 请求行+请求头长度
+    size_t request_len;     // 请求长度，流式 body 只含请求头
+    int keep_alive;         // 返回后是否保持连接
+    int last;               // 达到每个连接的请求数上限，返回后关闭连接
+
+    Arena *arena;           // 请求和返回使用的内存，整批返回发送完后整体重置
+
+    struct iovec *wiov;     // 待发送的返回数据，数组和各段数据都在 arena 中
+    int wiov_count;
+    int wiov_cap;
+    HttpReleaseFunc wrelease;   // 返回数据不在 arena 中时，全部发送完后释放
+    void *wrelease_data;
+} HttpExchange;
 
+/**
+ * @brief 客户端连接，除 HTTP_CONN_PROCESSING 状态外只由事件循环线程访问
+ */
+typedef struct HttpConnection {
+    int fd;
+    struct HttpServer *server;
+    struct HttpShard *shard;    // 接受连接的事件循环，连接的事件和处理完后的回调都在它的线程
+    HttpConnState state;
+    int peer_closed;    // 对端已关闭或出错
+    int keep_alive;     // 当前一批请求处理完后是否保持连接
+    int requests;       // 已处理的请求数
+    long long last_active; // 最近活动时间，毫秒
+
+    struct HttpConnection *prev; // 按最近活动时间排列的连接链表
+    struct HttpConnection *next;
+
+    char *rbuf;         // 读缓冲
+    size_t rlen;        // 读缓冲中的数据长度
+    size_t rcap;        // 读缓冲容量
+
+    HttpParser parser;  // 请求头解析状态, 下次读取后从上次停下的位置继续
+    size_t header_len;  // 请求行+请求头长度, 0表示未读完
+    size_t request_len; // 完整请求长度, 0表示未读完; 分块 body 为请求头加已解码的部分;
+                        // 流式 body 为请求头加已从读缓冲取走的部分
+    int reject;         // 读完请求头后直接拒绝的状态码，不读取 body, 0表示正常处理
+    int continue_pending;   // 客户端等待 100 Continue 后才发送 body
+    int body_stream;    // body 由 handler 流式读取，还没有读完
+    int body_chunked;   // body 使用分块编码，还没有解析完
+    long body_left;     // 流式读取 Content-Length body 时还未读取的长度
+    HttpChunkedParser chunked;  // 分块 body 的解析状态
+
+    HttpExchange head;  // 第一个请求，可以流式读取 body 和直接发送返回; 整批返回合并到它的待发送数据中
+    int wiov_sent;      // head 已发送完的段数，发送了一部分的段会原地前移
+
+    HttpExchange *batch;        // 流水线中随第一个请求一起处理的后续请求，第一次用到时分配，连接关闭时释放
+    HttpParser *batch_parsers;
+    int batch_count;
+    atomic_int pending;         // 同一批中还没有处理完的请求数
+
+    // io_uring 方式
+    unsigned long long uring_op;    // 进行中的接收或发送操作, 0表示没有; 完成前连接不能释放
+    int file_slot;      // 套接字在固定文件表中的位置, -1 表示没有使用固定文件
+    struct msghdr wmsg; // 进行中的发送
+    size_t wmsg_len;    // 进行中的发送提交的字节数
+} HttpConnection;
 
 // ====================================================================
 // =========================== REQUEST ================================
 // ====================================================================
 
+/**
+ * @brief 一个查询参数名的所有值，以NULL结尾
+ */
+typedef struct HttpQueryValues {
+    char **values;
+    int count;
+    int cap;                // values 的容量，包括结尾的NULL
+} HttpQueryValues;
+
+typedef map_t(HttpQueryValues) map_query_t;
+
 typedef struct HttpRequest {
     int client_fd;
+    Arena *arena;       // 连接的内存池，请求结束后整体重置
 
     int remote_port;
     char *remote_addr;
     char *remote_host;
 
-    char method[8];
-    char *path;
+    // 以下切片都指向连接的读缓冲，并已原地以\0结尾
+    HttpSlice method;
+    HttpSlice path;
+    HttpSlice version;
 
-    map_str_t header;
-    map_strs_t query_data;
+    HttpHeaders headers;    // 指向连接的读缓冲
+    const char *known[HTTP_HEADER_KNOWN_COUNT]; // 常用请求头第一次出现的值，没有时为NULL
+    long content_length;
+    int connection;         // HTTP_CONNECTION_* 的组合
 
-    // get 数据已经初始化过
+    HttpRouteParams params; // 路径参数，值指向 path
+    char *params_buf;       // 路径参数值的C字符串副本，首次读取时生成，在 arena 中
+
+    map_query_t query_data; // 查询参数，字符串和值数组都在 arena 中
+
+    // 查询参数已经解析过，没有读取查询参数的请求不会解析
     char get_data_init;
 
-    char *body;
-    
+    HttpConnection *conn;
+    const char *body;       // 缓冲的 body, 指向连接的读缓冲，流式 body 为NULL
+    size_t body_len;
+    size_t body_pos;        // http_request_read_body 已读取的位置
 } HttpRequest;
 
 /**
- * @brief 操作结束标记，从后面推入字符
+ * @brief 把解析器的区间转换为切片，并把区间后的分隔符原地改为\0
  */
-static void __end_flag_push(char *flag, size_t len, char c){
-    if(len > 0){
-        if(len > 1){
-            for(int i = 0; i < len-1;i++){
-                flag[i]=flag[i+1];
-            }
-        }
-        flag[len-1] = c;
-    }
+static HttpSlice _http_request_cstr(char *base, HttpSpan span){
+    base[span.off + span.len] = '\0';
+    return http_span_slice(base, span);
 }
 
 /**
  * @brief 初始化请求
  */
-static int http_request_init(HttpRequest *request, int client_fd){
+static int http_request_init(HttpRequest *request, HttpExchange *ex){
+    HttpConnection *conn = ex->conn;
+    int client_fd = conn->fd;
+    memset(request, 0, sizeof(HttpRequest));
     request->client_fd  = client_fd;
-    map_init(&request->header);
+    request->arena = ex->arena;
+    request->conn = conn;
 
     struct sockaddr_in addr;
     socklen_t addr_len = sizeof(addr);
@@ -135,305 +228,515 @@ static int http_request_init(HttpRequest *request, int client_fd){
 
     char ip_str[INET_ADDRSTRLEN];
     inet_ntop(AF_INET, &addr.sin_addr, ip_str, sizeof(ip_str));
-    request->remote_addr = malloc(sizeof(char)*INET_ADDRSTRLEN+1);
-    strcpy(request->remote_addr, ip_str);
+    request->remote_addr = arena_strdup(request->arena, ip_str);
 
     int port = ntohs(addr.sin_port);
     request->remote_port = port;
 
     int host_len = snprintf(NULL,0,"%s:%d",ip_str, port);
-    request->remote_host = malloc(host_len+1);
+    request->remote_host = arena_alloc(request->arena, host_len+1);
+    if(request->remote_addr == NULL || request->remote_host == NULL){
+        return -1;
+    }
     sprintf(request->remote_host, "%s:%d",ip_str, port);
 
     
-    // 读取第一行 直到第一个 \r\n
-    char line_data[MAX_LINE_SIZE];
-    int line_read = 0;
-    char line_end_flag[2] = {0};
-    for(;line_read < MAX_LINE_SIZE-2;){
-        int n = read(client_fd, line_data+line_read,1);
-        if(n <= 0){
+    // 请求头已经由事件循环解析，这里只把切片原地截断成C字符串，不复制
+    HttpParser *parser = ex->parser;
+    char *base = conn->rbuf + ex->start;
+    request->method = _http_request_cstr(base, parser->method);
+    request->path = _http_request_cstr(base, parser->path);
+    request->version = _http_request_cstr(base, parser->version);
+
+    http_headers_init(&request->headers, request->arena);
+    for(int i = 0; i < parser->header_count; i++){
+        HttpSlice name = _http_request_cstr(base, parser->headers[i].name);
+        HttpSlice value = _http_request_cstr(base, parser->headers[i].value);
+        if(http_headers_add(&request->headers, name, value) != 0){
             return -1;
         }
+    }
+    for(int k = 0; k < HTTP_HEADER_KNOWN_COUNT; k++){
+        request->known[k] = parser->known[k] >= 0 ? base + parser->headers[parser->known[k]].value.off : NULL;
+    }
+    request->content_length = parser->content_length;
+    request->connection = parser->connection;
 
-        __end_flag_push(line_end_flag, 2, line_data[line_read]);
-        line_read += n;
+    // 缓冲的 body 已经由事件循环读入缓冲，长度在读取时已经按路由校验过，不复制
+    request->body_len = ex->request_len - ex->header_len;
+    request->body = request->body_len > 0 ? base + ex->header_len : NULL;
 
-        if(line_read >=2 && strncmp(line_end_flag,"\r\n",2) == 0){
-            break;
-        }
-    }
-    line_data[line_read] = '\0';
-    request->path = malloc(sizeof(char)*line_read);
-    memset(request->path,0,line_read);
+    return 0;
+}
 
+/**
+ * @brief 销毁请求，内存都在 arena 中，由连接在返回发送完后整体重置
+ */
+static void http_request_destroy(HttpRequest *request){
+    request->client_fd=0;
+    request->remote_port=0;
+    request->remote_addr = NULL;
+    request->remote_host = NULL;
+    request->body = NULL;
+    request->body_len = request->body_pos = 0;
+    request->params_buf = NULL;
+    request->headers.count = 0;
+    if(request->get_data_init){
+        map_deinit(&request->query_data);
+        request->get_data_init = 0;
+    }
+    request->arena = NULL;
+}
 
-    if(!sscanf(line_data,"%7s %8191s ",request->method, request->path)){
-        return -1;
+/**
+ * @brief 获取已读入的请求 body，不复制
+ * @return 没有时返回NULL
+ */
+const char *http_request_body(HttpRequest *request, size_t *len){
+    if(len != NULL){
+        *len = request->body_len;
     }
+    return request->body;
+}
 
-    // 1. 读取请求头（直到 \r\n\r\n）
-    char header_data[MAX_HEADER_SIZE];
-    int header_read = 0;
-    char header_end_flag[4] = {0};
-    int header_line_offset = 0;
-    for(;header_read < MAX_HEADER_SIZE-4;){
-        int n = read(client_fd, header_data + header_read,1);
-        if(n <= 0){
-            return -1;
-        }
-        __end_flag_push(line_end_flag, 2, header_data[header_read]);
-        __end_flag_push(header_end_flag, 4, header_data[header_read]);
+/**
+ * @brief 在请求的内存池中分配内存，请求结束(返回发送完)后自动释放，不需要也不能 free
+ * @return 失败返回NULL
+ */
+void *http_request_alloc(HttpRequest *request, size_t size){
+    return arena_alloc(request->arena, size);
+}
 
-        header_read += n;
-        // 行结束
-        if(strncmp(line_end_flag,"\r\n",2) == 0){
-            int l = header_read - header_line_offset-1;
-            char *header_entry = malloc(sizeof(char)+l);
-            if(header_entry == NULL){
-                return -1;
-            }
-            strncpy(header_entry, header_data + header_line_offset,l);
-            header_entry[l-1] = '\0';
-
-            // // 查找第一个冒号位置
-            char *col = strchr(header_entry,':');
-            if(col){
-                *col = '\0';  // 将冒号填充成字符串结束
-                char *key = header_entry;
-                char *value = col+1;
-                while (*value == ' '|| *value == '\r' || *value == '\n')// 如果是空白或者换行，则指针往前推
-                {
-                    value++;
-                }
-                _http_add_header(&request->header, key, value);
-            }
+/**
+ * @brief 是否 HTTP/1.1 请求
+ */
+static int _http_request_is_http11(HttpRequest *request){
+    return request->version.len == 8 && memcmp(request->version.data, "HTTP/1.1", 8) == 0;
+}
 
-            free(header_entry);
-            header_entry = NULL;
-            header_line_offset = header_read;
-        }
-        
-        // strstr 找寻字符串第一次出现
-        if(header_read >= 4 && strncmp(header_end_flag,"\r\n\r\n",4) == 0){
-            break;
-        }
+/**
+ * @brief 根据协议版本和 Connection 头判断是否保持连接
+ * @return 保持返回1,否则返回0
+ */
+static int _http_request_keep_alive(HttpRequest *request){
+    if(request->connection & HTTP_CONNECTION_CLOSE){
+        return 0;
     }
-    header_data[header_read] = '\0';
-
-    // 遍历 Content-Length 查找body长度
-    char *content_length_str = _http_get_header(&request->header,"Content-Length");
-    int content_length = 0;
-    if(content_length_str){
-        content_length = atoi(content_length_str);
-        if(content_length < 0 || content_length > MAX_BODY_SIZE){
-            return -1;
-        }
+    if(request->connection & HTTP_CONNECTION_KEEP_ALIVE){
+        return 1;
     }
+    // HTTP/1.1 默认保持连接，HTTP/1.0 默认关闭
+    return _http_request_is_http11(request);
+}
 
-    // 读取body
-    size_t content_length_t = sizeof(char)*content_length+1;
-    char *body = malloc(content_length_t);
-    memset(body, 0, content_length_t);
-    if(body == NULL){
-        return -1;
+/**
+ * @brief 获取指定请求头，名称不区分大小写，有多个同名请求头时返回第一个
+ * @return 没有时返回空字符串
+ */
+char *http_request_get_header(HttpRequest *request,const char *key){
+    size_t len = strlen(key);
+    HttpKnownHeader known = http_known_header(key, len);
+    if(known != HTTP_HEADER_UNKNOWN){
+        return request->known[known] ? (char *)request->known[known] : "";
     }
 
-    int body_read = 0;
-    for(;body_read < content_length;){
-        int n = read(client_fd, body+body_read, content_length-body_read);
-        if(n <= 0){
-            free(body);
-            return -1;
-        }
-        body_read += n;
+    int idx = http_headers_find(&request->headers, key, len, 0);
+    if(idx < 0){
+        return "";
     }
+    return (char *)http_headers_at(&request->headers, idx)->value.data;
+}
 
-    request->body = body;
-
-    return 0;
+/**
+ * @brief Content-Length，没有时为0
+ */
+long http_request_content_length(HttpRequest *request){
+    return request->content_length;
 }
 
 /**
- * @brief 销毁请求头
+ * @brief Host 请求头
+ * @return 没有时返回NULL
  */
-static void http_request_destroy(HttpRequest *request){
-    request->client_fd=0;
-    request->remote_port=0;
+const char *http_request_host(HttpRequest *request){
+    return request->known[HTTP_HEADER_HOST];
+}
 
-    if(request->remote_addr != NULL){
-        free(request->remote_addr);
-        request->remote_addr = NULL;
-    }
+/**
+ * @brief Content-Type 请求头
+ * @return 没有时返回NULL
+ */
+const char *http_request_content_type(HttpRequest *request){
+    return request->known[HTTP_HEADER_CONTENT_TYPE];
+}
 
-    if(request->remote_host != NULL){
-        free(request->remote_host);
-        request->remote_host = NULL;
-    }
+/**
+ * @brief User-Agent 请求头
+ * @return 没有时返回NULL
+ */
+const char *http_request_user_agent(HttpRequest *request){
+    return request->known[HTTP_HEADER_USER_AGENT];
+}
 
-    _http_clear_header(&request->header);
-    map_deinit(&request->header);
-    request = NULL;
+/**
+ * @brief Cookie 请求头，有多个时返回第一个
+ * @return 没有时返回NULL
+ */
+const char *http_request_cookie(HttpRequest *request){
+    return request->known[HTTP_HEADER_COOKIE];
 }
 
 /**
- * @brief 添加请求头
+ * @brief Accept-Encoding 请求头
+ * @return 没有时返回NULL
  */
-static void _http_request_add_header(HttpRequest *request,const char *key, char *value){
-    _http_add_header(&request->header,key,value);
+const char *http_request_accept_encoding(HttpRequest *request){
+    return request->known[HTTP_HEADER_ACCEPT_ENCODING];
 }
 
 /**
- * @brief 获取指定请求头
+ * @brief 获取所有同名请求头的值，名称不区分大小写，按请求中的顺序
+ * @param values 存放值，最多 max 个
+ * @return 同名请求头的数量，可能大于 max
  */
-char *http_request_get_header(HttpRequest *request,const char *key){
-    return _http_get_header(&request->header,key);
+int http_request_get_headers(HttpRequest *request, const char *key, const char **values, int max){
+    size_t len = strlen(key);
+    int count = 0;
+    for(int idx = 0; (idx = http_headers_find(&request->headers, key, len, idx)) >= 0; idx++){
+        if(count < max){
+            values[count] = http_headers_at(&request->headers, idx)->value.data;
+        }
+        count++;
+    }
+    return count;
 }
 
 /**
- * @brief 迭代请求头
+ * @brief 迭代请求头，按请求中的顺序返回，同名的头会返回多次
  * @return 返回key，可能NULL
  */
 const char *http_request_iter_header(HttpRequest *request, map_iter_t *iter_t){
-    return map_next(&request->header, iter_t);
+    // bucketidx 作为下标使用，map_iter() 的初始值是 -1
+    unsigned idx = ++iter_t->bucketidx;
+    if(idx >= (unsigned)request->headers.count){
+        return NULL;
+    }
+    return http_headers_at(&request->headers, idx)->name.data;
 }
 
 /**
- * @brief 获取指定的请求参数
- * @param key query的键
+ * @brief 获取路径参数，如路由 "/users/:id" 中的 id
+ * @return 没有时返回NULL
  */
-char *http_request_query(HttpRequest *request, const char *key){
-    // 取得值
-    char **value = map_get(&request->query_data,key);
-    if(value != NULL){
-        return *value;
-    }
-
-    // 判断是否已经有系列化过
-    if(value == NULL && request->get_data_init){
+char *http_request_param(HttpRequest *request, const char *name){
+    HttpRouteParams *params = &request->params;
+    if(params->count == 0){
         return NULL;
     }
 
-    // 提取问号 ?
-    // char *tmp = malloc(sizeof(char)* strlen(request->path)+1);
-    // /query?a=b&c=d
-
-    char *query = malloc(sizeof(char)*strlen(request->path)+1);
-    strcpy(query,request->path);
+    // 参数值是 path 的一部分，不能原地截断，第一次读取时统一复制一份
+    if(request->params_buf == NULL){
+        size_t size = 0;
+        for(int i = 0; i < params->count; i++){
+            size += params->items[i].value.len + 1;
+        }
+        char *buf = arena_alloc(request->arena, size);
+        if(buf == NULL){
+            return NULL;
+        }
+        char *p = buf;
+        for(int i = 0; i < params->count; i++){
+            HttpSlice *value = &params->items[i].value;
+            memcpy(p, value->data, value->len);
+            p[value->len] = '\0';
+            value->data = p;
+            p += value->len + 1;
+        }
+        request->params_buf = buf;
+    }
 
-    char *q = strchr(query,'?');
-    if(q && *(q+1) != '\0'){
-        char *qr = q+1;
+    for(int i = 0; i < params->count; i++){
+        if(strcmp(params->items[i].name.data, name) == 0){
+            return (char *)params->items[i].value.data;
+        }
+    }
+    return NULL;
+}
 
-        char *save_ptr = NULL;
-        char *and = strtok_r(qr, '&', save_ptr);
-        
-        while (and)
-        {
-            char *eq = strchr(and,'=');
-            char *val = NULL;
-            if(eq){
-                *eq= '\0';
-                val = malloc(sizeof(char)* strlen(eq+1)+1);
-                strcpy(val, eq+1);
-            }
+/**
+ * @brief 一个十六进制字符的值
+ * @return 不是十六进制字符时返回-1
+ */
+static int _http_hex(char c){
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
 
-            char ***entry = map_get(&request->query_data, eq);
-            if(entry == NULL){
-                map_set(&request->query_data, eq, val);
-            }else{
-                char ***old = entry;
+/**
+ * @brief 原地解码 application/x-www-form-urlencoded，'+' 为空格，非法的 % 保持原样
+ */
+static void _http_url_decode(char *s){
+    char *out = s;
+    for(; *s; s++){
+        if(*s == '+'){
+            *out++ = ' ';
+        }else if(*s == '%' && _http_hex(s[1]) >= 0 && _http_hex(s[2]) >= 0){
+            *out++ = (char)(_http_hex(s[1]) << 4 | _http_hex(s[2]));
+            s += 2;
+        }else{
+            *out++ = *s;
+        }
+    }
+    *out = '\0';
+}
 
-                free(old);
-            }
-            
+/**
+ * @brief 把值追加到 key 的值列表，列表以NULL结尾，在 arena 中
+ * @return 成功返回0,失败返回-1
+ */
+static int _http_request_query_add(HttpRequest *request, const char *key, char *value){
+    HttpQueryValues *entry = map_get(&request->query_data, key);
+    if(entry == NULL){
+        char **values = arena_alloc(request->arena, sizeof(char *) * 2);
+        if(values == NULL){
+            return -1;
+        }
+        values[0] = value;
+        values[1] = NULL;
+        HttpQueryValues first = { values, 1, 2 };
+        return map_set(&request->query_data, key, first);
+    }
 
-            and = strtok_r(NULL,'&',save_ptr);
+    // 满了时容量翻倍，同名参数很多时总的复制和 arena 占用仍是线性的
+    if(entry->count + 1 == entry->cap){
+        char **values = arena_alloc(request->arena, sizeof(char *) * entry->cap * 2);
+        if(values == NULL){
+            return -1;
         }
+        memcpy(values, entry->values, sizeof(char *) * entry->count);
+        entry->values = values;
+        entry->cap *= 2;
+    }
+    entry->values[entry->count++] = value;
+    entry->values[entry->count] = NULL;
+    return 0;
+}
 
+/**
+ * @brief 第一次读取查询参数时解析 '?' 之后的部分，复制到 arena 中原地解码
+ * @return 成功返回0,失败返回-1
+ */
+static int _http_request_parse_query(HttpRequest *request){
+    if(request->get_data_init){
+        return 0;
     }
-    char tmp[strlen(request->path)+1];
-    strcpy(tmp,request->path);
+    request->get_data_init = 1;
 
-    char *strtok_ptr;
-    char *token = strtok_r(tmp,'?', strtok_ptr);
-    
+    const char *q = memchr(request->path.data, '?', request->path.len);
+    if(q == NULL){
+        return 0;
+    }
+    q++;
+    char *query = arena_strndup(request->arena, q, request->path.data + request->path.len - q);
+    if(query == NULL){
+        return -1;
+    }
 
+    char *save_ptr = NULL;
+    for(char *pair = strtok_r(query, "&", &save_ptr); pair; pair = strtok_r(NULL, "&", &save_ptr)){
+        // 没有 '=' 时值为空字符串
+        char *eq = strchr(pair, '=');
+        char *value = "";
+        if(eq){
+            *eq = '\0';
+            value = eq + 1;
+            _http_url_decode(value);
+        }
+        _http_url_decode(pair);
+        if(_http_request_query_add(request, pair, value) != 0){
+            return -1;
+        }
+    }
+    return 0;
+}
 
-    // query = strtok_r()
-    
-    
-    // 分割 &
+/**
+ * @brief 获取查询参数，有多个同名参数时返回第一个
+ * @param key 解码后的参数名
+ * @return 没有时返回NULL
+ */
+char *http_request_query(HttpRequest *request, const char *key){
+    char **values = http_request_query_all(request, key);
+    return values ? values[0] : NULL;
+}
 
-    // TODO 需要初始化
-    return NULL;
+/**
+ * @brief 获取同名查询参数的所有值
+ * @return 以NULL结尾的数组，没有时返回NULL
+ */
+char **http_request_query_all(HttpRequest *request, const char *key){
+    if(_http_request_parse_query(request) != 0){
+        return NULL;
+    }
+    HttpQueryValues *entry = map_get(&request->query_data, key);
+    return entry ? entry->values : NULL;
+}
+
+/**
+ * @brief 迭代查询参数名，顺序不固定，每个名称只返回一次
+ * @return 返回key，结束时返回NULL
+ */
+const char *http_request_iter_query(HttpRequest *request, map_iter_t *iter_t){
+    if(_http_request_parse_query(request) != 0){
+        return NULL;
+    }
+    return map_next(&request->query_data, iter_t);
 }
 
 // ====================================================================
 // =========================== RESPONSE ===============================
 // ====================================================================
 
+/**
+ * @brief 返回头，名称和值都在 arena 中
+ */
+typedef struct HttpResponseHeader {
+    char *name;
+    char *value;
+} HttpResponseHeader;
+
 typedef struct HttpResponse {
     int status;
-    char *body;
-
-    map_str_t header;
+    const char *body;   // 可能包含\0，以 body_len 为准
+    size_t body_len;
+    HttpReleaseFunc release;    // body 的释放方法，arena 中的和静态的为NULL
+    Arena *arena;       // 与请求共用的内存池
+    HttpExchange *ex;
+
+    char chunked;       // 客户端支持分块传输 (HTTP/1.1)
+    char streaming;     // 已调用 http_response_begin_stream，返回头已发送
+    char ended;         // 流式返回已结束
+    char failed;        // 流式返回发送失败，连接将被关闭
+    char chunk_head[20];    // 当前块的长度行
+
+    HttpResponseHeader *headers;
+    int header_count;
+    int header_cap;
 } HttpResponse;
 
 /**
  * @brief 初始化返回数据
  */
-static void http_response_init(HttpResponse *response){
+static void http_response_init(HttpResponse *response, HttpExchange *ex){
+    memset(response, 0, sizeof(HttpResponse));
     response->status = 200;
-    response->body = NULL;
-    map_init(&response->header);
+    response->arena = ex->arena;
+    response->ex = ex;
 }
 
-/** 
- * @brief 返回一个新的response,在堆里
+/**
+ * @brief 释放 body，已交给连接发送的不会再释放
  */
-static HttpResponse *http_response_new(){
-    HttpResponse *response = (HttpResponse *)malloc(sizeof(HttpResponse));
-    http_response_init(response);
-    return response;
+static void _http_response_release_body(HttpResponse *response){
+    if(response->release != NULL){
+        response->release((void *)response->body);
+        response->release = NULL;
+    }
+    response->body = NULL;
+    response->body_len = 0;
 }
 
 /**
- * @brief 销毁一个response
- * 
- * @param response 
+ * @brief 销毁一个response，内存都在 arena 中，没有发送的 body 在这里释放
  */
 static void http_response_destroy(HttpResponse *response){
-    if(response->body!= NULL){
-        free(response->body);
-    }
-    response->body =NULL;
+    _http_response_release_body(response);
     response->status = 0;
+    response->headers = NULL;
+    response->header_count = 0;
+    response->header_cap = 0;
+}
+
+/**
+ * @brief 查找返回头，名称不区分大小写
+ */
+static HttpResponseHeader *_http_response_find_header(HttpResponse *response, const char *key){
+    for(int i = 0; i < response->header_count; i++){
+        if(strcasecmp(response->headers[i].name, key) == 0){
+            return &response->headers[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 追加返回头，容量不够时在 arena 中重新分配
+ */
+static void _http_response_append_header(HttpResponse *response, const char *key, char *value){
+    if(response->header_count == response->header_cap){
+        int cap = response->header_cap ? response->header_cap * 2 : 8;
+        HttpResponseHeader *headers = arena_alloc(response->arena, sizeof(HttpResponseHeader) * cap);
+        if(headers == NULL){
+            return;
+        }
+        if(response->header_count > 0){
+            memcpy(headers, response->headers, sizeof(HttpResponseHeader) * response->header_count);
+        }
+        response->headers = headers;
+        response->header_cap = cap;
+    }
 
-    _http_clear_header(&response->header);
-    map_deinit(&response->header);
+    char *name = arena_strdup(response->arena, key);
+    char *val = arena_strdup(response->arena, value);
+    if(name == NULL || val == NULL){
+        return;
+    }
+    response->headers[response->header_count].name = name;
+    response->headers[response->header_count].value = val;
+    response->header_count++;
 }
 
 /**
- * @brief 添加头
+ * @brief 添加头，同名的头会分别输出
  */
 void http_response_add_header(HttpResponse *response,const char *key, char *value){
-    _http_add_header(&response->header,key,value);
+    _http_response_append_header(response, key, value);
 }
 
 /**
- * @brief 设置头部信息
+ * @brief 设置头部信息，直接覆盖原先数据
  */
 void http_response_set_header(HttpResponse *response,const char *key, char *value){
-    _http_set_header(&response->header,key,value);
+    HttpResponseHeader *header = _http_response_find_header(response, key);
+    if(header == NULL){
+        _http_response_append_header(response, key, value);
+        return;
+    }
+    char *val = arena_strdup(response->arena, value);
+    if(val != NULL){
+        header->value = val;
+    }
 }
 
 /**
  * @brief 获取头
- * @return 返回头内容
+ * @return 返回头内容，没有时返回空字符串
  */
 char *http_response_get_header(HttpResponse *response,const char *key){
-    return _http_get_header(&response->header,key);
+    HttpResponseHeader *header = _http_response_find_header(response, key);
+    return header ? header->value : "";
+}
+
+/**
+ * @brief 设置 body，替换掉之前写入的
+ */
+static void _http_response_set_body(HttpResponse *response, const void *data, size_t len, HttpReleaseFunc release){
+    _http_response_release_body(response);
+    response->body = data;
+    response->body_len = len;
+    response->release = release;
 }
 
 /**
@@ -442,8 +745,46 @@ char *http_response_get_header(HttpResponse *response,const char *key){
 int http_response_write(HttpResponse *response, char *data){
     if(response == NULL) return -1;
 
-    response->body = malloc(sizeof(char)*strlen(data));
-    strcpy(response->body, data);
+    return http_response_write_bytes(response, data, strlen(data));
+}
+
+/**
+ * @brief 复制 len 字节到 arena，可以包含\0
+ */
+int http_response_write_bytes(HttpResponse *response, const void *data, size_t len){
+    if(response == NULL) return -1;
+
+    char *body = arena_alloc(response->arena, len);
+    if(body == NULL){
+        _http_response_release_body(response);
+        return -1;
+    }
+    memcpy(body, data, len);
+    _http_response_set_body(response, body, len, NULL);
+    return 0;
+}
+
+/**
+ * @brief 不复制，发送完后由连接调用 release
+ */
+int http_response_write_ref(HttpResponse *response, const void *data, size_t len, HttpReleaseFunc release){
+    if(response == NULL){
+        if(release != NULL){
+            release((void *)data);
+        }
+        return -1;
+    }
+    _http_response_set_body(response, data, len, release);
+    return 0;
+}
+
+/**
+ * @brief 不复制也不释放
+ */
+int http_response_write_static(HttpResponse *response, const void *data, size_t len){
+    if(response == NULL) return -1;
+
+    _http_response_set_body(response, data, len, NULL);
     return 0;
 }
 
@@ -452,126 +793,1656 @@ int http_response_write(HttpResponse *response, char *data){
 // ============================= SERVER ===============================
 // ====================================================================
 
+/**
+ * @brief 路由，路由树中保存的是指向它的指针
+ */
+typedef struct HttpRoute {
+    HttpHandler handle;
+    HttpBodyMode body_mode;
+    long max_body;              // Content-Length 的最大值
+    HttpMethod method;          // 每核独立模式下按这两项为每个事件循环重新建立路由表
+    char *path;
+    struct HttpRoute *next;     // 服务器的所有路由，按添加顺序，销毁时释放
+} HttpRoute;
+
+/**
+ * @brief 一个事件循环和它的监听套接字，接受的连接只由这个事件循环的线程访问。
+ *        按缓存行对齐，相邻的事件循环各自写自己的字段时互不影响
+ */
+typedef struct HttpShard {
+    _Alignas(CACHE_LINE_SIZE) struct HttpServer *server;
+    int socket_fd;      // 监听套接字
+    EventLoop *loop;
+    pthread_t thread;
+    int cpu;            // 绑定的 CPU, -1 不绑定
+
+    Uring *uring;       // io_uring 方式时不为NULL, 由事件循环线程独占
+    int *uring_slots;   // 固定文件表中空闲位置的栈，位置在关闭完成后才放回
+    unsigned uring_free;
+    int accept_paused;  // 文件描述符用完时暂停接受，周期任务中恢复
+
+    HttpRouter *router;         // 每核独立模式下是本线程建立的副本，否则是服务器的路由表
+
+    HttpConnection *conn_head;  // 最久未活动的连接
+    HttpConnection *conn_tail;  // 最近活动的连接
+
+    // 统计，只由事件循环线程写入，其他线程随时读取
+    atomic_llong stat_accepted;
+    atomic_llong stat_closed;
+    atomic_llong stat_requests;
+} HttpShard;
+
 typedef struct HttpServer {
     char *host; // 绑定的主机地址       // 8
     int port; // 服务器端口            // 4
-    int socket_fd; // 套接字文件描述符  // 4
 
-    ThreadPool *thread_pool; // 线程池 // 8
+    ThreadPool *thread_pool; // 线程池，所有事件循环共用，每核独立模式下为NULL // 8
+
+    HttpListenMode listen_mode;
+    HttpIoEngine io_engine;
+    int shard_count;         // 事件循环数量, HTTP_LISTEN_SINGLE 时为1
+    HttpShard *shards;
+
+    int keepalive_max_requests; // 每个连接最多处理的请求数, <=0 不限制
+    int keepalive_timeout;      // 空闲超时，毫秒, <=0 不保持连接
 
-    map_void_t routes;               // 8
+    HttpRouter *router;      // 路由, 启动后只读, 工作线程无锁共享
+    HttpRoute *routes;
+
+    atomic_int stop_requested;  // http_server_stop 已被调用，事件循环创建前调用时由 http_server_start 检查
+
+    int workers;             // 工作进程数, 0 不使用多进程
+    int worker_index;        // 工作进程中是自己的编号，其他情况为-1
+    int listen_fd;           // 主进程打开、工作进程继承的监听套接字, -1 表示由各事件循环自己打开
+    struct HttpWorkerSlot *_Atomic worker_slots; // 和工作进程共享的统计
+    pid_t master_pid;
+    pthread_t master_thread;    // 主进程中等待信号的线程
+    atomic_int master_running;
 } HttpServer;
 
+/**
+ * @brief 一个工作进程在共享内存中的统计，各工作进程只写自己的，按缓存行对齐
+ */
+typedef struct HttpWorkerSlot {
+    _Alignas(CACHE_LINE_SIZE) atomic_int pid;  // 由主进程写入
+    atomic_int restarts;
+    atomic_llong rss;
+    atomic_llong accepted;
+    atomic_llong active;
+    atomic_llong requests;
+    long long started;      // 启动时间，毫秒，只由主进程使用
+    long long restart_at;   // 等待重新启动的时间，0 表示不需要
+} HttpWorkerSlot;
 
-typedef struct handle_struct{
-    HttpServer *svr;
-    int client_fd;
-} handle_struct;
+/**
+ * @brief 统计计数加 n，计数只有所属事件循环一个写入者，不需要原子的读改写
+ */
+static inline void _http_stat_add(atomic_llong *counter, long long n){
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
 
 /**
- * @brief 客户端返回
+ * @brief 由服务器生成的返回头
  */
-static void response_to_client(int client_fd, HttpRequest *request, HttpResponse *response){
-    char buf[MAX_HEADER_SIZE];
-    char *status_msg;
-    char *body = response->body;
+static int _http_response_reserved_header(const char *name){
+    return strcasecmp(name, "Content-Length") == 0 || strcasecmp(name, "Connection") == 0
+        || strcasecmp(name, "Transfer-Encoding") == 0;
+}
 
-    if(body == NULL){
-        body = "";
+/**
+ * @brief 追加一段待发送数据，不复制，空的段直接忽略
+ * @return 成功返回0,失败返回-1
+ */
+static int _http_exchange_add_iov(HttpExchange *ex, const void *base, size_t len){
+    if(len == 0){
+        return 0;
     }
-    
-    switch (response->status)
-    {
+    if(ex->wiov_count == ex->wiov_cap){
+        int cap = ex->wiov_cap ? ex->wiov_cap * 2 : 4;
+        struct iovec *iov = arena_alloc(ex->arena, sizeof(struct iovec) * cap);
+        if(iov == NULL){
+            return -1;
+        }
+        if(ex->wiov_count > 0){
+            memcpy(iov, ex->wiov, sizeof(struct iovec) * ex->wiov_count);
+        }
+        ex->wiov = iov;
+        ex->wiov_cap = cap;
+    }
+    ex->wiov[ex->wiov_count].iov_base = (void *)base;
+    ex->wiov[ex->wiov_count].iov_len = len;
+    ex->wiov_count++;
+    return 0;
+}
+
+/**
+ * @brief 状态行和返回头在 arena 中按实际长度生成，作为一段待发送数据
+ * @param body_len 流式返回时忽略
+ * @return 成功返回0,失败返回-1
+ */
+static int _http_response_add_head(HttpExchange *ex, HttpResponse *response, size_t body_len){
+    char *status_msg;
+
+    switch (response->status)
+    {
+        case 400:
+            status_msg = HTTP_STATUS_MSG_BAD_REQUEST;
+            break;
+
         case 404:
             status_msg = HTTP_STATUS_MSG_NOT_FOUND;
             break;
+
+        case 413:
+            status_msg = HTTP_STATUS_MSG_PAYLOAD_TOO_LARGE;
+            break;
         
         default:
             status_msg = HTTP_STATUS_MSG_OK;
             break;
     }
 
-    char len_str[10];
-    snprintf(len_str, sizeof(len_str), "%zu", strlen(body));
-    http_response_set_header(response,"Content-Length", len_str);
-
-    char *header_str = malloc(sizeof(char)*256);
-    map_iter_t header_iter = map_iter();
-    const char *key;
-    while ((key = map_next(&response->header, &header_iter)) != NULL)
-    {  
-        char *tmp = header_str;
-        header_str = str_append(key,": ");
-        free(tmp);
-        tmp = header_str;
-        header_str = str_append(header_str,_http_get_header(&response->header,key));
-        free(tmp);
-        tmp = header_str;
-        header_str = str_append(header_str,"\r\n");
-        free(tmp);  
-    }
-    key = NULL;
-
-    sprintf(buf,
+    // 流式返回不知道长度，HTTP/1.0 的客户端不支持分块，以关闭连接表示结束
+    char framing[48] = "";
+    if(!response->streaming){
+        snprintf(framing, sizeof(framing), "Content-Length: %zu\r\n", body_len);
+    }else if(response->chunked){
+        strcpy(framing, "Transfer-Encoding: chunked\r\n");
+    }
+
+    char head[256];
+    int head_len = snprintf(head, sizeof(head),
         "HTTP/1.1 %d %s\r\n"
-        "Content-Type: text/plain\r\n"
-        "Connection: close\r\n"
         "%s"
-        "\r\n"
+        "Connection: %s\r\n"
         "%s",
-        response->status, status_msg, header_str, body);
+        response->status, status_msg,
+        _http_response_find_header(response, "Content-Type") ? "" : "Content-Type: text/plain\r\n",
+        ex->keep_alive ? "keep-alive" : "close",
+        framing);
+
+    // Content-Length、Transfer-Encoding 和 Connection 由服务器生成，忽略 handler 设置的值
+    size_t len = head_len + 2;
+    for(int i = 0; i < response->header_count; i++){
+        HttpResponseHeader *header = &response->headers[i];
+        if(_http_response_reserved_header(header->name)){
+            continue;
+        }
+        len += strlen(header->name) + 2 + strlen(header->value) + 2;
+    }
+
+    char *buf = arena_alloc(ex->arena, len);
+    if(buf == NULL){
+        return -1;
+    }
+
+    char *p = buf;
+    memcpy(p, head, head_len);
+    p += head_len;
+    for(int i = 0; i < response->header_count; i++){
+        HttpResponseHeader *header = &response->headers[i];
+        if(_http_response_reserved_header(header->name)){
+            continue;
+        }
+        p = stpcpy(p, header->name);
+        *p++ = ':';
+        *p++ = ' ';
+        p = stpcpy(p, header->value);
+        *p++ = '\r';
+        *p++ = '\n';
+    }
+    *p++ = '\r';
+    *p++ = '\n';
+    return _http_exchange_add_iov(ex, buf, len);
+}
+
+/**
+ * @brief 客户端返回，body 不复制，和返回头一起作为待发送数据
+ */
+static void response_to_client(HttpExchange *ex, HttpRequest *request, HttpResponse *response){
+    if(response->streaming){
+        // handler 没有结束流式返回时由服务器结束，失败的连接直接关闭
+        if(!response->failed){
+            http_response_end(response);
+        }
+        return;
+    }
+
+    const char *body = response->body;
+    size_t body_len = body ? response->body_len : 0;
+
+    // body 的所有权交给连接，发送完或连接关闭时释放
+    ex->wrelease = response->release;
+    ex->wrelease_data = (void *)body;
+    response->release = NULL;
+
+    if(_http_response_add_head(ex, response, body_len) != 0 || _http_exchange_add_iov(ex, body, body_len) != 0){
+        // 发送不完整的返回没有意义，直接关闭连接
+        ex->wiov_count = 0;
+        ex->keep_alive = 0;
+    }
+}
+
+/**
+ * @brief 释放一个请求已交给连接的返回数据
+ */
+static void _http_exchange_release(HttpExchange *ex){
+    if(ex->wrelease != NULL){
+        ex->wrelease(ex->wrelease_data);
+        ex->wrelease = NULL;
+        ex->wrelease_data = NULL;
+    }
+}
+
+/**
+ * @brief 释放同一批请求已交给连接的返回数据
+ */
+static void _http_conn_release(HttpConnection *conn){
+    _http_exchange_release(&conn->head);
+    for(int i = 0; i < conn->batch_count; i++){
+        _http_exchange_release(&conn->batch[i]);
+    }
+}
+
+/**
+ * @brief 新建连接
+ */
+static HttpConnection *_http_conn_new(HttpShard *shard, int client_fd){
+    HttpConnection *conn = malloc(sizeof(HttpConnection));
+    if(conn == NULL){
+        return NULL;
+    }
+    memset(conn, 0, sizeof(HttpConnection));
+    conn->fd = client_fd;
+    conn->server = shard->server;
+    conn->shard = shard;
+    conn->state = HTTP_CONN_READING;
+    conn->file_slot = -1;
+    http_parser_init(&conn->parser);
+    conn->head.conn = conn;
+    conn->head.parser = &conn->parser;
+    conn->head.arena = arena_new(REQUEST_ARENA_SIZE);
+    if(conn->head.arena == NULL){
+        free(conn);
+        return NULL;
+    }
+    return conn;
+}
+
+/**
+ * @brief 从连接链表中移除
+ */
+static void _http_conn_unlink(HttpConnection *conn){
+    HttpShard *shard = conn->shard;
+    if(conn->prev){
+        conn->prev->next = conn->next;
+    }else{
+        shard->conn_head = conn->next;
+    }
+    if(conn->next){
+        conn->next->prev = conn->prev;
+    }else{
+        shard->conn_tail = conn->prev;
+    }
+    conn->prev = conn->next = NULL;
+}
+
+/**
+ * @brief 刷新活动时间，移到连接链表末尾
+ */
+static void _http_conn_touch(HttpConnection *conn){
+    HttpShard *shard = conn->shard;
+    conn->last_active = event_loop_now(shard->loop);
+    if(shard->conn_tail == conn){
+        return;
+    }
+    if(conn->prev || conn->next || shard->conn_head == conn){
+        _http_conn_unlink(conn);
+    }
+    conn->prev = shard->conn_tail;
+    if(shard->conn_tail){
+        shard->conn_tail->next = conn;
+    }else{
+        shard->conn_head = conn;
+    }
+    shard->conn_tail = conn;
+}
+
+/**
+ * @brief 释放已关闭的连接
+ */
+static void _http_conn_free(HttpConnection *conn){
+    _http_conn_release(conn);
+    free(conn->rbuf);
+    arena_destroy(conn->head.arena);
+    if(conn->batch != NULL){
+        for(int i = 0; i < PIPELINE_MAX - 1; i++){
+            if(conn->batch[i].arena != NULL){
+                arena_destroy(conn->batch[i].arena);
+            }
+        }
+        free(conn->batch);
+        free(conn->batch_parsers);
+    }
+    free(conn);
+}
+
+// ====================================================================
+// ============================= URING ================================
+// ====================================================================
+
+/**
+ * @brief 操作对象是连接的套接字，有固定文件时使用固定文件，内核不必每次查找文件描述符
+ */
+static void _http_uring_prep_fd(HttpConnection *conn, struct io_uring_sqe *sqe){
+    if(conn->file_slot >= 0){
+        sqe->fd = conn->file_slot;
+        sqe->flags |= IOSQE_FIXED_FILE;
+    }else{
+        sqe->fd = conn->fd;
+    }
+}
+
+/**
+ * @brief 关闭连接的固定文件，没有固定文件时关闭套接字
+ */
+static void _http_uring_prep_close(HttpConnection *conn, struct io_uring_sqe *sqe){
+    sqe->opcode = IORING_OP_CLOSE;
+    if(conn->file_slot >= 0){
+        sqe->file_index = conn->file_slot + 1;
+        sqe->user_data = ((unsigned long long)conn->file_slot << URING_OP_BITS) | URING_OP_CLOSE;
+    }else{
+        sqe->fd = conn->fd;
+    }
+}
+
+/**
+ * @brief 提交一次接收，数据放在内核从缓冲环中选出的缓冲里，空闲连接不占用接收缓冲。
+ *        第一次接收前把套接字放入固定文件表，和接收链接在一起提交
+ * @return 成功返回0,失败返回-1
+ */
+static int _http_uring_recv(HttpConnection *conn){
+    HttpShard *shard = conn->shard;
+    Uring *ring = shard->uring;
+    if(uring_reserve(ring, 2) != 0){
+        return -1;
+    }
+
+    struct io_uring_sqe *sqe;
+    if(conn->file_slot < 0 && shard->uring_free > 0){
+        conn->file_slot = shard->uring_slots[--shard->uring_free];
+        sqe = uring_get_sqe(ring);
+        sqe->opcode = IORING_OP_FILES_UPDATE;
+        sqe->addr = (uintptr_t)&conn->fd;
+        sqe->len = 1;
+        sqe->off = conn->file_slot;
+        sqe->flags = IOSQE_IO_LINK;
+    }
+
+    sqe = uring_get_sqe(ring);
+    sqe->opcode = IORING_OP_RECV;
+    _http_uring_prep_fd(conn, sqe);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->len = READ_BUFFER_SIZE;
+    sqe->user_data = (uintptr_t)conn | URING_OP_RECV;
+    conn->uring_op = sqe->user_data;
+    return 0;
+}
+
+/**
+ * @brief 提交一次发送，最后一段返回发送后要关闭连接时把关闭链接在发送之后
+ * @return 没有待发送数据返回1, 已提交返回0, 失败返回-1
+ */
+static int _http_uring_send(HttpConnection *conn){
+    HttpExchange *head = &conn->head;
+    Uring *ring = conn->shard->uring;
+    int left = head->wiov_count - conn->wiov_sent;
+    if(left == 0){
+        return 1;
+    }
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if(sqe == NULL){
+        return -1;
+    }
+
+    // 内核在操作完成前读取 msghdr 和各段数据，它们都在连接和 arena 中，操作进行中连接不会释放
+    memset(&conn->wmsg, 0, sizeof(conn->wmsg));
+    conn->wmsg.msg_iov = head->wiov + conn->wiov_sent;
+    conn->wmsg.msg_iovlen = left > IOV_MAX ? IOV_MAX : left;
+    conn->wmsg_len = 0;
+    for(size_t i = 0; i < conn->wmsg.msg_iovlen; i++){
+        conn->wmsg_len += conn->wmsg.msg_iov[i].iov_len;
+    }
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    _http_uring_prep_fd(conn, sqe);
+    sqe->addr = (uintptr_t)&conn->wmsg;
+    sqe->len = 1;
+    // 发送缓冲满时由内核等待可写，完成时可能只发送了一部分，剩余的由完成事件再次提交;
+    // 不使用 MSG_WAITALL，不是所有内核都保证全部发送，接收慢的客户端也要在每次完成时刷新活动时间
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = (uintptr_t)conn | URING_OP_SEND;
+    conn->uring_op = sqe->user_data;
+    return 0;
+}
+
+/**
+ * @brief 在监听套接字上提交多次接受，一次提交持续产生新连接
+ * @return 成功返回0,失败返回-1
+ */
+static int _http_uring_accept(HttpShard *shard){
+    struct io_uring_sqe *sqe = uring_get_sqe(shard->uring);
+    if(sqe == NULL){
+        return -1;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = shard->socket_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = (uintptr_t)shard | URING_OP_ACCEPT;
+    return 0;
+}
+
+/**
+ * @brief 取消进行中的操作并关闭套接字，固定文件表中的位置在关闭完成后放回
+ */
+static void _http_uring_close(HttpConnection *conn){
+    HttpShard *shard = conn->shard;
+    struct io_uring_sqe *sqe;
+    if(conn->uring_op != 0){
+        if((sqe = uring_get_sqe(shard->uring)) != NULL){
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = conn->uring_op;
+        }else{
+            // 提交队列满时让接收或发送立即结束
+            shutdown(conn->fd, SHUT_RDWR);
+        }
+    }
+    close(conn->fd);
+    if(conn->file_slot < 0){
+        return;
+    }
+    if((sqe = uring_get_sqe(shard->uring)) != NULL){
+        _http_uring_prep_close(conn, sqe);
+    }else{
+        uring_unregister_file(shard->uring, conn->file_slot);
+        shard->uring_slots[shard->uring_free++] = conn->file_slot;
+    }
+}
+
+/**
+ * @brief 关闭连接，只能在事件循环线程调用; io_uring 中还有进行中的操作时，等操作完成后再释放
+ */
+static void _http_conn_close(HttpConnection *conn){
+    conn->state = HTTP_CONN_CLOSED;
+    _http_conn_unlink(conn);
+    _http_stat_add(&conn->shard->stat_closed, 1);
+    if(conn->shard->uring != NULL){
+        _http_uring_close(conn);
+        if(conn->uring_op != 0){
+            return;
+        }
+    }else{
+        event_loop_del(conn->shard->loop, conn->fd);
+        close(conn->fd);
+    }
+    _http_conn_free(conn);
+}
+
+/**
+ * @brief 已发送 n 字节，跳过发送完的段，发送了一部分的段原地前移
+ */
+static void _http_conn_advance(HttpConnection *conn, size_t n){
+    HttpExchange *head = &conn->head;
+    while (n > 0)
+    {
+        struct iovec *iov = &head->wiov[conn->wiov_sent];
+        if(n >= iov->iov_len){
+            n -= iov->iov_len;
+            conn->wiov_sent++;
+        }else{
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+            n = 0;
+        }
+    }
+}
+
+/**
+ * @brief 发送待发送数据，一次系统调用发送多段，只发送了一部分时记录位置。
+ *        不释放返回数据，同一批的其他请求可能还在处理
+ * @return 全部发送完返回1, 需要等待可写返回0, 出错返回-1
+ */
+static int _http_conn_flush(HttpConnection *conn){
+    HttpExchange *head = &conn->head;
+    while (conn->wiov_sent < head->wiov_count)
+    {
+        // 和 writev 相同，但可以带 MSG_NOSIGNAL，对端关闭时不会产生 SIGPIPE
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = head->wiov + conn->wiov_sent;
+        msg.msg_iovlen = head->wiov_count - conn->wiov_sent;
+        if(msg.msg_iovlen > IOV_MAX){
+            msg.msg_iovlen = IOV_MAX;
+        }
+
+        ssize_t n = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+        if(n > 0){
+            _http_conn_advance(conn, n);
+            continue;
+        }
+        if(n < 0 && errno == EINTR){
+            continue;
+        }
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            return 0;
+        }
+        return -1;
+    }
+    return 1;
+}
+
+// ====================================================================
+// ============================ STREAM ================================
+// ====================================================================
+
+/**
+ * @brief 在工作线程中等待连接可读或可写。连接由工作线程持有，事件循环不会处理它的事件
+ * @return 就绪返回0, 出错或超时返回-1
+ */
+static int _http_conn_wait(HttpConnection *conn, short events){
+    for(;;){
+        struct pollfd pfd = { .fd = conn->fd, .events = events };
+        int n = poll(&pfd, 1, STREAM_TIMEOUT);
+        if(n < 0 && errno == EINTR){
+            continue;
+        }
+        return n > 0 ? 0 : -1;
+    }
+}
+
+/**
+ * @brief 在工作线程中发送全部待发送数据，客户端接收慢时阻塞等待，使生产数据的 handler 暂停
+ * @return 成功返回0, 出错或超时返回-1
+ */
+static int _http_conn_flush_wait(HttpConnection *conn){
+    int rs;
+    while ((rs = _http_conn_flush(conn)) == 0)
+    {
+        if(_http_conn_wait(conn, POLLOUT) != 0){
+            return -1;
+        }
+    }
+    if(rs < 0){
+        return -1;
+    }
+    // 已发送的段不再需要，数组留给下一块使用
+    conn->head.wiov_count = conn->wiov_sent = 0;
+    return 0;
+}
+
+/**
+ * @brief 是否可以直接向套接字发送。流水线中排在后面的请求要等前面的返回发送完，只能先缓存
+ */
+static int _http_response_direct(HttpResponse *response){
+    return response->ex == &response->ex->conn->head;
+}
+
+/**
+ * @brief 流式返回发送失败，之后的写入都失败，处理完后关闭连接
+ */
+static int _http_response_stream_fail(HttpResponse *response){
+    HttpExchange *ex = response->ex;
+    response->failed = 1;
+    ex->keep_alive = 0;
+    ex->wiov_count = 0;
+    if(_http_response_direct(response)){
+        ex->conn->wiov_sent = 0;
+    }
+    return -1;
+}
+
+/**
+ * @brief 开始流式返回，立即发送返回头
+ */
+int http_response_begin_stream(HttpResponse *response){
+    if(response == NULL || response->streaming){
+        return -1;
+    }
+    _http_response_release_body(response);
+    response->streaming = 1;
+    HttpExchange *ex = response->ex;
+    if(!response->chunked){
+        ex->keep_alive = 0;
+    }
+    if(!_http_response_direct(response)){
+        return _http_response_add_head(ex, response, 0) == 0 ? 0 : _http_response_stream_fail(response);
+    }
+
+    // 已经发送了最终的返回，不能再发送 100 Continue
+    ex->conn->continue_pending = 0;
+    if(_http_response_add_head(ex, response, 0) != 0 || _http_conn_flush_wait(ex->conn) != 0){
+        return _http_response_stream_fail(response);
+    }
+    return 0;
+}
+
+/**
+ * @brief 发送一块数据，返回时数据已全部交给内核; 排在后面的请求复制到 arena 中和整批一起发送
+ */
+int http_response_write_chunk(HttpResponse *response, const void *data, size_t len){
+    if(response == NULL || !response->streaming || response->ended || response->failed){
+        return -1;
+    }
+    if(len == 0){
+        return 0; // 长度为0的块表示结束，不能发送
+    }
+
+    HttpExchange *ex = response->ex;
+    if(!_http_response_direct(response)){
+        // 分块头、数据和块结尾复制为一段，handler 返回后 data 和 response 都不再有效
+        char *buf = arena_alloc(ex->arena, len + sizeof(response->chunk_head) + 2);
+        if(buf == NULL){
+            return _http_response_stream_fail(response);
+        }
+        size_t n = response->chunked ? (size_t)sprintf(buf, "%zx\r\n", len) : 0;
+        memcpy(buf + n, data, len);
+        n += len;
+        if(response->chunked){
+            buf[n++] = '\r';
+            buf[n++] = '\n';
+        }
+        return _http_exchange_add_iov(ex, buf, n) == 0 ? 0 : _http_response_stream_fail(response);
+    }
+
+    int rs = 0;
+    if(response->chunked){
+        int n = snprintf(response->chunk_head, sizeof(response->chunk_head), "%zx\r\n", len);
+        rs |= _http_exchange_add_iov(ex, response->chunk_head, n);
+    }
+    rs |= _http_exchange_add_iov(ex, data, len);
+    if(response->chunked){
+        rs |= _http_exchange_add_iov(ex, "\r\n", 2);
+    }
+    if(rs != 0 || _http_conn_flush_wait(ex->conn) != 0){
+        return _http_response_stream_fail(response);
+    }
+    return 0;
+}
+
+/**
+ * @brief 结束流式返回，结束块不等待发送完，剩余部分交给事件循环
+ */
+int http_response_end(HttpResponse *response){
+    if(response == NULL || !response->streaming || response->failed){
+        return -1;
+    }
+    if(response->ended){
+        return 0;
+    }
+    response->ended = 1;
+    if(!response->chunked){
+        return 0; // 以关闭连接表示结束
+    }
 
-    write(client_fd, buf, strlen(buf));
-    free(header_str);
-    header_str = NULL;
-    status_msg = NULL;
-    body = NULL;
+    HttpExchange *ex = response->ex;
+    if(_http_exchange_add_iov(ex, "0\r\n\r\n", 5) != 0
+        || (_http_response_direct(response) && _http_conn_flush(ex->conn) < 0)){
+        return _http_response_stream_fail(response);
+    }
+    return 0;
+}
+
+static const char HTTP_CONTINUE[] = "HTTP/1.1 100 Continue\r\n\r\n";
+
+/**
+ * @brief 在工作线程中从套接字读取，没有数据时等待
+ * @return 读取的字节数, 对端关闭、出错或超时返回-1
+ */
+static long _http_conn_recv(HttpConnection *conn, void *buf, size_t len){
+    for(;;){
+        ssize_t n = recv(conn->fd, buf, len, 0);
+        if(n > 0){
+            return n;
+        }
+        if(n < 0 && errno == EINTR){
+            continue;
+        }
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && _http_conn_wait(conn, POLLIN) == 0){
+            continue;
+        }
+        return -1;
+    }
+}
+
+/**
+ * @brief 流式读取 Content-Length body，先取随请求头一起读入缓冲的部分，再直接从套接字读到 buf
+ * @return 读取的字节数, 出错返回-1
+ */
+static long _http_conn_read_fixed(HttpConnection *conn, void *buf, size_t len){
+    if(len > (size_t)conn->body_left){
+        len = conn->body_left;
+    }
+
+    long n;
+    size_t buffered = conn->rlen - conn->request_len;
+    if(buffered > 0){
+        n = len < buffered ? len : buffered;
+        memcpy(buf, conn->rbuf + conn->request_len, n);
+        conn->request_len += n;
+    }else{
+        // 最多读到 body 结尾，之后的下一个请求留在套接字中由事件循环读取
+        n = _http_conn_recv(conn, buf, len);
+        if(n < 0){
+            return -1;
+        }
+    }
+    conn->body_left -= n;
+    if(conn->body_left == 0){
+        conn->body_stream = 0;
+    }
+    return n;
+}
+
+/**
+ * @brief 流式读取分块 body。分块头读入读缓冲中请求头之后的空间解析;
+ *        块数据先取读缓冲中的部分，再直接从套接字读到 buf
+ * @return 读取的字节数, 读完返回0, 出错或格式非法返回-1
+ */
+static long _http_conn_read_chunked(HttpConnection *conn, void *buf, size_t len){
+    HttpChunkedParser *chunked = &conn->chunked;
+    for(;;){
+        size_t buffered = conn->rlen - conn->request_len;
+        if(chunked->remaining > 0){
+            size_t n = len < chunked->remaining ? len : chunked->remaining;
+            long rs;
+            if(buffered > 0){
+                rs = n < buffered ? n : buffered;
+                memcpy(buf, conn->rbuf + conn->request_len, rs);
+                conn->request_len += rs;
+            }else if((rs = _http_conn_recv(conn, buf, n)) < 0){
+                return -1;
+            }
+            http_chunked_consume(chunked, rs);
+            return rs;
+        }
+
+        if(buffered > 0){
+            size_t consumed;
+            int rs = http_chunked_execute(chunked, conn->rbuf + conn->request_len, buffered, &consumed);
+            conn->request_len += consumed;
+            if(rs == HTTP_PARSE_ERROR){
+                return -1;
+            }
+            if(rs == HTTP_PARSE_DONE){
+                conn->body_stream = 0;
+                conn->body_chunked = 0;
+                return 0;
+            }
+            continue;
+        }
+
+        // 读缓冲中的数据都已解析，丢掉后从请求头之后继续读取，请求头仍被请求引用
+        conn->rlen = conn->request_len = conn->header_len;
+        long n = _http_conn_recv(conn, conn->rbuf + conn->rlen, conn->rcap - conn->rlen);
+        if(n < 0){
+            return -1;
+        }
+        conn->rlen += n;
+    }
+}
+
+/**
+ * @brief 在工作线程中读取流式 body
+ * @return 读取的字节数, 读完返回0, 出错或超时返回-1
+ */
+static long _http_conn_read_body(HttpConnection *conn, void *buf, size_t len){
+    if(!conn->body_stream || len == 0){
+        return 0;
+    }
+
+    // handler 真正读取时才让客户端发送 body
+    if(conn->continue_pending){
+        conn->continue_pending = 0;
+        if(_http_exchange_add_iov(&conn->head, HTTP_CONTINUE, sizeof(HTTP_CONTINUE) - 1) != 0
+            || _http_conn_flush_wait(conn) != 0){
+            conn->head.keep_alive = 0;
+            return -1;
+        }
+    }
+
+    long n = conn->body_chunked ? _http_conn_read_chunked(conn, buf, len) : _http_conn_read_fixed(conn, buf, len);
+    if(n < 0){
+        // body 没有读完，连接不能再用
+        conn->head.keep_alive = 0;
+    }
+    return n;
+}
+
+/**
+ * @brief 读取请求 body，缓冲的 body 从读缓冲复制
+ */
+long http_request_read_body(HttpRequest *request, void *buf, size_t len){
+    HttpConnection *conn = request->conn;
+    if(conn->body_stream){
+        return _http_conn_read_body(conn, buf, len);
+    }
+
+    size_t n = request->body_len - request->body_pos;
+    if(n > len){
+        n = len;
+    }
+    if(n > 0){
+        memcpy(buf, request->body + request->body_pos, n);
+        request->body_pos += n;
+    }
+    return n;
+}
+
+/**
+ * @brief 丢弃 handler 没有读完的流式 body，使连接可以处理下一个请求
+ * @return 成功返回0, 剩余太多或读取失败返回-1, 此时应关闭连接
+ */
+static int _http_conn_drain_body(HttpConnection *conn){
+    // 客户端还在等待 100 Continue，不会发送 body
+    if(conn->continue_pending || (!conn->body_chunked && conn->body_left > MAX_DRAIN_SIZE)){
+        return -1;
+    }
+    char buf[4096];
+    long total = 0;
+    while (conn->body_stream)
+    {
+        long n = _http_conn_read_body(conn, buf, sizeof(buf));
+        if(n < 0 || (total += n) > MAX_DRAIN_SIZE){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 请求头读完后，按路由检查 body 长度并决定是否先读入 body
+ */
+static void _http_conn_check_body(HttpConnection *conn){
+    HttpParser *parser = &conn->parser;
+    long length = parser->content_length;
+    int chunked = parser->known[HTTP_HEADER_TRANSFER_ENCODING] >= 0;
+
+    // 不支持其他传输编码; 同时有 Content-Length 时(包括0)无法确定 body 的边界，
+    // 前面的代理可能按 Content-Length 把分块 body 当作下一个请求，返回 400 并关闭连接
+    if(chunked && (!parser->chunked || parser->known[HTTP_HEADER_CONTENT_LENGTH] >= 0)){
+        conn->reject = 400;
+        return;
+    }
+
+    // 这里只需要路由的配置，路径参数由工作线程匹配
+    HttpMethod method = http_method_parse(conn->rbuf + parser->method.off, parser->method.len);
+    HttpRoute *route = http_router_match(conn->shard->router, method, conn->rbuf + parser->path.off, parser->path.len, NULL);
+    long max_body = route ? route->max_body : MAX_BODY_SIZE;
+
+    if(length > max_body){
+        // 不读取 body，直接返回 413 并关闭连接
+        conn->reject = 413;
+        return;
+    }
+    if(chunked){
+        http_chunked_init(&conn->chunked, max_body);
+        conn->body_chunked = 1;
+    }
+    if(route != NULL && route->body_mode == HTTP_BODY_STREAM){
+        // 只需要请求头，body 由 handler 读取; 工作线程中不能扩大读缓冲，这里先留出读取分块头的空间
+        if(chunked && conn->rcap - conn->header_len < CHUNKED_READ_SPACE){
+            char *buf = realloc(conn->rbuf, conn->header_len + READ_BUFFER_SIZE);
+            if(buf == NULL){
+                conn->reject = 413;
+                return;
+            }
+            conn->rbuf = buf;
+            conn->rcap = conn->header_len + READ_BUFFER_SIZE;
+        }
+        conn->body_stream = 1;
+        conn->body_left = length;
+        conn->continue_pending = parser->expect_continue;
+        return;
+    }
+
+    conn->request_len += length;
+    if(parser->expect_continue && (chunked ? conn->rlen == conn->header_len : conn->rlen < conn->request_len)){
+        // 读取请求时没有待发送的返回，发送缓冲是空的
+        ssize_t n = send(conn->fd, HTTP_CONTINUE, sizeof(HTTP_CONTINUE) - 1, MSG_NOSIGNAL);
+        if(n < 0 && errno != EAGAIN && errno != EWOULDBLOCK){
+            conn->peer_closed = 1;
+        }
+    }
+}
+
+/**
+ * @brief 在读缓冲中原地解码分块 body，块数据依次前移拼接到请求头之后，
+ *        剩余未解析的数据(或下一个请求)移到已解码部分之后，读缓冲只需容纳解码后的 body
+ * @return body 解码完或非法返回1, 需要更多数据返回0
+ */
+static int _http_conn_decode_chunked(HttpConnection *conn){
+    HttpChunkedParser *chunked = &conn->chunked;
+    char *buf = conn->rbuf;
+    size_t out = conn->request_len, pos = conn->request_len;
+    int rs = HTTP_PARSE_AGAIN;
+
+    while (pos < conn->rlen)
+    {
+        if(chunked->remaining > 0){
+            size_t n = conn->rlen - pos;
+            if(n > chunked->remaining){
+                n = chunked->remaining;
+            }
+            if(out != pos){
+                memmove(buf + out, buf + pos, n);
+            }
+            out += n;
+            pos += n;
+            http_chunked_consume(chunked, n);
+            continue;
+        }
+
+        size_t consumed;
+        rs = http_chunked_execute(chunked, buf + pos, conn->rlen - pos, &consumed);
+        pos += consumed;
+        if(rs != HTTP_PARSE_AGAIN){
+            break;
+        }
+    }
+
+    if(pos > out){
+        memmove(buf + out, buf + pos, conn->rlen - pos);
+        conn->rlen -= pos - out;
+    }
+    conn->request_len = out;
+
+    if(rs == HTTP_PARSE_ERROR){
+        // 不再读取 body, 返回错误并关闭连接
+        conn->reject = chunked->too_large ? 413 : 400;
+        conn->request_len = conn->header_len;
+    }
+    if(rs != HTTP_PARSE_AGAIN){
+        conn->body_chunked = 0;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 检查读缓冲中是否已有完整请求，解析器从上次停下的位置继续，不会重复扫描
+ * @return 完整返回1, 需要更多数据返回0, 请求非法返回-1
+ */
+static int _http_conn_check_request(HttpConnection *conn){
+    if(conn->header_len == 0){
+        // body 的长度限制由路由决定，读完请求头后再检查
+        int rs = http_parser_execute(&conn->parser, conn->rbuf, conn->rlen, MAX_LINE_SIZE + MAX_HEADER_SIZE, LONG_MAX);
+        if(rs != HTTP_PARSE_DONE){
+            return rs;
+        }
+        conn->header_len = conn->parser.header_len;
+        conn->request_len = conn->header_len;
+        if(conn->parser.content_length > 0 || conn->parser.known[HTTP_HEADER_TRANSFER_ENCODING] >= 0){
+            _http_conn_check_body(conn);
+        }
+    }
+    if(conn->body_chunked && !conn->body_stream){
+        return _http_conn_decode_chunked(conn);
+    }
+    return conn->rlen >= conn->request_len;
+}
+
+/**
+ * @brief 扩大读缓冲，请求头读完后直接按完整请求的长度分配，分块 body 的长度未知，按两倍扩大
+ * @return 成功返回0, 超出限制或分配失败返回-1
+ */
+static int _http_conn_grow(HttpConnection *conn){
+    size_t cap;
+    if(conn->header_len == 0){
+        if(conn->rcap >= MAX_LINE_SIZE + MAX_HEADER_SIZE){
+            return -1;
+        }
+        cap = conn->rcap > 0 ? conn->rcap * 2 : READ_BUFFER_SIZE;
+    }else if(conn->body_chunked){
+        // 解码时已限制 body 的长度，读缓冲中只有解码后的 body
+        cap = conn->rcap * 2;
+    }else{
+        cap = conn->request_len;
+    }
+
+    char *buf = realloc(conn->rbuf, cap);
+    if(buf == NULL){
+        return -1;
+    }
+    conn->rbuf = buf;
+    conn->rcap = cap;
+    return 0;
+}
+
+static void *_http_exchange_process(void *arg);
+
+/**
+ * @brief 这个请求的返回发送后连接是否一定保持，是才能把它后面的请求一起处理，否则后面的请求执行了返回却被丢弃。
+ *        HTTP/1.0 的流式返回不能分块，发送后要关闭连接，所以只看 HTTP/1.1; 之后只有分配失败和连接出错会关闭连接
+ */
+static int _http_exchange_keeps_conn(HttpConnection *conn, HttpParser *parser, const char *base, int last){
+    if(conn->server->keepalive_timeout <= 0 || last || (parser->connection & HTTP_CONNECTION_CLOSE)){
+        return 0;
+    }
+    return parser->version.len == 8 && memcmp(base + parser->version.off, "HTTP/1.1", 8) == 0;
+}
+
+/**
+ * @brief 准备流水线中的第 i 个后续请求，第一次用到时分配
+ * @return 失败返回NULL
+ */
+static HttpExchange *_http_conn_batch_slot(HttpConnection *conn, int i){
+    if(conn->batch == NULL){
+        conn->batch = calloc(PIPELINE_MAX - 1, sizeof(HttpExchange));
+        conn->batch_parsers = malloc(sizeof(HttpParser) * (PIPELINE_MAX - 1));
+        if(conn->batch == NULL || conn->batch_parsers == NULL){
+            free(conn->batch);
+            free(conn->batch_parsers);
+            conn->batch = NULL;
+            conn->batch_parsers = NULL;
+            return NULL;
+        }
+    }
+    HttpExchange *ex = &conn->batch[i];
+    if(ex->arena == NULL && (ex->arena = arena_new(REQUEST_ARENA_SIZE)) == NULL){
+        return NULL;
+    }
+    ex->conn = conn;
+    ex->parser = &conn->batch_parsers[i];
+    return ex;
+}
+
+/**
+ * @brief 第一个请求之后已经完整读入的请求和它一起处理。只收集不需要事件循环特殊处理 body 的请求，
+ *        其余的(和不完整的)留在读缓冲中，等这一批返回后按原来的方式读取
+ */
+static void _http_conn_collect_batch(HttpConnection *conn){
+    HttpServer *svr = conn->server;
+    conn->batch_count = 0;
+    if(conn->reject || conn->body_stream || !_http_exchange_keeps_conn(conn, &conn->parser, conn->rbuf, conn->head.last)){
+        return;
+    }
+
+    size_t pos = conn->request_len;
+    while (conn->batch_count < PIPELINE_MAX - 1 && pos < conn->rlen)
+    {
+        HttpExchange *ex = _http_conn_batch_slot(conn, conn->batch_count);
+        if(ex == NULL){
+            return;
+        }
+        HttpParser *parser = ex->parser;
+        const char *base = conn->rbuf + pos;
+        http_parser_init(parser);
+        if(http_parser_execute(parser, base, conn->rlen - pos, MAX_LINE_SIZE + MAX_HEADER_SIZE, MAX_BODY_SIZE) != HTTP_PARSE_DONE
+            || parser->known[HTTP_HEADER_TRANSFER_ENCODING] >= 0 || parser->expect_continue){
+            return;
+        }
+        if(parser->content_length > 0){
+            HttpMethod method = http_method_parse(base + parser->method.off, parser->method.len);
+            HttpRoute *route = http_router_match(conn->shard->router, method, base + parser->path.off, parser->path.len, NULL);
+            if(route != NULL && (route->body_mode == HTTP_BODY_STREAM || parser->content_length > route->max_body)){
+                return;
+            }
+        }
+        size_t len = parser->header_len + parser->content_length;
+        if(conn->rlen - pos < len){
+            return;
+        }
+
+        ex->start = pos;
+        ex->header_len = parser->header_len;
+        ex->request_len = len;
+        conn->requests++;
+        ex->last = svr->keepalive_max_requests > 0 && conn->requests >= svr->keepalive_max_requests;
+        conn->batch_count++;
+        pos += len;
+        if(!_http_exchange_keeps_conn(conn, parser, base, ex->last)){
+            return;
+        }
+    }
+}
+
+/**
+ * @brief 读到完整请求后，连同流水线中已完整读入的后续请求一起交给线程池，各自独立处理
+ */
+static void _http_conn_dispatch(HttpConnection *conn){
+    HttpServer *svr = conn->server;
+    HttpExchange *head = &conn->head;
+    head->start = 0;
+    head->header_len = conn->header_len;
+    head->request_len = conn->request_len;
+    conn->requests++;
+    head->last = svr->keepalive_max_requests > 0 && conn->requests >= svr->keepalive_max_requests;
+    _http_conn_collect_batch(conn);
+
+    // 任务加入线程池后连接就由工作线程持有，最后完成的请求把连接交回事件循环，之后不能再访问
+    int count = conn->batch_count;
+    HttpExchange *batch = conn->batch;
+    _http_stat_add(&conn->shard->stat_requests, count + 1);
+    atomic_store(&conn->pending, count + 1);
+    conn->state = HTTP_CONN_PROCESSING;
+    if(svr->thread_pool == NULL){
+        // 每核独立模式直接在本线程处理，连接由最后一个请求投递回本事件循环，本轮事件处理完后发送
+        _http_exchange_process(head);
+        for(int i = 0; i < count; i++){
+            _http_exchange_process(&batch[i]);
+        }
+        return;
+    }
+    if(threadpool_add_task(svr->thread_pool, _http_exchange_process, head) != 0){
+        _http_conn_close(conn);
+        return;
+    }
+    for(int i = 0; i < count; i++){
+        if(threadpool_add_task(svr->thread_pool, _http_exchange_process, &batch[i]) != 0){
+            // 第一个请求已经在处理，不能关闭连接，队列满时直接在这里处理
+            _http_exchange_process(&batch[i]);
+        }
+    }
+}
+
+/**
+ * @brief 从套接字读取数据，读到完整请求后交给线程池处理
+ */
+static void _http_conn_read(HttpConnection *conn){
+    int rs;
+    while ((rs = _http_conn_check_request(conn)) == 0)
+    {
+        if(conn->rlen == conn->rcap && _http_conn_grow(conn) != 0){
+            rs = -1;
+            break;
+        }
+
+        if(conn->shard->uring != NULL){
+            // 数据在接收完成后复制进读缓冲，见 _http_uring_on_recv
+            if(_http_uring_recv(conn) != 0){
+                rs = -1;
+            }
+            break;
+        }
+
+        // 一次读满缓冲剩余空间，请求头和随之到达的 body 都留在缓冲里
+        ssize_t n = recv(conn->fd, conn->rbuf + conn->rlen, conn->rcap - conn->rlen, 0);
+        if(n > 0){
+            conn->rlen += n;
+            _http_conn_touch(conn);
+            continue;
+        }
+        if(n < 0 && errno == EINTR){
+            continue;
+        }
+        if(n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)){
+            conn->peer_closed = 1;
+        }
+        break;
+    }
+
+    if(rs > 0){
+        _http_conn_dispatch(conn);
+        return;
+    }
+
+    if(rs < 0 || conn->peer_closed){
+        _http_conn_close(conn);
+    }
+}
+
+/**
+ * @brief 丢弃已处理的请求，准备在同一连接上读取下一个请求
+ */
+static void _http_conn_reset(HttpConnection *conn){
+    // 这一批请求和返回的内存一次性回收，大请求用过的块不随空闲连接保留
+    size_t consumed = conn->request_len;
+    for(int i = -1; i < conn->batch_count; i++){
+        HttpExchange *ex = i < 0 ? &conn->head : &conn->batch[i];
+        ex->wiov = NULL;
+        ex->wiov_count = ex->wiov_cap = 0;
+        if(arena_capacity(ex->arena) > REQUEST_ARENA_SIZE){
+            arena_release(ex->arena);
+        }else{
+            arena_reset(ex->arena);
+        }
+        if(i >= 0){
+            consumed = ex->start + ex->request_len;
+        }
+    }
+    conn->batch_count = 0;
+    conn->wiov_sent = 0;
+
+    size_t left = conn->rlen - consumed;
+    if(left > 0){
+        memmove(conn->rbuf, conn->rbuf + consumed, left);
+    }else if(conn->rcap > READ_BUFFER_SIZE){
+        // 大请求用过的缓冲不随空闲连接保留
+        free(conn->rbuf);
+        conn->rbuf = NULL;
+        conn->rcap = 0;
+    }
+    conn->rlen = left;
+    http_parser_init(&conn->parser);
+    conn->header_len = 0;
+    conn->request_len = 0;
+    conn->reject = 0;
+    conn->continue_pending = 0;
+    conn->body_stream = 0;
+    conn->body_chunked = 0;
+    conn->body_left = 0;
+    conn->state = HTTP_CONN_READING;
+}
+
+/**
+ * @brief 发送剩余返回数据，发送完毕后继续读取下一个请求或关闭连接
+ */
+static void _http_conn_write(HttpConnection *conn){
+    int rs;
+    if(conn->shard->uring != NULL){
+        rs = _http_uring_send(conn);
+    }else{
+        // 客户端接收慢时只要发送有进展就不算空闲，否则大的返回会被空闲检查中途关闭; io_uring 方式在发送完成时刷新
+        HttpExchange *head = &conn->head;
+        int sent = conn->wiov_sent;
+        size_t left = sent < head->wiov_count ? head->wiov[sent].iov_len : 0;
+        rs = _http_conn_flush(conn);
+        if(conn->wiov_sent != sent || (sent < head->wiov_count && head->wiov[sent].iov_len != left)){
+            _http_conn_touch(conn);
+        }
+    }
+    if(rs == 0 && !conn->peer_closed){
+        return; // 等待可写事件或发送完成
+    }
+    if(rs == 1){
+        // 数据已经全部在内核中
+        _http_conn_release(conn);
+    }
+
+    if(rs == 1 && conn->keep_alive && !conn->peer_closed){
+        _http_conn_reset(conn);
+        // 边缘触发，处理期间到达的数据不会再产生事件，这里主动读取
+        _http_conn_read(conn);
+        return;
+    }
+    _http_conn_close(conn);
+}
+
+/**
+ * @brief 工作线程处理完毕，回到事件循环线程
+ */
+static void _http_conn_on_processed(void *arg){
+    HttpConnection *conn = (HttpConnection *)arg;
+    conn->state = HTTP_CONN_WRITING;
+    _http_conn_touch(conn);
+    _http_conn_write(conn);
+}
+
+static void _http_worker_publish(HttpServer *server);
+
+/**
+ * @brief 关闭空闲超时的连接，由事件循环周期调用; 工作进程同时报告统计
+ */
+static void _http_server_sweep(void *arg){
+    HttpShard *shard = (HttpShard *)arg;
+    HttpServer *svr = shard->server;
+    long long now = event_loop_now(shard->loop);
+    long long timeout = svr->keepalive_timeout > 0 ? svr->keepalive_timeout : KEEPALIVE_TIMEOUT;
+
+    if(svr->worker_index >= 0){
+        _http_worker_publish(svr);
+    }
+    if(shard->accept_paused && _http_uring_accept(shard) == 0){
+        shard->accept_paused = 0;
+    }
+
+    HttpConnection *conn = shard->conn_head;
+    while (conn && now - conn->last_active >= timeout)
+    {
+        HttpConnection *next = conn->next;
+        // 处理中的连接由工作线程持有，不能关闭
+        if(conn->state != HTTP_CONN_PROCESSING){
+            _http_conn_close(conn);
+        }
+        conn = next;
+    }
+}
+
+/**
+ * @brief 连接就绪事件
+ */
+static void _http_conn_on_event(EventLoop *loop, int fd, int events, void *arg){
+    HttpConnection *conn = (HttpConnection *)arg;
+    if(events & EVENT_ERROR){
+        conn->peer_closed = 1;
+    }
+
+    switch (conn->state)
+    {
+        case HTTP_CONN_READING:
+            if(events & (EVENT_READABLE | EVENT_ERROR)){
+                _http_conn_read(conn);
+            }
+            break;
+
+        case HTTP_CONN_WRITING:
+            _http_conn_write(conn);
+            break;
+
+        default:
+            // 处理中的连接由工作线程持有，完成后会回到事件循环
+            break;
+    }
+}
+
+/**
+ * @brief 同一批请求都处理完后，按请求顺序把后续请求的返回接到第一个请求之后，一次系统调用发送
+ */
+static void _http_conn_finish_batch(HttpConnection *conn){
+    HttpExchange *head = &conn->head;
+    conn->keep_alive = head->keep_alive;
+    for(int i = 0; i < conn->batch_count && conn->keep_alive; i++){
+        HttpExchange *ex = &conn->batch[i];
+        for(int k = 0; k < ex->wiov_count; k++){
+            if(_http_exchange_add_iov(head, ex->wiov[k].iov_base, ex->wiov[k].iov_len) != 0){
+                // 返回不完整，后面的都不能发送
+                head->wiov_count -= k;
+                conn->keep_alive = 0;
+                break;
+            }
+        }
+        conn->keep_alive = conn->keep_alive && ex->keep_alive;
+    }
+
+    // 连接此时仍由本线程持有，先尝试直接发送，剩余部分交给事件循环; io_uring 方式全部由事件循环提交
+    if(conn->shard->uring == NULL && _http_conn_flush(conn) == 1){
+        _http_conn_release(conn);
+    }
+    if(event_loop_post(conn->shard->loop, _http_conn_on_processed, conn) != 0){
+        conn->peer_closed = 1;
+    }
+}
+
+/**
+ * @brief 处理一个客户端请求，在工作线程中执行，同一批的请求可能同时在不同线程处理
+ */
+static void *_http_exchange_process(void *arg) {
+    HttpExchange *ex = (HttpExchange *)arg;
+    HttpConnection *conn = ex->conn;
+    HttpServer *svr = conn->server;
+
+    // // 默认状态 200
+    HttpResponse response;
+    http_response_init(&response, ex);
+
+    HttpRequest request;
+    if(http_request_init(&request, ex) != 0){
+        ex->keep_alive = 0;
+        response.status = 400;
+        response_to_client(ex, &request, &response);
+    }else if(ex == &conn->head && conn->reject != 0){
+        ex->keep_alive = 0;
+        response.status = conn->reject;
+        response_to_client(ex, &request, &response);
+    }else{
+        response.chunked = _http_request_is_http11(&request);
+        ex->keep_alive = svr->keepalive_timeout > 0 && _http_request_keep_alive(&request) && !ex->last;
+
+        HttpMethod method = http_method_parse(request.method.data, request.method.len);
+        HttpRoute *route = http_router_match(conn->shard->router, method,
+            request.path.data, request.path.len, &request.params);
+        if(route != NULL){
+            route->handle(&request, &response);
+            if(ex == &conn->head && conn->body_stream && ex->keep_alive && _http_conn_drain_body(conn) != 0){
+                ex->keep_alive = 0;
+            }
+            response_to_client(ex, &request, &response);
+        }else{
+            response.status = 404;
+            response_to_client(ex, &request, &response);
+        }
+    }
+    http_request_destroy(&request);
+    http_response_destroy(&response);
+
+    // 最后完成的请求负责发送整批返回，其他请求的返回可能还没有生成
+    if(atomic_fetch_sub_explicit(&conn->pending, 1, memory_order_acq_rel) == 1){
+        _http_conn_finish_batch(conn);
+    }
+    return NULL;
+}
+
+/**
+ * @brief 监听套接字可读，接受所有等待中的连接
+ */
+static void _http_server_on_accept(EventLoop *loop, int fd, int events, void *arg){
+    HttpShard *shard = (HttpShard *)arg;
+
+    for(;;){
+        int client_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC); // 接受连接请求
+        if(client_fd < 0){
+            if(errno == EINTR) continue;
+            break; // EAGAIN 表示已全部接受
+        }
+
+        HttpConnection *conn = _http_conn_new(shard, client_fd);
+        if(conn == NULL){
+            close(client_fd);
+            continue;
+        }
+
+        if(event_loop_add(loop, client_fd, EVENT_READABLE | EVENT_WRITABLE, _http_conn_on_event, conn) != 0){
+            _http_conn_free(conn);
+            close(client_fd);
+            continue;
+        }
+        _http_stat_add(&shard->stat_accepted, 1);
+        _http_conn_touch(conn);
+
+        // 边缘触发，注册前到达的数据不会再产生事件
+        _http_conn_read(conn);
+    }
+}
+
+/**
+ * @brief 读缓冲至少还能放下 n 字节
+ * @return 成功返回0,分配失败返回-1
+ */
+static int _http_conn_reserve(HttpConnection *conn, size_t n){
+    if(conn->rcap - conn->rlen >= n){
+        return 0;
+    }
+    size_t cap = conn->rcap > 0 ? conn->rcap : READ_BUFFER_SIZE;
+    while (cap - conn->rlen < n)
+    {
+        cap *= 2;
+    }
+    char *buf = realloc(conn->rbuf, cap);
+    if(buf == NULL){
+        return -1;
+    }
+    conn->rbuf = buf;
+    conn->rcap = cap;
+    return 0;
+}
+
+/**
+ * @brief 接收完成，把数据复制进读缓冲后立即归还缓冲，再继续解析
+ */
+static void _http_uring_on_recv(HttpConnection *conn, int res, unsigned flags){
+    Uring *ring = conn->shard->uring;
+    conn->uring_op = 0;
+    if(flags & IORING_CQE_F_BUFFER){
+        unsigned bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        if(res > 0 && conn->state != HTTP_CONN_CLOSED){
+            if(_http_conn_reserve(conn, res) == 0){
+                memcpy(conn->rbuf + conn->rlen, uring_buffer(ring, bid), res);
+                conn->rlen += res;
+            }else{
+                res = -ENOMEM;
+            }
+        }
+        uring_recycle_buffer(ring, bid);
+    }
+
+    if(conn->state == HTTP_CONN_CLOSED){
+        _http_conn_free(conn);
+        return;
+    }
+    if(res > 0){
+        _http_conn_touch(conn);
+        _http_conn_read(conn);
+        return;
+    }
+    if(res == -ENOBUFS){
+        // 缓冲都在使用中，重新提交
+        _http_conn_read(conn);
+        return;
+    }
+    conn->peer_closed = 1;
+    _http_conn_close(conn);
+}
+
+/**
+ * @brief 发送完成，还有剩余数据时继续发送，全部发送完后读取下一个请求或关闭连接
+ */
+static void _http_uring_on_send(HttpConnection *conn, int res){
+    conn->uring_op = 0;
+    if(conn->state == HTTP_CONN_CLOSED){
+        _http_conn_free(conn);
+        return;
+    }
+    // 没有空的段，发送了0字节和出错一样; 只发送了一部分时 _http_conn_write 提交剩余的，全部完成后才关闭
+    if(res <= 0 || (size_t)res > conn->wmsg_len){
+        conn->peer_closed = 1;
+        _http_conn_close(conn);
+        return;
+    }
+    _http_conn_touch(conn);
+    _http_conn_advance(conn, res);
+    _http_conn_write(conn);
+}
+
+/**
+ * @brief 接受了一个连接，多次接受结束时重新提交
+ */
+static void _http_uring_on_accept(HttpShard *shard, int res, unsigned flags){
+    if(res >= 0){
+        HttpConnection *conn = _http_conn_new(shard, res);
+        if(conn == NULL){
+            close(res);
+        }else{
+            _http_stat_add(&shard->stat_accepted, 1);
+            _http_conn_touch(conn);
+            _http_conn_read(conn);
+        }
+    }
+    if(!(flags & IORING_CQE_F_MORE)){
+        // 文件描述符用完时立即重新提交也只会失败，由周期任务恢复
+        if(res == -EMFILE || res == -ENFILE || _http_uring_accept(shard) != 0){
+            shard->accept_paused = 1;
+        }
+    }
+}
+
+/**
+ * @brief 处理所有完成事件
+ * @return 处理的数量
+ */
+static int _http_shard_drain(HttpShard *shard){
+    struct io_uring_cqe *cqe;
+    int count = 0;
+    while ((cqe = uring_peek_cqe(shard->uring)) != NULL)
+    {
+        // 处理中可能提交新操作，先取出结果归还完成项
+        unsigned long long data = cqe->user_data;
+        int res = cqe->res;
+        unsigned flags = cqe->flags;
+        uring_cqe_seen(shard->uring);
+        count++;
+
+        void *ptr = (void *)(uintptr_t)(data & ~URING_OP_MASK);
+        switch (data & URING_OP_MASK)
+        {
+            case URING_OP_ACCEPT:
+                _http_uring_on_accept(ptr, res, flags);
+                break;
+            case URING_OP_RECV:
+                _http_uring_on_recv(ptr, res, flags);
+                break;
+            case URING_OP_SEND:
+                _http_uring_on_send(ptr, res);
+                break;
+            case URING_OP_CLOSE:
+                shard->uring_slots[shard->uring_free++] = (int)(data >> URING_OP_BITS);
+                break;
+            default:
+                break;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief io_uring 有完成事件
+ */
+static void _http_shard_on_uring(EventLoop *loop, int fd, int events, void *arg){
+    _http_shard_drain((HttpShard *)arg);
+}
+
+/**
+ * @brief 事件循环每轮等待前一次提交本轮产生的所有操作; 提交时已完成的操作立即处理，新产生的操作一起再提交
+ */
+static void _http_shard_submit(void *arg){
+    HttpShard *shard = (HttpShard *)arg;
+    do{
+        uring_submit(shard->uring);
+    }while (_http_shard_drain(shard) > 0);
 }
 
 /**
- * @brief 处理客户端
+ * @brief 为事件循环创建 io_uring，完成事件通过 io_uring 的文件描述符通知事件循环
+ * @return 成功返回0, 内核不支持时返回-1
  */
-static void *run_client_handle(void *arg) {
-    handle_struct *hs = (handle_struct *)arg;
-    int client_fd = hs->client_fd;
-
-    HttpRequest request;
-    http_request_init(&request,client_fd);
-    
-    char *routeTmp = "%s %s";
-    int l = snprintf(NULL, 0, routeTmp, request.method, request.path);
-    char route[l+1];
-    sprintf(route, routeTmp, request.method, request.path);
-
-    void *m_val = map_get(&hs->svr->routes, route);
-    // // 默认状态 200
-    HttpResponse response;
-    http_response_init(&response);
-
-    if(m_val != NULL ){
-        HttpHandler handle = *(HttpHandler*)m_val;
-        handle(&request, &response);
-        response_to_client(client_fd, &request, &response);
-    }else{
-        response.status = 404;
-        response_to_client(client_fd, &request, &response);
+static int _http_shard_init_uring(HttpShard *shard){
+    static const int ops[] = {
+        IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG,
+        IORING_OP_CLOSE, IORING_OP_FILES_UPDATE, IORING_OP_ASYNC_CANCEL,
+    };
+    Uring *ring = uring_new(URING_ENTRIES, URING_CQ_ENTRIES);
+    if(ring == NULL){
+        return -1;
     }
-    http_request_destroy(&request);
-    http_response_destroy(&response);
 
-    close(client_fd); // 处理完毕后关闭客户端连接
-    return NULL;
-}
+    // 固定文件表的大小不能超过文件描述符上限
+    unsigned files = MAX_CONNECTIONS;
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < files){
+        files = (unsigned)limit.rlim_cur;
+    }
 
-/**
- * @brief 
- */
-static void client_handle_done(void *arg){
-    handle_struct *s = (handle_struct *)arg;
-    s->client_fd =0;
-    s->svr = NULL;
-    free(s);
-    s = NULL;
+    shard->uring = ring;
+    shard->uring_slots = malloc(files * sizeof(int));
+    if(shard->uring_slots == NULL
+        || !uring_supports(ring, ops, sizeof(ops) / sizeof(ops[0]))
+        || uring_register_files(ring, files) != 0
+        || uring_setup_buffers(ring, URING_BUF_GROUP, URING_BUF_COUNT, READ_BUFFER_SIZE) != 0
+        || _http_uring_accept(shard) != 0
+        || event_loop_add(shard->loop, uring_fd(ring), EVENT_READABLE, _http_shard_on_uring, shard) != 0){
+        free(shard->uring_slots);
+        shard->uring_slots = NULL;
+        uring_destroy(ring);
+        shard->uring = NULL;
+        return -1;
+    }
+    for(unsigned i = 0; i < files; i++){
+        shard->uring_slots[i] = files - 1 - i;
+    }
+    shard->uring_free = files;
+    event_loop_set_prepare(shard->loop, _http_shard_submit, shard);
+    return 0;
 }
 
 /**
@@ -580,7 +2451,16 @@ static void client_handle_done(void *arg){
  */
 HttpServer *http_server_new(){
     HttpServer *svr = malloc(sizeof(HttpServer));
-    map_init(&svr->routes);
+    memset(svr, 0, sizeof(HttpServer));
+    svr->keepalive_max_requests = KEEPALIVE_MAX_REQUESTS;
+    svr->keepalive_timeout = KEEPALIVE_TIMEOUT;
+    svr->worker_index = -1;
+    svr->listen_fd = -1;
+    svr->router = http_router_new();
+    if(svr->router == NULL){
+        free(svr);
+        return NULL;
+    }
     return svr;
 }
 
@@ -606,12 +2486,34 @@ int http_server_init(HttpServer *server, char *host, int port) {
 }
 
 /**
- * @brief 启动HTTP服务器
- * @return 成功返回0,失败返回非0值
+ * @brief 设置监听方式，需在 http_server_start 前调用
+ * @param loops 事件循环的数量, <=0 使用在线的 CPU 数
  */
-int http_server_start(HttpServer *server){
+void http_server_set_listeners(HttpServer *server, HttpListenMode mode, int loops){
+    server->listen_mode = mode;
+    server->shard_count = loops;
+}
+
+/**
+ * @brief 设置收发数据的方式，需在 http_server_start 前调用
+ */
+void http_server_set_io_engine(HttpServer *server, HttpIoEngine engine){
+    server->io_engine = engine;
+}
+
+/**
+ * @brief 打开一个监听套接字
+ * @param reuseport 多个事件循环各自监听同一端口
+ * @param cpu 优先接收这个 CPU 上到达的连接, -1 不设置
+ * @return 成功返回套接字, 失败返回-1
+ */
+static int _http_server_listen(HttpServer *server, int reuseport, int cpu){
 // 打开套接字
-    int socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int socket_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(socket_fd < 0){
+        printf("创建socket失败: 原因:%s",strerror(errno));
+        return -1;
+    }
 
     // 初始化服务
     struct sockaddr_in server_addr = {
@@ -621,79 +2523,695 @@ int http_server_start(HttpServer *server){
     };
 
     int yes = 1;
-    int rs = setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
-    if (rs < 0) {
+    if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) < 0
+        || (reuseport && setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) < 0)) {
         printf("设置socket失败: 原因:%s",strerror(errno));
-        return rs;
+        close(socket_fd);
+        return -1;
+    }
+    // 6.1 以后的内核在同一组 SO_REUSEPORT 套接字中优先选择 CPU 相同的，只是优化，旧内核不支持时忽略
+    if(cpu >= 0){
+        setsockopt(socket_fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
     }
 
     // 绑定 socket 到本地地址和端口，此时还未监听
-    rs = bind(socket_fd, (struct sockaddr *)&server_addr, sizeof(server_addr));
-    if(rs < 0){
+    if(bind(socket_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0){
         printf("绑定失败: 原因:%s",strerror(errno));
-        return rs;
+        close(socket_fd);
+        return -1;
     }
 
     // 开始监听连接，最大连接等待队列长度为 1000
-    rs = listen(socket_fd, 1000); // 监听队列长度为1000
-    if(rs < 0){
+    if(listen(socket_fd, 1000) < 0){ // 监听队列长度为1000
         printf("监听失败: 原因:%s",strerror(errno));
-        return rs;
+        close(socket_fd);
+        return -1;
+    }
+    return socket_fd;
+}
+
+/**
+ * @brief 本进程可以使用的 CPU，即在线且在 CPU 亲和性中的，按编号从小到大
+ * @return CPU 的数量，至少为1
+ */
+static int _http_server_cpus(int *cpus, int max){
+    int count = 0;
+    cpu_set_t set;
+    if(sched_getaffinity(0, sizeof(set), &set) == 0){
+        for(int c = 0; c < CPU_SETSIZE && count < max; c++){
+            if(CPU_ISSET(c, &set)){
+                cpus[count++] = c;
+            }
+        }
+    }
+    if(count == 0){
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        for(; count < online && count < max; count++){
+            cpus[count] = count;
+        }
+    }
+    if(count == 0){
+        cpus[count++] = 0;
     }
+    return count;
+}
 
-    server->thread_pool = threadpool_new(10, 2, client_handle_done); // 创建线程池，10个线程，最大任务数1000
-    if (server->thread_pool == NULL) {
-        close(socket_fd); // 线程池创建失败，关闭套接字
+/**
+ * @brief 给同一组 SO_REUSEPORT 套接字加载 cBPF 程序，按收到连接的 CPU 选择套接字:
+ *        CPU cpus[i] 上到达的连接交给第 i 个开始监听的套接字，它的事件循环绑定在 cpus[i] 上;
+ *        本进程不能使用的 CPU 上到达的连接交给第 c % count 个
+ * @return 成功返回0,失败返回-1
+ */
+static int _http_server_attach_cpu_filter(int socket_fd, const int *cpus, int count){
+    // CPU 编号正好是 0..count-1 时直接取模，否则逐个比较
+    int identity = 1;
+    for(int i = 0; i < count && identity; i++){
+        identity = cpus[i] == i;
+    }
+    int len = identity ? 3 : count * 2 + 3;
+    if(len > BPF_MAXINSNS){
+        errno = E2BIG;
+        return -1;
+    }
+    struct sock_filter *code = malloc(sizeof(struct sock_filter) * len);
+    if(code == NULL){
         return -1;
     }
 
-    while (1)
-    {
-        int clinet_fd = accept(socket_fd, NULL, NULL); // 接受连接请求
-        if(clinet_fd > 0){
-            handle_struct *handle_arg = malloc(sizeof(handle_struct));
-            handle_arg->client_fd = clinet_fd;
-            handle_arg->svr = server;
-            int rs = threadpool_add_task(server->thread_pool, run_client_handle, handle_arg);
-            if(rs != 0){
-                // printf("无法加入进程,原因:%s\n",threadpool_error(rs));
-                client_handle_done(handle_arg);
-                close(clinet_fd);
+    int n = 0;
+    code[n++] = (struct sock_filter){ BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU };   // A = 当前 CPU
+    for(int i = 0; i < count && !identity; i++){
+        code[n++] = (struct sock_filter){ BPF_JMP | BPF_JEQ | BPF_K, 0, 1, (unsigned int)cpus[i] }; // A == cpus[i]
+        code[n++] = (struct sock_filter){ BPF_RET | BPF_K, 0, 0, (unsigned int)i };                 // 返回 i
+    }
+    code[n++] = (struct sock_filter){ BPF_ALU | BPF_MOD | BPF_K, 0, 0, (unsigned int)count };      // A %= count
+    code[n++] = (struct sock_filter){ BPF_RET | BPF_A, 0, 0, 0 };                                   // 返回套接字下标
+
+    struct sock_fprog prog = {
+        .len = n,
+        .filter = code,
+    };
+    int rs = setsockopt(socket_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+    free(code);
+    return rs;
+}
+
+/**
+ * @brief 关闭所有监听套接字并销毁事件循环，事件循环都已停止
+ */
+static void _http_server_free_shards(HttpServer *server){
+    HttpShard *shards = server->shards;
+    int count = server->shard_count;
+    if(shards == NULL){
+        return;
+    }
+    server->shards = NULL;
+    for(int i = 0; i < count; i++){
+        if(shards[i].socket_fd >= 0){
+            close(shards[i].socket_fd);
+        }
+        if(shards[i].loop != NULL){
+            event_loop_destroy(shards[i].loop);
+        }
+        uring_destroy(shards[i].uring);
+        free(shards[i].uring_slots);
+        if(shards[i].router != server->router){
+            http_router_destroy(shards[i].router);
+        }
+    }
+    free(shards);
+}
+
+/**
+ * @brief 创建事件循环并注册监听套接字和周期任务
+ * @return 成功返回0,失败返回-1
+ */
+static int _http_shard_init(HttpShard *shard, HttpServer *server, int reuseport, int cpu){
+    shard->server = server;
+    shard->cpu = cpu;
+    shard->router = server->router;
+    shard->socket_fd = server->listen_fd >= 0 ? server->listen_fd : _http_server_listen(server, reuseport, cpu);
+    if(shard->socket_fd < 0){
+        return -1;
+    }
+
+    shard->loop = event_loop_new(MAX_CONNECTIONS);
+    if(shard->loop == NULL){
+        return -1;
+    }
+
+    if(server->io_engine == HTTP_IO_URING && _http_shard_init_uring(shard) != 0){
+        printf("io_uring不可用，使用epoll: 原因:%s",strerror(errno));
+    }
+
+    // 由事件循环负责接受连接和读写，线程池只执行已完整读取的请求
+    if(shard->uring == NULL
+        && event_loop_add(shard->loop, shard->socket_fd, EVENT_READABLE, _http_server_on_accept, shard) < 0){
+        printf("注册监听失败: 原因:%s",strerror(errno));
+        return -1;
+    }
+
+    event_loop_set_tick(shard->loop, CONN_SWEEP_INTERVAL, _http_server_sweep, shard);
+    return 0;
+}
+
+/**
+ * @brief 每核独立模式下在事件循环线程中按添加顺序重新建立路由表，内存分配在本核附近;
+ *        失败时继续使用服务器的路由表
+ */
+static void _http_shard_own_router(HttpShard *shard){
+    HttpServer *server = shard->server;
+    if(server->listen_mode != HTTP_LISTEN_PER_CORE){
+        return;
+    }
+    HttpRouter *router = http_router_new();
+    if(router == NULL){
+        return;
+    }
+    for(HttpRoute *route = server->routes; route != NULL; route = route->next){
+        if(http_router_add(router, route->method, route->path, route) != 0){
+            http_router_destroy(router);
+            return;
+        }
+    }
+    http_router_freeze(router);
+    shard->router = router;
+}
+
+/**
+ * @brief 事件循环线程，绑定 CPU 后运行事件循环
+ */
+static void *_http_shard_run(void *arg){
+    HttpShard *shard = (HttpShard *)arg;
+    if(shard->cpu >= 0){
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(shard->cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    _http_shard_own_router(shard);
+    if(event_loop_run(shard->loop) != 0){
+        // 一个事件循环出错时停止整个服务
+        http_server_stop(shard->server);
+    }
+    return NULL;
+}
+
+/**
+ * @brief 在本进程中运行事件循环，直到 http_server_stop
+ * @return 成功返回0,失败返回非0值
+ */
+static int _http_server_run(HttpServer *server){
+    int count = 1;
+    // 工作进程只使用继承的监听套接字
+    int reuseport = server->listen_mode != HTTP_LISTEN_SINGLE && server->listen_fd < 0;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if(cpus <= 0){
+        cpus = 1;
+    }
+    // 按 CPU 分配时每个可用的 CPU 一个事件循环，绑定的 CPU 和 cBPF 程序选择的一致，设置的数量不使用
+    int per_core = server->listen_mode == HTTP_LISTEN_PER_CORE;
+    int steer = reuseport && (server->listen_mode == HTTP_LISTEN_REUSEPORT_CPU || per_core);
+    int cpu_ids[CPU_SETSIZE];
+    int cpu_count = steer ? _http_server_cpus(cpu_ids, CPU_SETSIZE) : 0;
+    if(steer){
+        count = cpu_count;
+    }else if(reuseport){
+        count = server->shard_count > 0 ? server->shard_count : (int)cpus;
+    }
+
+    // 路由此后不再变化，编译为只读表供工作线程无锁共享，失败时仍可用路由树
+    http_router_freeze(server->router);
+    // 请求头扫描的实现在第一次使用时选择，多个事件循环会同时解析，启动前先选好
+    http_scan_level();
+
+    // 每核独立模式不使用线程池，请求在接受它的事件循环线程处理
+    if(!per_core){
+        server->thread_pool = threadpool_new(10, 1024, NULL); // 创建线程池，10个线程，最大任务数1024
+        if (server->thread_pool == NULL) {
+            return -1;
+        }
+    }
+
+    HttpShard *shards = aligned_alloc(CACHE_LINE_SIZE, count * sizeof(HttpShard));
+    if(shards == NULL){
+        threadpool_destroy(server->thread_pool);
+        server->thread_pool = NULL;
+        return -1;
+    }
+    memset(shards, 0, count * sizeof(HttpShard));
+    for(int i = 0; i < count; i++){
+        shards[i].socket_fd = -1;
+    }
+    server->shard_count = count;
+    server->shards = shards;
+
+    // 按顺序开始监听，第 i 个套接字在 SO_REUSEPORT 组中的下标也是 i
+    int rs = 0;
+    // 工作进程共用一个监听套接字，不绑定 CPU
+    for(int i = 0; i < count && rs == 0; i++){
+        rs = _http_shard_init(&shards[i], server, reuseport, steer ? cpu_ids[i] : -1);
+    }
+    if(rs == 0 && steer
+        && _http_server_attach_cpu_filter(shards[0].socket_fd, cpu_ids, count) != 0){
+        // 不支持时仍按哈希分配，只是连接可能在其他核上处理
+        printf("加载CPU分配程序失败: 原因:%s\n",strerror(errno));
+    }
+    if(rs == 0 && atomic_load(&server->stop_requested)){
+        // 事件循环创建完之前就被停止，http_server_stop 可能没有看到它们
+        http_server_stop(server);
+    }
+
+    if(rs == 0 && count == 1){
+        _http_shard_own_router(&shards[0]);
+        rs = event_loop_run(shards[0].loop);
+    }else if(rs == 0){
+        int started = 0;
+        for(; started < count; started++){
+            if(pthread_create(&shards[started].thread, NULL, _http_shard_run, &shards[started]) != 0){
+                http_server_stop(server);
+                rs = -1;
+                break;
             }
-            handle_arg = NULL;
+        }
+        for(int i = 0; i < started; i++){
+            pthread_join(shards[i].thread, NULL);
         }
     }
 
     threadpool_destroy(server->thread_pool);
+    server->thread_pool = NULL;
+    atomic_store(&server->stop_requested, 0);
+    return rs;
+}
+
+// ====================================================================
+// ============================ PREFORK ===============================
+// ====================================================================
+
+static HttpServer *worker_server;   // 工作进程中由信号处理函数停止的服务
+
+/**
+ * @brief 单调时钟，毫秒
+ */
+static long long _http_clock_ms(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief 本进程的常驻内存，字节
+ * @return 读取失败返回0
+ */
+static long long _http_process_rss(){
+    char buf[128];
+    int fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        return 0;
+    }
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if(n <= 0){
+        return 0;
+    }
+    buf[n] = '\0';
+    long long pages;
+    if(sscanf(buf, "%*s %lld", &pages) != 1){
+        return 0;
+    }
+    return pages * sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * @brief 工作进程把统计写入共享内存
+ */
+static void _http_worker_publish(HttpServer *server){
+    HttpWorkerSlot *slot = &server->worker_slots[server->worker_index];
+    HttpServerStats stats;
+    http_server_stats(server, &stats);
+    atomic_store_explicit(&slot->rss, _http_process_rss(), memory_order_relaxed);
+    atomic_store_explicit(&slot->accepted, stats.accepted, memory_order_relaxed);
+    atomic_store_explicit(&slot->active, stats.active, memory_order_relaxed);
+    atomic_store_explicit(&slot->requests, stats.requests, memory_order_relaxed);
+}
+
+static void _http_worker_on_signal(int sig){
+    int saved = errno;
+    http_server_stop(worker_server);
+    errno = saved;
+}
+
+/**
+ * @brief 工作进程: 设置停止信号的处理函数、恢复原来的屏蔽字后运行事件循环，不返回
+ */
+static void _http_worker_main(HttpServer *server, int index, const sigset_t *mask){
+    server->worker_index = index;
+    atomic_store(&server->master_running, 0);
+
+    // 主进程被强制结束时工作进程也退出; 设置之前主进程可能已经退出
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if(getppid() != server->master_pid){
+        exit(1);
+    }
+
+    worker_server = server;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = _http_worker_on_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGQUIT, &sa, NULL);
+    pthread_sigmask(SIG_SETMASK, mask, NULL);
+
+    exit(_http_server_run(server) == 0 ? 0 : 1);
+}
+
+/**
+ * @brief 启动一个工作进程，统计从0开始
+ * @return 成功返回0, 失败返回-1 并安排稍后重试
+ */
+static int _http_worker_spawn(HttpServer *server, int index, const sigset_t *mask){
+    HttpWorkerSlot *slot = &server->worker_slots[index];
+    atomic_store(&slot->rss, 0);
+    atomic_store(&slot->accepted, 0);
+    atomic_store(&slot->active, 0);
+    atomic_store(&slot->requests, 0);
+    slot->restart_at = 0;
+
+    // 缓冲中还没输出的内容不能在工作进程中再输出一次
+    fflush(NULL);
+    pid_t pid = fork();
+    if(pid < 0){
+        printf("创建工作进程失败: 原因:%s",strerror(errno));
+        slot->restart_at = _http_clock_ms() + WORKER_RESTART_DELAY;
+        return -1;
+    }
+    if(pid == 0){
+        _http_worker_main(server, index, mask);
+    }
+    atomic_store(&slot->pid, pid);
+    slot->started = _http_clock_ms();
+    return 0;
+}
+
+/**
+ * @brief 给所有工作进程发送信号
+ */
+static void _http_master_signal(HttpServer *server, int sig){
+    for(int i = 0; i < server->workers; i++){
+        int pid = atomic_load(&server->worker_slots[i].pid);
+        if(pid > 0){
+            kill(pid, sig);
+        }
+    }
+}
+
+/**
+ * @brief 回收已退出的工作进程，不在停止中时安排重新启动。只等待自己的工作进程，不影响程序的其他子进程
+ */
+static void _http_master_reap(HttpServer *server, int stopping){
+    for(int i = 0; i < server->workers; i++){
+        HttpWorkerSlot *slot = &server->worker_slots[i];
+        int pid = atomic_load(&slot->pid);
+        int status;
+        if(pid <= 0 || waitpid(pid, &status, WNOHANG) != pid){
+            continue;
+        }
+        atomic_store(&slot->pid, 0);
+        if(stopping){
+            continue;
+        }
+
+        if(WIFSIGNALED(status)){
+            printf("工作进程%d异常退出: 原因:%s",pid,strsignal(WTERMSIG(status)));
+        }else{
+            printf("工作进程%d异常退出: 原因:退出码%d",pid,WEXITSTATUS(status));
+        }
+        atomic_fetch_add(&slot->restarts, 1);
+        // 启动后很快就退出的推迟重新启动，避免不停地 fork
+        long long now = _http_clock_ms();
+        long long at = slot->started + WORKER_RESTART_DELAY;
+        slot->restart_at = at > now ? at : now;
+    }
+}
+
+/**
+ * @brief 主进程: 打开一次监听套接字，启动工作进程，然后在本线程同步等待信号直到停止
+ * @return 成功返回0,失败返回非0值
+ */
+static int _http_server_master(HttpServer *server){
+    static const int signals[] = { SIGCHLD, SIGINT, SIGTERM, SIGQUIT, SIGHUP, SIGUSR1, SIGUSR2 };
+    int count = server->workers;
+
+    server->listen_fd = _http_server_listen(server, 0, -1);
+    if(server->listen_fd < 0){
+        return -1;
+    }
+    // 工作进程继承编译好的路由表和选好的扫描实现
+    http_router_freeze(server->router);
+    http_scan_level();
+
+    if(server->worker_slots == NULL){
+        HttpWorkerSlot *slots = mmap(NULL, count * sizeof(HttpWorkerSlot), PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if(slots == MAP_FAILED){
+            printf("创建共享内存失败: 原因:%s",strerror(errno));
+            close(server->listen_fd);
+            server->listen_fd = -1;
+            return -1;
+        }
+        server->worker_slots = slots;
+    }
+
+    // 不使用信号处理函数，工作进程恢复调用前的屏蔽字
+    sigset_t set, old;
+    sigemptyset(&set);
+    for(size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++){
+        sigaddset(&set, signals[i]);
+    }
+    pthread_sigmask(SIG_BLOCK, &set, &old);
+    server->master_pid = getpid();
+    server->master_thread = pthread_self();
+    atomic_store(&server->master_running, 1);
+
+    // 在此之前调用的 http_server_stop 只设置了标记
+    int stopping = atomic_load(&server->stop_requested);
+    for(int i = 0; i < count && !stopping; i++){
+        _http_worker_spawn(server, i, &old);
+    }
+    while (!stopping)
+    {
+        // 有等待重新启动的工作进程时最多等到它的时间
+        long long next = 0;
+        for(int i = 0; i < count; i++){
+            HttpWorkerSlot *slot = &server->worker_slots[i];
+            if(slot->restart_at != 0 && (next == 0 || slot->restart_at < next)){
+                next = slot->restart_at;
+            }
+        }
+        struct timespec timeout = { 0, 0 };
+        if(next > 0){
+            long long wait = next - _http_clock_ms();
+            if(wait > 0){
+                timeout.tv_sec = wait / 1000;
+                timeout.tv_nsec = wait % 1000 * 1000000;
+            }
+        }
+
+        int sig = sigtimedwait(&set, NULL, next > 0 ? &timeout : NULL);
+        if(sig == SIGINT || sig == SIGTERM || sig == SIGQUIT || atomic_load(&server->stop_requested)){
+            stopping = 1;
+        }else if(sig == SIGHUP || sig == SIGUSR1 || sig == SIGUSR2){
+            _http_master_signal(server, sig);
+        }
+
+        // SIGCHLD 可能合并，每次都检查所有工作进程
+        _http_master_reap(server, stopping);
+        long long now = _http_clock_ms();
+        for(int i = 0; i < count && !stopping; i++){
+            HttpWorkerSlot *slot = &server->worker_slots[i];
+            if(slot->restart_at != 0 && slot->restart_at <= now){
+                _http_worker_spawn(server, i, &old);
+            }
+        }
+    }
+
+    // 工作进程处理完当前的事件后退出
+    _http_master_signal(server, SIGTERM);
+    for(int i = 0; i < count; i++){
+        HttpWorkerSlot *slot = &server->worker_slots[i];
+        int pid = atomic_load(&slot->pid);
+        while (pid > 0 && waitpid(pid, NULL, 0) < 0 && errno == EINTR);
+        atomic_store(&slot->pid, 0);
+        slot->restart_at = 0;
+    }
+
+    // 取出停止期间收到的信号再恢复屏蔽字
+    atomic_store(&server->master_running, 0);
+    struct timespec zero = { 0, 0 };
+    while (sigtimedwait(&set, NULL, &zero) > 0);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    close(server->listen_fd);
+    server->listen_fd = -1;
+    atomic_store(&server->stop_requested, 0);
     return 0;
 }
 
+/**
+ * @brief 启动HTTP服务器
+ * @return 成功返回0,失败返回非0值
+ */
+int http_server_start(HttpServer *server){
+    if(server->workers > 0){
+        return _http_server_master(server);
+    }
+    return _http_server_run(server);
+}
+
+/**
+ * @brief 设置工作进程数，需在 http_server_start 前调用
+ */
+void http_server_set_workers(HttpServer *server, int workers){
+    server->workers = workers > 0 ? workers : 0;
+}
+
+/**
+ * @brief 读取各工作进程的统计
+ */
+int http_server_worker_stats(HttpServer *server, HttpWorkerStats *stats, int max){
+    HttpWorkerSlot *slots = server->worker_slots;
+    int count = 0;
+    for(; slots != NULL && count < server->workers && count < max; count++){
+        HttpWorkerSlot *slot = &slots[count];
+        stats[count].pid = atomic_load_explicit(&slot->pid, memory_order_relaxed);
+        stats[count].restarts = atomic_load_explicit(&slot->restarts, memory_order_relaxed);
+        stats[count].rss = atomic_load_explicit(&slot->rss, memory_order_relaxed);
+        stats[count].accepted = atomic_load_explicit(&slot->accepted, memory_order_relaxed);
+        stats[count].active = atomic_load_explicit(&slot->active, memory_order_relaxed);
+        stats[count].requests = atomic_load_explicit(&slot->requests, memory_order_relaxed);
+    }
+    return count;
+}
+
+/**
+ * @brief 设置长连接参数，需在 http_server_start 前调用
+ * @param max_requests 每个连接最多处理的请求数, <=0 不限制
+ * @param idle_timeout 空闲超时，毫秒, <=0 不保持连接
+ */
+void http_server_set_keepalive(HttpServer *server, int max_requests, int idle_timeout){
+    server->keepalive_max_requests = max_requests;
+    server->keepalive_timeout = idle_timeout;
+}
+
+/**
+ * @brief 读取统计，各事件循环的计数求和
+ */
+void http_server_stats(HttpServer *server, HttpServerStats *stats){
+    memset(stats, 0, sizeof(HttpServerStats));
+    if(server->worker_index < 0 && server->worker_slots != NULL){
+        // 主进程: 各工作进程的统计之和
+        HttpWorkerSlot *slots = server->worker_slots;
+        for(int i = 0; i < server->workers; i++){
+            stats->accepted += atomic_load_explicit(&slots[i].accepted, memory_order_relaxed);
+            stats->active += atomic_load_explicit(&slots[i].active, memory_order_relaxed);
+            stats->requests += atomic_load_explicit(&slots[i].requests, memory_order_relaxed);
+        }
+        return;
+    }
+    HttpShard *shards = server->shards;
+    for(int i = 0; shards != NULL && i < server->shard_count; i++){
+        long long accepted = atomic_load_explicit(&shards[i].stat_accepted, memory_order_relaxed);
+        stats->accepted += accepted;
+        stats->active += accepted - atomic_load_explicit(&shards[i].stat_closed, memory_order_relaxed);
+        stats->requests += atomic_load_explicit(&shards[i].stat_requests, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief 停止HTTP服务，线程安全
+ */
+void http_server_stop(HttpServer *server){
+    atomic_store(&server->stop_requested, 1);
+    if(server->worker_index < 0 && atomic_load(&server->master_running)){
+        // 唤醒等待信号的主进程线程去停止工作进程; SIGCHLD 的默认处理是忽略，晚到也无害
+        pthread_kill(server->master_thread, SIGCHLD);
+        return;
+    }
+    HttpShard *shards = server->shards;
+    for(int i = 0; shards != NULL && i < server->shard_count; i++){
+        if(shards[i].loop != NULL){
+            event_loop_stop(shards[i].loop);
+        }
+    }
+}
+
 /**
  * @brief 销毁HTTP服务
  * @return 成功返回0,失败返回非0值
  */
 int http_server_destroy(HttpServer *server){
-    close(server->socket_fd);
-    server->socket_fd=0;
+    _http_server_free_shards(server);
     server->thread_pool = NULL;
-    map_deinit(&server->routes);
+    if(server->worker_slots != NULL){
+        munmap(server->worker_slots, server->workers * sizeof(HttpWorkerSlot));
+        server->worker_slots = NULL;
+    }
+    http_router_destroy(server->router);
+    server->router = NULL;
+    while (server->routes != NULL)
+    {
+        HttpRoute *next = server->routes->next;
+        free(server->routes->path);
+        free(server->routes);
+        server->routes = next;
+    }
     return 0;
 }
 
 /**
- * @brief 添加HTTP路由
+ * @brief 添加HTTP路由，需在 http_server_start 前调用
+ * @param path 支持静态路径、":name" 匹配一段、"*name" 匹配剩余部分
  * @return 添加成功返回0,失败返回-1
  */
 int http_server_route_add(HttpServer *server, char *method , char *path, void (*handle)(HttpRequest *, HttpResponse *)){
-    int key_len = snprintf(NULL,0, "%s %s",method, path);
-    char *key = malloc(sizeof(char)*key_len);
-    sprintf(key,"%s %s",method, path);
+    return http_server_route_add_body(server, method, path, handle, HTTP_BODY_BUFFERED, 0);
+}
 
-    if(map_get(&server->routes, key)){
+/**
+ * @brief 添加HTTP路由，并指定请求 body 的读取方式和大小限制
+ * @return 添加成功返回0,失败返回-1
+ */
+int http_server_route_add_body(HttpServer *server, char *method, char *path, HttpHandler handle,
+                               HttpBodyMode mode, long max_body){
+    HttpMethod m = http_method_parse(method, strlen(method));
+    if(m == HTTP_METHOD_UNKNOWN){
         return -1;
     }
 
-    map_set(&server->routes, key, handle);
+    HttpRoute *route = malloc(sizeof(HttpRoute));
+    if(route == NULL){
+        return -1;
+    }
+    route->handle = handle;
+    route->body_mode = mode;
+    route->max_body = max_body > 0 ? max_body : MAX_BODY_SIZE;
+    route->method = m;
+    route->path = strdup(path);
+    route->next = NULL;
+    if(route->path == NULL || http_router_add(server->router, m, path, route) != 0){
+        free(route->path);
+        free(route);
+        return -1;
+    }
+    HttpRoute **tail = &server->routes;
+    while (*tail != NULL)
+    {
+        tail = &(*tail)->next;
+    }
+    *tail = route;
     return 0;
 }
 
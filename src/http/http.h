@@ -15,6 +15,8 @@ extern "C" {
 
 #define HTTP_STATUS_MSG_OK "OK"
 #define HTTP_STATUS_MSG_NOT_FOUND "Not found"
+#define HTTP_STATUS_MSG_BAD_REQUEST "Bad Request"
+#define HTTP_STATUS_MSG_PAYLOAD_TOO_LARGE "Payload Too Large"
 
 // ====================================================================
 // =========================== REQUEST ================================
@@ -25,16 +27,84 @@ extern "C" {
 typedef struct HttpRequest HttpRequest;
 
 /**
- * @brief 添加请求头
+ * @brief 获取请求头，名称不区分大小写，有多个同名请求头时返回第一个
+ * @return 没有时返回空字符串
  */
 char *http_request_get_header(HttpRequest *request,const char *key);
 
 /**
- * @brief 迭代请求头
+ * @brief Content-Length，解析请求头时已转换为数字，没有时为0
+ */
+long http_request_content_length(HttpRequest *request);
+
+/**
+ * @brief 常用请求头，解析时已记录，不需要查找
+ * @return 没有时返回NULL
+ */
+const char *http_request_host(HttpRequest *request);
+const char *http_request_content_type(HttpRequest *request);
+const char *http_request_user_agent(HttpRequest *request);
+const char *http_request_cookie(HttpRequest *request);
+const char *http_request_accept_encoding(HttpRequest *request);
+
+/**
+ * @brief 获取所有同名请求头的值，名称不区分大小写，按请求中的顺序
+ * @param values 存放值，最多 max 个
+ * @return 同名请求头的数量，可能大于 max
+ */
+int http_request_get_headers(HttpRequest *request, const char *key, const char **values, int max);
+
+/**
+ * @brief 迭代请求头，同名的头会返回多次
  * @return 返回key，可能NULL
  */
 const char *http_request_iter_header(HttpRequest *request, map_iter_t *iter_t);
 
+/**
+ * @brief 获取路径参数，如路由 "/users/:id" 中的 id, 通配 "*path" 中的 path
+ * @return 没有时返回NULL
+ */
+char *http_request_param(HttpRequest *request, const char *name);
+
+/**
+ * @brief 获取查询参数，如 "/search?q=a+b" 中的 q 为 "a b"，第一次调用时才解析
+ * @param key 解码后的参数名
+ * @return 有多个同名参数时返回第一个，没有时返回NULL
+ */
+char *http_request_query(HttpRequest *request, const char *key);
+
+/**
+ * @brief 获取同名查询参数的所有值，如 "?a=1&a=2"
+ * @return 以NULL结尾的数组，没有时返回NULL
+ */
+char **http_request_query_all(HttpRequest *request, const char *key);
+
+/**
+ * @brief 迭代查询参数名，顺序不固定，每个名称只返回一次
+ * @return 返回key，结束时返回NULL
+ */
+const char *http_request_iter_query(HttpRequest *request, map_iter_t *iter_t);
+
+/**
+ * @brief 获取已读入的请求 body，不复制，不以\0结尾，可以包含\0
+ * @param len 输出长度，可以为NULL
+ * @return 没有 body 或路由为 HTTP_BODY_STREAM 时返回NULL
+ */
+const char *http_request_body(HttpRequest *request, size_t *len);
+
+/**
+ * @brief 读取请求 body。HTTP_BODY_STREAM 的路由直接从连接读取，客户端发送慢时阻塞等待;
+ *        HTTP_BODY_BUFFERED 的路由从已读入的 body 复制。客户端要求 100-continue 时第一次读取才回复
+ * @return 读取的字节数, body 读完返回0, 连接出错或等待超时返回-1
+ */
+long http_request_read_body(HttpRequest *request, void *buf, size_t len);
+
+/**
+ * @brief 在请求的内存池中分配内存，请求结束(返回发送完)后自动释放，不需要也不能 free
+ * @return 失败返回NULL
+ */
+void *http_request_alloc(HttpRequest *request, size_t size);
+
 // ====================================================================
 // =========================== RESPONSE ===============================
 // ====================================================================
@@ -45,18 +115,62 @@ const char *http_request_iter_header(HttpRequest *request, map_iter_t *iter_t);
 typedef struct HttpResponse HttpResponse;
 
 /**
- * @brief 写入返回数据
- * @return 成功写入的数量
+ * @brief 释放返回数据的回调，参数为 http_response_write_ref 传入的指针
+ */
+typedef void (*HttpReleaseFunc)(void *data);
+
+/**
+ * @brief 写入返回数据，复制到请求的内存池，按C字符串计算长度
+ * @return 成功返回0,失败返回-1
  */
 int http_response_write(HttpResponse *response, char *data);
 
 /**
- * @brief 添加头
+ * @brief 写入 len 字节返回数据，复制到请求的内存池，可以包含\0
+ * @return 成功返回0,失败返回-1
+ */
+int http_response_write_bytes(HttpResponse *response, const void *data, size_t len);
+
+/**
+ * @brief 写入返回数据，不复制，数据的所有权交给服务器
+ * @param release 数据全部交给内核后调用，连接出错或再次写入时也会调用，可能在任意线程; 为NULL时不调用
+ * @return 成功返回0,失败返回-1 (失败时也会调用 release)
+ */
+int http_response_write_ref(HttpResponse *response, const void *data, size_t len, HttpReleaseFunc release);
+
+/**
+ * @brief 写入返回数据，不复制也不释放，data 需在服务器运行期间一直有效，如字符串常量
+ * @return 成功返回0,失败返回-1
+ */
+int http_response_write_static(HttpResponse *response, const void *data, size_t len);
+
+/**
+ * @brief 开始流式返回，立即发送状态行和返回头，之后不能再修改，已写入的 body 被丢弃
+ * @details HTTP/1.1 使用 Transfer-Encoding: chunked 并可保持连接;
+ *          HTTP/1.0 的客户端不支持分块，直接发送数据并以关闭连接表示结束
+ * @return 成功返回0,失败返回-1
+ */
+int http_response_begin_stream(HttpResponse *response);
+
+/**
+ * @brief 流式发送一块数据，不复制，返回时数据已全部交给内核; 客户端接收慢时阻塞等待
+ * @return 成功返回0, 连接出错或等待超时返回-1, 之后的写入都会失败
+ */
+int http_response_write_chunk(HttpResponse *response, const void *data, size_t len);
+
+/**
+ * @brief 结束流式返回，handler 返回时没有调用的话由服务器调用
+ * @return 成功返回0,失败返回-1
+ */
+int http_response_end(HttpResponse *response);
+
+/**
+ * @brief 添加头，同名的头会分别输出
  */
 void http_response_add_header(HttpResponse *response, const char *key, char *value);
 
 /**
- * @brief 设置
+ * @brief 设置头，覆盖同名的头
  */
 void http_response_set_header(HttpResponse *response, const char *key, char *value);
 
@@ -82,6 +196,56 @@ typedef struct HttpServer HttpServer;
  */
 typedef void(*HttpHandler)(HttpRequest *, HttpResponse *);
 
+/**
+ * @brief 请求 body 的读取方式
+ */
+typedef enum HttpBodyMode {
+    HTTP_BODY_BUFFERED = 0, // 读完整个 body 再调用 handler，默认
+    HTTP_BODY_STREAM,       // 读完请求头就调用 handler，body 由 handler 用 http_request_read_body 读取
+} HttpBodyMode;
+
+/**
+ * @brief 监听套接字和事件循环的分布方式
+ */
+typedef enum HttpListenMode {
+    HTTP_LISTEN_SINGLE = 0,     // 一个监听套接字和一个事件循环，在调用 http_server_start 的线程运行，默认
+    HTTP_LISTEN_REUSEPORT,      // 每个事件循环一个线程和一个 SO_REUSEPORT 监听套接字，由内核按连接的哈希分配新连接
+    HTTP_LISTEN_REUSEPORT_CPU,  // 同上，但按收到连接的 CPU 分配，事件循环线程绑定到对应的 CPU，连接留在接收它的核上;
+                                // 每个可用的 CPU(在线且在进程的 CPU 亲和性中)一个事件循环
+    HTTP_LISTEN_PER_CORE,       // 同上，且每个核不共享任何东西: 不使用线程池，handler 在事件循环线程直接执行，
+                                // 路由表和统计计数各自一份。handler 不能阻塞，流式读写 body 时同一核上的其他连接要等待
+} HttpListenMode;
+
+/**
+ * @brief 服务器统计，各事件循环计数之和
+ */
+typedef struct HttpServerStats {
+    long long accepted;     // 接受的连接数
+    long long active;       // 当前打开的连接数
+    long long requests;     // 处理的请求数，包括直接返回错误的
+} HttpServerStats;
+
+/**
+ * @brief 连接的 I/O 方式
+ */
+typedef enum HttpIoEngine {
+    HTTP_IO_EPOLL = 0,  // epoll 就绪通知加非阻塞读写，默认
+    HTTP_IO_URING,      // io_uring: 多次接受、从提供的缓冲环接收、固定文件、发送后链接关闭，
+                        // 每轮事件循环一次提交; 内核不支持或被禁用时自动使用 epoll
+} HttpIoEngine;
+
+/**
+ * @brief 一个工作进程的统计，由工作进程每秒写入和主进程共享的内存
+ */
+typedef struct HttpWorkerStats {
+    int pid;                // 0 表示没有运行
+    int restarts;           // 异常退出后被重新启动的次数
+    long long rss;          // 常驻内存，字节
+    long long accepted;     // 本次启动后接受的连接数
+    long long active;       // 当前打开的连接数
+    long long requests;     // 本次启动后处理的请求数
+} HttpWorkerStats;
+
 /**
  * @brief 返回一个新的HTTP服务指针
  * @return HTTP 服务指针
@@ -98,11 +262,60 @@ HttpServer *http_server_new();
 int http_server_init(HttpServer *server, char *host, int port);
 
 /**
- * @brief 启动HTTP服务器
+ * @brief 设置长连接参数，需在 http_server_start 前调用
+ * @param max_requests 每个连接最多处理的请求数, <=0 不限制, 默认100
+ * @param idle_timeout 空闲超时，毫秒, <=0 不保持连接, 默认5000
+ */
+void http_server_set_keepalive(HttpServer *server, int max_requests, int idle_timeout);
+
+/**
+ * @brief 设置监听方式，需在 http_server_start 前调用
+ * @param loops 事件循环的数量, <=0 使用在线的 CPU 数; HTTP_LISTEN_SINGLE 和按 CPU 分配的方式忽略，
+ *              后者的数量是可用的 CPU 数，可以用 CPU 亲和性(如 taskset)限制
+ */
+void http_server_set_listeners(HttpServer *server, HttpListenMode mode, int loops);
+
+/**
+ * @brief 设置连接的 I/O 方式，需在 http_server_start 前调用，handler 不受影响
+ */
+void http_server_set_io_engine(HttpServer *server, HttpIoEngine engine);
+
+/**
+ * @brief 设置工作进程数，需在 http_server_start 前调用。大于0时 http_server_start 只打开一次监听套接字，
+ *        然后 fork 出这些工作进程，各自用一个事件循环接受这个套接字上的连接，监听方式中的事件循环数被忽略。
+ *        当前进程作为主进程不处理请求: 重新启动异常退出的工作进程，把 SIGHUP、SIGUSR1、SIGUSR2 转发给工作进程，
+ *        收到 SIGINT、SIGTERM、SIGQUIT 或 http_server_stop 时停止所有工作进程
+ * @param workers 工作进程数, <=0 不使用多进程，默认
+ */
+void http_server_set_workers(HttpServer *server, int workers);
+
+/**
+ * @brief 读取各工作进程的统计，主进程和工作进程中都可以调用
+ * @return 写入 stats 的数量，没有使用多进程时返回0
+ */
+int http_server_worker_stats(HttpServer *server, HttpWorkerStats *stats, int max);
+
+/**
+ * @brief 启动HTTP服务器，运行事件循环直到 http_server_stop。
+ *        HTTP_LISTEN_SINGLE 在当前线程运行，其他方式在各自的线程运行，当前线程等待它们结束。
+ *        使用工作进程时当前线程作为主进程等待信号，调用前进程中的其他线程应屏蔽 SIGCHLD、SIGINT、SIGTERM、
+ *        SIGQUIT、SIGHUP、SIGUSR1、SIGUSR2; 工作进程继承调用前的信号处理方式，SIGINT、SIGTERM、SIGQUIT 除外
  * @return 成功返回0,失败返回非0值
  */
 int http_server_start(HttpServer *server);
 
+/**
+ * @brief 读取统计，服务运行中可以在任意线程调用。每个事件循环只写自己的计数，读取时才求和;
+ *        主进程中是各工作进程最近一次报告的和
+ */
+void http_server_stats(HttpServer *server, HttpServerStats *stats);
+
+/**
+ * @brief 停止HTTP服务，http_server_start 随后返回，线程安全，可以在信号处理函数中调用;
+ *        在 http_server_start 之前调用时它立即返回
+ */
+void http_server_stop(HttpServer *server);
+
 /**
  * @brief 销毁HTTP服务
  * @return 成功返回0,失败返回非0值
@@ -110,11 +323,20 @@ int http_server_start(HttpServer *server);
 int http_server_destroy(HttpServer *server);
 
 /**
- * @brief 添加HTTP路由
+ * @brief 添加HTTP路由，需在 http_server_start 前调用
+ * @param path 支持静态路径、":name" 匹配一段、"*name" 匹配剩余部分，匹配时忽略 '?' 之后的查询参数
  * @return 添加成功返回0,失败返回-1
  */
 int http_server_route_add(HttpServer *server, char *method , char *path, void (*handle)(HttpRequest *, HttpResponse *));
 
+/**
+ * @brief 添加HTTP路由，并指定请求 body 的读取方式和大小限制，需在 http_server_start 前调用
+ * @param max_body Content-Length 的最大值，超过时返回 413 并关闭连接，<=0 使用默认值(1MB)
+ * @return 添加成功返回0,失败返回-1
+ */
+int http_server_route_add_body(HttpServer *server, char *method, char *path, HttpHandler handle,
+                               HttpBodyMode mode, long max_body);
+
 #ifdef __cplusplus
 }
 #endif
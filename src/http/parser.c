@@ -0,0 +1,314 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "parser.h"
+#include "headers.h"
+#include "scan.h"
+
+/**
+ * @brief 解析状态
+ */
+enum {
+    S_METHOD = 0,
+    S_PATH,
+    S_VERSION,
+    S_LINE_LF,        // 请求行的 \r 之后
+    S_HEADER_START,
+    S_HEADER_NAME,
+    S_VALUE_START,
+    S_VALUE,
+    S_HEADER_LF,      // 请求头的 \r 之后
+    S_END_LF,         // 空行的 \r 之后
+    S_DONE,
+};
+
+#define IS_TOKEN(c) http_token_chars[(unsigned char)(c)]
+
+static inline HttpSpan _span(size_t start, size_t end){
+    HttpSpan span = { (unsigned int)start, (unsigned int)(end - start) };
+    return span;
+}
+
+/**
+ * @brief 初始化解析器
+ */
+void http_parser_init(HttpParser *parser){
+    memset(parser, 0, sizeof(HttpParser));
+    memset(parser->known, -1, sizeof(parser->known));
+    parser->state = S_METHOD;
+}
+
+#define NAME_IS(lower) http_header_name_eq(name, lower, sizeof(lower)-1)
+
+/**
+ * @brief 识别常用请求头，先按长度区分，最多再比较两次
+ * @return 不是常用请求头时返回 HTTP_HEADER_UNKNOWN
+ */
+HttpKnownHeader http_known_header(const char *name, size_t len){
+    switch (len)
+    {
+        case 4:
+            if(NAME_IS("host")) return HTTP_HEADER_HOST;
+            break;
+        case 6:
+            if(NAME_IS("cookie")) return HTTP_HEADER_COOKIE;
+            if(NAME_IS("expect")) return HTTP_HEADER_EXPECT;
+            break;
+        case 10:
+            if(NAME_IS("connection")) return HTTP_HEADER_CONNECTION;
+            if(NAME_IS("user-agent")) return HTTP_HEADER_USER_AGENT;
+            break;
+        case 12:
+            if(NAME_IS("content-type")) return HTTP_HEADER_CONTENT_TYPE;
+            break;
+        case 14:
+            if(NAME_IS("content-length")) return HTTP_HEADER_CONTENT_LENGTH;
+            break;
+        case 15:
+            if(NAME_IS("accept-encoding")) return HTTP_HEADER_ACCEPT_ENCODING;
+            break;
+        case 17:
+            if(NAME_IS("transfer-encoding")) return HTTP_HEADER_TRANSFER_ENCODING;
+            break;
+    }
+    return HTTP_HEADER_UNKNOWN;
+}
+
+/**
+ * @brief 判断逗号分隔的列表项是否为 token，忽略大小写和两边空白
+ */
+static int _http_item_is(const char *p, size_t len, const char *token, size_t token_len){
+    while (len > 0 && (*p == ' ' || *p == '\t'))
+    {
+        p++;
+        len--;
+    }
+    while (len > 0 && (p[len-1] == ' ' || p[len-1] == '\t'))
+    {
+        len--;
+    }
+    return len == token_len && http_header_name_eq(p, token, len);
+}
+
+/**
+ * @brief 解析 Connection 头，如 "keep-alive, Upgrade"
+ */
+static int _http_parse_connection(const char *p, const char *end){
+    int flags = 0;
+    while (p < end)
+    {
+        const char *comma = memchr(p, ',', end - p);
+        const char *item_end = comma ? comma : end;
+        if(_http_item_is(p, item_end - p, "close", 5)) flags |= HTTP_CONNECTION_CLOSE;
+        else if(_http_item_is(p, item_end - p, "keep-alive", 10)) flags |= HTTP_CONNECTION_KEEP_ALIVE;
+        else if(_http_item_is(p, item_end - p, "upgrade", 7)) flags |= HTTP_CONNECTION_UPGRADE;
+        p = item_end + 1;
+    }
+    return flags;
+}
+
+/**
+ * @brief 解析 Content-Length
+ * @return 成功返回0,非法返回-1
+ */
+static int _http_parse_content_length(HttpParser *parser, const char *p, const char *end, long max_body_len){
+    if(p == end){
+        return -1;
+    }
+
+    long value = 0;
+    for(; p < end; p++){
+        if(*p < '0' || *p > '9'){
+            return -1;
+        }
+        // 先比较再计算，很长的数字不会溢出
+        int d = *p - '0';
+        if(value > max_body_len / 10 || value*10 > max_body_len - d){
+            return -1;
+        }
+        value = value*10 + d;
+    }
+
+    // 重复的 Content-Length 必须一致，第一个是0时也要检查
+    if(parser->known[HTTP_HEADER_CONTENT_LENGTH] != parser->header_count && parser->content_length != value){
+        return -1;
+    }
+    parser->content_length = value;
+    return 0;
+}
+
+/**
+ * @brief 请求头解析完一个后，识别常用请求头并解析其中的数字和选项
+ * @return 成功返回0,非法返回-1
+ */
+static int _http_parser_on_header(HttpParser *parser, const char *data, const HttpHeaderSpan *header, long max_body_len){
+    HttpKnownHeader known = http_known_header(data + header->name.off, header->name.len);
+    if(known == HTTP_HEADER_UNKNOWN){
+        return 0;
+    }
+    if(parser->known[known] < 0){
+        parser->known[known] = parser->header_count;
+    }
+
+    const char *p = data + header->value.off;
+    const char *end = p + header->value.len;
+    switch (known)
+    {
+        case HTTP_HEADER_CONTENT_LENGTH:
+            return _http_parse_content_length(parser, p, end, max_body_len);
+        case HTTP_HEADER_CONNECTION:
+            parser->connection |= _http_parse_connection(p, end);
+            break;
+        case HTTP_HEADER_TRANSFER_ENCODING: {
+            // 只看最后一项，多个 Transfer-Encoding 头时以最后一个为准
+            const char *last = end;
+            while (last > p && last[-1] != ',') last--;
+            parser->chunked = _http_item_is(last, end - last, "chunked", 7);
+            break;
+        }
+        case HTTP_HEADER_EXPECT:
+            parser->expect_continue = _http_item_is(p, end - p, "100-continue", 12);
+            break;
+        default:
+            break;
+    }
+    return 0;
+}
+
+/**
+ * @brief 继续解析，从上次停下的位置开始，只扫描新到达的数据
+ */
+int http_parser_execute(HttpParser *parser, const char *data, size_t len, size_t max_header_len, long max_body_len){
+    if(parser->state == S_DONE){
+        return HTTP_PARSE_DONE;
+    }
+
+    size_t pos = parser->pos;
+    size_t mark = parser->mark;
+    size_t end = len < max_header_len ? len : max_header_len;
+    unsigned char c;
+
+    while (pos < end)
+    {
+        switch (parser->state)
+        {
+            case S_METHOD:
+                pos += http_scan_token(data + pos, end - pos);
+                if(pos == end) goto again;
+                if(data[pos] != ' ' || pos == mark) return HTTP_PARSE_ERROR;
+                parser->method = _span(mark, pos);
+                mark = ++pos;
+                parser->state = S_PATH;
+                break;
+
+            case S_PATH:
+                pos += http_scan_vchar(data + pos, end - pos);
+                if(pos == end) goto again;
+                if(data[pos] != ' ' || pos == mark) return HTTP_PARSE_ERROR;
+                parser->path = _span(mark, pos);
+                mark = ++pos;
+                parser->state = S_VERSION;
+                break;
+
+            case S_VERSION:
+                pos += http_scan_vchar(data + pos, end - pos);
+                if(pos == end) goto again;
+                c = data[pos];
+                if(pos == mark || (c != '\r' && c != '\n')) return HTTP_PARSE_ERROR;
+                parser->version = _span(mark, pos);
+                pos++;
+                parser->state = c == '\r' ? S_LINE_LF : S_HEADER_START;
+                break;
+
+            case S_LINE_LF:
+            case S_HEADER_LF:
+                if(data[pos] != '\n') return HTTP_PARSE_ERROR;
+                pos++;
+                parser->state = S_HEADER_START;
+                break;
+
+            case S_HEADER_START:
+                c = data[pos];
+                if(c == '\r'){
+                    pos++;
+                    parser->state = S_END_LF;
+                    break;
+                }
+                if(c == '\n'){
+                    pos++;
+                    goto done;
+                }
+                if(!IS_TOKEN(c) || parser->header_count >= HTTP_PARSER_MAX_HEADERS){
+                    return HTTP_PARSE_ERROR;
+                }
+                mark = pos;
+                parser->state = S_HEADER_NAME;
+                break;
+
+            case S_HEADER_NAME:
+                pos += http_scan_token(data + pos, end - pos);
+                if(pos == end) goto again;
+                if(data[pos] != ':') return HTTP_PARSE_ERROR;
+                parser->headers[parser->header_count].name = _span(mark, pos);
+                pos++;
+                parser->state = S_VALUE_START;
+                break;
+
+            case S_VALUE_START:
+                while (pos < end && (data[pos] == ' ' || data[pos] == '\t')) pos++;
+                if(pos == end) goto again;
+                mark = pos;
+                parser->state = S_VALUE;
+                break;
+
+            case S_VALUE: {
+                pos += http_scan_value(data + pos, end - pos);
+                if(pos == end) goto again;
+                c = data[pos];
+                if(c != '\r' && c != '\n') return HTTP_PARSE_ERROR;
+
+                // 去掉值末尾的空白
+                size_t value_end = pos;
+                while (value_end > mark && (data[value_end-1] == ' ' || data[value_end-1] == '\t'))
+                {
+                    value_end--;
+                }
+
+                HttpHeaderSpan *header = &parser->headers[parser->header_count];
+                header->value = _span(mark, value_end);
+                if(_http_parser_on_header(parser, data, header, max_body_len) != 0){
+                    return HTTP_PARSE_ERROR;
+                }
+                parser->header_count++;
+
+                pos++;
+                parser->state = c == '\r' ? S_HEADER_LF : S_HEADER_START;
+                break;
+            }
+
+            case S_END_LF:
+                if(data[pos] != '\n') return HTTP_PARSE_ERROR;
+                pos++;
+                goto done;
+
+            default:
+                return HTTP_PARSE_ERROR;
+        }
+    }
+
+again:
+    parser->pos = pos;
+    parser->mark = mark;
+    if(len >= max_header_len){
+        return HTTP_PARSE_ERROR; // 超出长度限制仍未结束
+    }
+    return HTTP_PARSE_AGAIN;
+
+done:
+    parser->pos = pos;
+    parser->mark = mark;
+    parser->header_len = pos;
+    parser->state = S_DONE;
+    return HTTP_PARSE_DONE;
+}
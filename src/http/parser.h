@@ -0,0 +1,119 @@
+#ifndef HTTP_PARSER_H_
+#define HTTP_PARSER_H_
+
+// Description: Header file for parser (单遍状态机请求头解析，不做任何内存分配)
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HTTP_PARSER_MAX_HEADERS 64
+
+#define HTTP_PARSE_DONE 1
+#define HTTP_PARSE_AGAIN 0
+#define HTTP_PARSE_ERROR -1
+
+/**
+ * @brief 字符串切片，指向连接缓冲，不以\0结尾
+ */
+typedef struct HttpSlice {
+    const char *data;
+    size_t len;
+} HttpSlice;
+
+/**
+ * @brief 缓冲中的区间，用偏移量表示，缓冲扩容后依然有效
+ */
+typedef struct HttpSpan {
+    unsigned int off;
+    unsigned int len;
+} HttpSpan;
+
+/**
+ * @brief 请求头
+ */
+typedef struct HttpHeaderSpan {
+    HttpSpan name;
+    HttpSpan value;
+} HttpHeaderSpan;
+
+/**
+ * @brief 解析时识别的常用请求头
+ */
+typedef enum HttpKnownHeader {
+    HTTP_HEADER_HOST = 0,
+    HTTP_HEADER_CONNECTION,
+    HTTP_HEADER_CONTENT_LENGTH,
+    HTTP_HEADER_CONTENT_TYPE,
+    HTTP_HEADER_TRANSFER_ENCODING,
+    HTTP_HEADER_ACCEPT_ENCODING,
+    HTTP_HEADER_EXPECT,
+    HTTP_HEADER_COOKIE,
+    HTTP_HEADER_USER_AGENT,
+    HTTP_HEADER_KNOWN_COUNT,
+    HTTP_HEADER_UNKNOWN = -1,
+} HttpKnownHeader;
+
+// Connection 头中的选项
+#define HTTP_CONNECTION_CLOSE 0x1
+#define HTTP_CONNECTION_KEEP_ALIVE 0x2
+#define HTTP_CONNECTION_UPGRADE 0x4
+
+/**
+ * @brief 解析器状态，可以在多次读取之间恢复
+ */
+typedef struct HttpParser {
+    int state;
+    size_t pos;         // 已解析到的位置
+    size_t mark;        // 当前 token 的起始位置
+
+    HttpSpan method;
+    HttpSpan path;
+    HttpSpan version;
+
+    HttpHeaderSpan headers[HTTP_PARSER_MAX_HEADERS];
+    int header_count;
+
+    signed char known[HTTP_HEADER_KNOWN_COUNT]; // 常用请求头第一次出现的下标，没有时为-1
+
+    long content_length; // 没有时为0
+    int connection;      // HTTP_CONNECTION_* 的组合
+    int chunked;         // Transfer-Encoding 的最后一项是 chunked
+    int expect_continue; // Expect: 100-continue
+    size_t header_len;   // 请求行+请求头的总长度，解析完成后有效
+} HttpParser;
+
+/**
+ * @brief 初始化解析器
+ */
+void http_parser_init(HttpParser *parser);
+
+/**
+ * @brief 继续解析，data 必须是请求的起始位置，len 是目前已收到的全部长度
+ * @param max_header_len 请求行+请求头的最大长度
+ * @param max_body_len Content-Length 的最大值
+ * @return HTTP_PARSE_DONE 请求头完整, HTTP_PARSE_AGAIN 需要更多数据, HTTP_PARSE_ERROR 请求非法
+ */
+int http_parser_execute(HttpParser *parser, const char *data, size_t len, size_t max_header_len, long max_body_len);
+
+/**
+ * @brief 识别常用请求头，名称不区分大小写
+ * @return 不是常用请求头时返回 HTTP_HEADER_UNKNOWN
+ */
+HttpKnownHeader http_known_header(const char *name, size_t len);
+
+/**
+ * @brief 把区间转换为切片
+ */
+static inline HttpSlice http_span_slice(const char *base, HttpSpan span){
+    HttpSlice slice = { base + span.off, span.len };
+    return slice;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HTTP_PARSER_H_ */
@@ -15,5 +15,6 @@ void route_test(HttpRequest *request, HttpResponse *response){
         printf("%s:%s\n",key,value);
     }
 
-    http_response_write(response, "你有新的消息，请注意查收!\r\n");
+    static const char msg[] = "你有新的消息，请注意查收!\r\n";
+    http_response_write_static(response, msg, sizeof(msg) - 1);
 }
\ No newline at end of file
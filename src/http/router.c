@@ -0,0 +1,664 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "router.h"
+
+/**
+ * @brief 节点类型
+ */
+enum {
+    NODE_STATIC = 0,
+    NODE_PARAM,     // :name, 匹配到下一个 '/' 为止
+    NODE_WILDCARD,  // *name, 匹配剩余全部
+};
+
+/**
+ * @brief 路由树节点
+ * @details 静态节点保存压缩后的公共前缀，子节点按首字节索引；
+ *          每个节点最多一个参数子节点和一个通配子节点
+ */
+typedef struct HttpRouteNode {
+    int type;
+    char *prefix;       // 静态节点的前缀
+    size_t prefix_len;
+    char *name;         // 参数名，以\0结尾
+    size_t name_len;
+
+    char *indices;      // 静态子节点前缀的首字节，与 children 一一对应
+    struct HttpRouteNode **children;
+    int child_count;
+
+    struct HttpRouteNode *param;
+    struct HttpRouteNode *wildcard;
+
+    void *handle;
+} HttpRouteNode;
+
+/**
+ * @brief 冻结后的静态路由
+ */
+typedef struct HttpRouteEntry {
+    uint64_t hash;
+    const char *path;   // 指向 HttpRouteTable.paths
+    unsigned int len;
+    int method;
+    void *handle;
+} HttpRouteEntry;
+
+/**
+ * @brief 静态路由的最小完美哈希表(hash and displace)
+ * @details 先按哈希值分到 buckets 个桶，每个桶找一个 seed，
+ *          使桶内所有 key 经 seed 再混合后落到互不冲突的空槽位。
+ *          查找只需计算一次哈希，再比较一次
+ */
+typedef struct HttpRouteTable {
+    HttpRouteEntry *entries;    // size 个，与槽位一一对应
+    uint32_t *seeds;            // buckets 个
+    size_t size;
+    size_t buckets;
+    char *paths;                // 所有路径连续存放
+} HttpRouteTable;
+
+typedef struct HttpRouter {
+    HttpRouteNode *roots[HTTP_METHOD_COUNT];
+    HttpRouteTable *table;      // 冻结后生成，没有静态路由时为NULL
+    int frozen;                 // 冻结后不能再添加路由
+} HttpRouter;
+
+static const struct {
+    const char *name;
+    size_t len;
+} METHODS[HTTP_METHOD_COUNT] = {
+    [HTTP_GET] = { "GET", 3 },
+    [HTTP_HEAD] = { "HEAD", 4 },
+    [HTTP_POST] = { "POST", 4 },
+    [HTTP_PUT] = { "PUT", 3 },
+    [HTTP_DELETE] = { "DELETE", 6 },
+    [HTTP_CONNECT] = { "CONNECT", 7 },
+    [HTTP_OPTIONS] = { "OPTIONS", 7 },
+    [HTTP_TRACE] = { "TRACE", 5 },
+    [HTTP_PATCH] = { "PATCH", 5 },
+};
+
+/**
+ * @brief 识别请求方法
+ * @return 不认识的方法返回 HTTP_METHOD_UNKNOWN
+ */
+HttpMethod http_method_parse(const char *method, size_t len){
+    for(int i = 0; i < HTTP_METHOD_COUNT; i++){
+        if(METHODS[i].len == len && memcmp(METHODS[i].name, method, len) == 0){
+            return (HttpMethod)i;
+        }
+    }
+    return HTTP_METHOD_UNKNOWN;
+}
+
+// ====================================================================
+// ============================= NODE =================================
+// ====================================================================
+
+static char *_strndup(const char *s, size_t len){
+    char *dup = malloc(len + 1);
+    if(dup == NULL){
+        return NULL;
+    }
+    memcpy(dup, s, len);
+    dup[len] = '\0';
+    return dup;
+}
+
+static HttpRouteNode *_node_new(int type, const char *text, size_t len){
+    HttpRouteNode *node = calloc(1, sizeof(HttpRouteNode));
+    if(node == NULL){
+        return NULL;
+    }
+    node->type = type;
+
+    char *dup = _strndup(text, len);
+    if(dup == NULL){
+        free(node);
+        return NULL;
+    }
+    if(type == NODE_STATIC){
+        node->prefix = dup;
+        node->prefix_len = len;
+    }else{
+        node->name = dup;
+        node->name_len = len;
+    }
+    return node;
+}
+
+static void _node_free(HttpRouteNode *node){
+    if(node == NULL) return;
+    for(int i = 0; i < node->child_count; i++){
+        _node_free(node->children[i]);
+    }
+    _node_free(node->param);
+    _node_free(node->wildcard);
+    free(node->children);
+    free(node->indices);
+    free(node->prefix);
+    free(node->name);
+    free(node);
+}
+
+static int _node_add_child(HttpRouteNode *node, HttpRouteNode *child){
+    HttpRouteNode **children = realloc(node->children, sizeof(HttpRouteNode *) * (node->child_count + 1));
+    if(children == NULL){
+        return -1;
+    }
+    node->children = children;
+
+    char *indices = realloc(node->indices, node->child_count + 1);
+    if(indices == NULL){
+        return -1;
+    }
+    node->indices = indices;
+
+    node->indices[node->child_count] = child->prefix[0];
+    node->children[node->child_count] = child;
+    node->child_count++;
+    return 0;
+}
+
+static HttpRouteNode *_node_find_child(const HttpRouteNode *node, char c){
+    const char *idx = node->child_count > 0 ? memchr(node->indices, c, node->child_count) : NULL;
+    return idx ? node->children[idx - node->indices] : NULL;
+}
+
+/**
+ * @brief 在 at 处拆分静态节点，前半部分留在原节点，后半部分连同所有子节点移到新节点
+ */
+static int _node_split(HttpRouteNode *node, size_t at){
+    HttpRouteNode *tail = _node_new(NODE_STATIC, node->prefix + at, node->prefix_len - at);
+    if(tail == NULL){
+        return -1;
+    }
+    tail->indices = node->indices;
+    tail->children = node->children;
+    tail->child_count = node->child_count;
+    tail->param = node->param;
+    tail->wildcard = node->wildcard;
+    tail->handle = node->handle;
+
+    node->indices = NULL;
+    node->children = NULL;
+    node->child_count = 0;
+    node->param = NULL;
+    node->wildcard = NULL;
+    node->handle = NULL;
+    node->prefix_len = at;
+    node->prefix[at] = '\0';
+
+    if(_node_add_child(node, tail) != 0){
+        _node_free(tail);
+        return -1;
+    }
+    return 0;
+}
+
+// ====================================================================
+// ============================ INSERT ================================
+// ====================================================================
+
+/**
+ * @brief 从已完全匹配的 node 之后继续插入剩余的 pattern
+ */
+static int _router_insert(HttpRouteNode *node, const char *pattern, void *handle){
+    if(*pattern == '\0'){
+        if(node->handle != NULL){
+            return -1; // 重复路由
+        }
+        node->handle = handle;
+        return 0;
+    }
+
+    if(*pattern == ':' || *pattern == '*'){
+        int type = *pattern == ':' ? NODE_PARAM : NODE_WILDCARD;
+        const char *name = pattern + 1;
+        size_t name_len = strcspn(name, "/");
+        if(name_len == 0 || memchr(name, ':', name_len) || memchr(name, '*', name_len)){
+            return -1;
+        }
+        if(type == NODE_WILDCARD && name[name_len] != '\0'){
+            return -1; // 通配只能在结尾
+        }
+
+        HttpRouteNode **slot = type == NODE_PARAM ? &node->param : &node->wildcard;
+        if(*slot == NULL){
+            *slot = _node_new(type, name, name_len);
+            if(*slot == NULL){
+                return -1;
+            }
+        }else if((*slot)->name_len != name_len || memcmp((*slot)->name, name, name_len) != 0){
+            return -1; // 同一位置的参数名必须一致
+        }
+        return _router_insert(*slot, name + name_len, handle);
+    }
+
+    if(node->type == NODE_PARAM && *pattern != '/'){
+        return -1; // 参数必须占满一段
+    }
+
+    size_t run = strcspn(pattern, ":*");
+    HttpRouteNode *child = _node_find_child(node, *pattern);
+    if(child == NULL){
+        child = _node_new(NODE_STATIC, pattern, run);
+        if(child == NULL){
+            return -1;
+        }
+        if(_node_add_child(node, child) != 0){
+            _node_free(child);
+            return -1;
+        }
+        return _router_insert(child, pattern + run, handle);
+    }
+
+    size_t common = 0;
+    while (common < run && common < child->prefix_len && child->prefix[common] == pattern[common])
+    {
+        common++;
+    }
+    if(common < child->prefix_len && _node_split(child, common) != 0){
+        return -1;
+    }
+    return _router_insert(child, pattern + common, handle);
+}
+
+/**
+ * @brief 创建路由器
+ * @return 失败返回NULL
+ */
+HttpRouter *http_router_new(){
+    HttpRouter *router = calloc(1, sizeof(HttpRouter));
+    return router;
+}
+
+/**
+ * @brief 销毁路由器
+ */
+static void _route_table_free(HttpRouteTable *table);
+
+void http_router_destroy(HttpRouter *router){
+    if(router == NULL) return;
+    for(int i = 0; i < HTTP_METHOD_COUNT; i++){
+        _node_free(router->roots[i]);
+    }
+    _route_table_free(router->table);
+    free(router);
+}
+
+/**
+ * @brief 添加路由，只能在开始匹配之前调用
+ * @return 成功返回0, 路由非法或与已有路由冲突返回-1
+ */
+int http_router_add(HttpRouter *router, HttpMethod method, const char *pattern, void *handle){
+    if(router->frozen){
+        return -1;
+    }
+    if(method < 0 || method >= HTTP_METHOD_COUNT || pattern == NULL || pattern[0] != '/' || handle == NULL){
+        return -1;
+    }
+
+    // 参数和通配必须占满一段
+    for(const char *p = pattern; *p; p++){
+        if((*p == ':' || *p == '*') && p[-1] != '/'){
+            return -1;
+        }
+    }
+
+    if(router->roots[method] == NULL){
+        router->roots[method] = _node_new(NODE_STATIC, "", 0);
+        if(router->roots[method] == NULL){
+            return -1;
+        }
+    }
+    return _router_insert(router->roots[method], pattern, handle);
+}
+
+// ====================================================================
+// ============================ FREEZE ================================
+// ====================================================================
+
+#define ROUTE_SEED_MAX (1u << 20)
+
+static inline uint64_t _route_mix(uint64_t x){
+    x ^= x >> 32;
+    x *= 0xd6e8feb86659fd93ull;
+    x ^= x >> 32;
+    x *= 0xd6e8feb86659fd93ull;
+    x ^= x >> 32;
+    return x;
+}
+
+/**
+ * @brief (method, path) 的哈希，每次处理8字节
+ */
+static uint64_t _route_hash(int method, const char *path, size_t len){
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ ((uint64_t)len << 8) ^ (uint64_t)method;
+    while (len >= 8)
+    {
+        uint64_t w;
+        memcpy(&w, path, 8);
+        h = (h ^ w) * 0xbf58476d1ce4e5b9ull;
+        h ^= h >> 29;
+        path += 8;
+        len -= 8;
+    }
+    if(len > 0){
+        uint64_t w = 0;
+        memcpy(&w, path, len);
+        h = (h ^ w) * 0xbf58476d1ce4e5b9ull;
+    }
+    return _route_mix(h);
+}
+
+static inline size_t _route_bucket(const HttpRouteTable *table, uint64_t hash){
+    return (hash >> 32) % table->buckets;
+}
+
+static inline size_t _route_slot(const HttpRouteTable *table, uint64_t hash, uint32_t seed){
+    return _route_mix(hash ^ (seed * 0x9e3779b97f4a7c15ull)) % table->size;
+}
+
+static void _route_table_free(HttpRouteTable *table){
+    if(table == NULL) return;
+    free(table->entries);
+    free(table->seeds);
+    free(table->paths);
+    free(table);
+}
+
+/**
+ * @brief 收集过程中的临时数据
+ */
+typedef struct RouteCollect {
+    HttpRouteEntry *entries;
+    size_t count;
+    size_t cap;
+    char *path;         // 当前路径
+    size_t path_len;
+    size_t path_cap;
+    size_t total_len;   // 所有路径长度之和
+} RouteCollect;
+
+/**
+ * @brief 深度优先收集不含参数的完整路由
+ */
+static int _route_collect(RouteCollect *c, const HttpRouteNode *node, int method){
+    size_t saved = c->path_len;
+    if(c->path_len + node->prefix_len > c->path_cap){
+        size_t cap = (c->path_len + node->prefix_len) * 2;
+        char *path = realloc(c->path, cap);
+        if(path == NULL) return -1;
+        c->path = path;
+        c->path_cap = cap;
+    }
+    if(node->prefix_len > 0){
+        memcpy(c->path + c->path_len, node->prefix, node->prefix_len);
+        c->path_len += node->prefix_len;
+    }
+
+    if(node->handle != NULL){
+        if(c->count == c->cap){
+            size_t cap = c->cap ? c->cap * 2 : 64;
+            HttpRouteEntry *entries = realloc(c->entries, sizeof(HttpRouteEntry) * cap);
+            if(entries == NULL) return -1;
+            c->entries = entries;
+            c->cap = cap;
+        }
+        // 先临时复制一份，最后统一放到连续的 paths 中
+        char *dup = malloc(c->path_len);
+        if(dup == NULL && c->path_len > 0) return -1;
+        memcpy(dup, c->path, c->path_len);
+        HttpRouteEntry *e = &c->entries[c->count++];
+        e->path = dup;
+        e->len = c->path_len;
+        e->method = method;
+        e->handle = node->handle;
+        e->hash = _route_hash(method, c->path, c->path_len);
+        c->total_len += c->path_len;
+    }
+
+    for(int i = 0; i < node->child_count; i++){
+        if(_route_collect(c, node->children[i], method) != 0){
+            return -1;
+        }
+    }
+    c->path_len = saved;
+    return 0;
+}
+
+/**
+ * @brief 为收集到的路由寻找每个桶的 seed
+ * @return 成功返回0, 找不到(如哈希完全相同)返回-1
+ */
+static int _route_table_place(HttpRouteTable *table, HttpRouteEntry *src, size_t n){
+    size_t *bucket_size = calloc(table->buckets, sizeof(size_t));
+    size_t *bucket_start = calloc(table->buckets + 1, sizeof(size_t));
+    size_t *members = malloc(sizeof(size_t) * n);
+    size_t *order = malloc(sizeof(size_t) * table->buckets);
+    char *used = calloc(n, 1);
+    size_t *slots = malloc(sizeof(size_t) * n);
+    int rs = -1;
+    if(!bucket_size || !bucket_start || !members || !order || !used || !slots){
+        goto out;
+    }
+
+    // 按桶分组
+    for(size_t i = 0; i < n; i++){
+        bucket_size[_route_bucket(table, src[i].hash)]++;
+    }
+    for(size_t b = 0; b < table->buckets; b++){
+        bucket_start[b+1] = bucket_start[b] + bucket_size[b];
+        order[b] = b;
+    }
+    memset(bucket_size, 0, sizeof(size_t) * table->buckets);
+    for(size_t i = 0; i < n; i++){
+        size_t b = _route_bucket(table, src[i].hash);
+        members[bucket_start[b] + bucket_size[b]++] = i;
+    }
+
+    // 大桶先放，插入排序即可，路由数量不多
+    for(size_t i = 1; i < table->buckets; i++){
+        size_t b = order[i], j = i;
+        while (j > 0 && bucket_size[order[j-1]] < bucket_size[b])
+        {
+            order[j] = order[j-1];
+            j--;
+        }
+        order[j] = b;
+    }
+
+    for(size_t i = 0; i < table->buckets && bucket_size[order[i]] > 0; i++){
+        size_t b = order[i];
+        size_t *m = members + bucket_start[b];
+        uint32_t seed;
+        for(seed = 0; seed < ROUTE_SEED_MAX; seed++){
+            size_t k;
+            for(k = 0; k < bucket_size[b]; k++){
+                slots[k] = _route_slot(table, src[m[k]].hash, seed);
+                if(used[slots[k]]) break;
+                used[slots[k]] = 1;
+            }
+            if(k == bucket_size[b]) break;
+            while (k-- > 0) used[slots[k]] = 0;
+        }
+        if(seed == ROUTE_SEED_MAX){
+            goto out;
+        }
+        table->seeds[b] = seed;
+        for(size_t k = 0; k < bucket_size[b]; k++){
+            table->entries[slots[k]] = src[m[k]];
+        }
+    }
+    rs = 0;
+
+out:
+    free(bucket_size);
+    free(bucket_start);
+    free(members);
+    free(order);
+    free(used);
+    free(slots);
+    return rs;
+}
+
+/**
+ * @brief 把所有静态路由编译为只读的完美哈希表，之后不能再添加路由
+ * @return 成功返回0, 失败返回-1(路由树仍然可用)
+ */
+int http_router_freeze(HttpRouter *router){
+    if(router->frozen){
+        return 0;
+    }
+    router->frozen = 1;
+
+    RouteCollect c;
+    memset(&c, 0, sizeof(c));
+    int rs = 0;
+    for(int m = 0; m < HTTP_METHOD_COUNT && rs == 0; m++){
+        if(router->roots[m] != NULL){
+            rs = _route_collect(&c, router->roots[m], m);
+        }
+    }
+
+    HttpRouteTable *table = NULL;
+    if(rs == 0 && c.count > 0){
+        table = calloc(1, sizeof(HttpRouteTable));
+        rs = table ? 0 : -1;
+    }
+    if(table != NULL){
+        table->size = c.count;
+        table->buckets = c.count / 4 + 1;
+        table->entries = calloc(c.count, sizeof(HttpRouteEntry));
+        table->seeds = calloc(table->buckets, sizeof(uint32_t));
+        table->paths = malloc(c.total_len + 1);
+        if(!table->entries || !table->seeds || !table->paths){
+            rs = -1;
+        }else{
+            rs = _route_table_place(table, c.entries, c.count);
+        }
+    }
+
+    if(rs == 0 && table != NULL){
+        // 路径连续存放，查找时只访问一块内存
+        char *p = table->paths;
+        for(size_t i = 0; i < table->size; i++){
+            HttpRouteEntry *e = &table->entries[i];
+            memcpy(p, e->path, e->len);
+            e->path = p;
+            p += e->len;
+        }
+    }
+
+    for(size_t i = 0; i < c.count; i++){
+        free((char *)c.entries[i].path);
+    }
+    free(c.entries);
+    free(c.path);
+
+    if(rs != 0){
+        _route_table_free(table);
+        return -1;
+    }
+    router->table = table;
+    return 0;
+}
+
+/**
+ * @brief 在冻结表中查找完全匹配的静态路由
+ */
+static void *_route_table_find(const HttpRouteTable *table, int method, const char *path, size_t len){
+    uint64_t hash = _route_hash(method, path, len);
+    uint32_t seed = table->seeds[_route_bucket(table, hash)];
+    const HttpRouteEntry *e = &table->entries[_route_slot(table, hash, seed)];
+    if(e->hash == hash && e->len == len && e->method == method && memcmp(e->path, path, len) == 0){
+        return e->handle;
+    }
+    return NULL;
+}
+
+// ====================================================================
+// ============================= MATCH ================================
+// ====================================================================
+
+/**
+ * @brief 从已完全匹配的 node 之后继续匹配剩余路径，失败时回溯尝试下一优先级
+ */
+static void *_router_match(const HttpRouteNode *node, const char *path, size_t len, HttpRouteParams *params){
+    if(len == 0 && node->handle != NULL){
+        return node->handle;
+    }
+
+    if(len > 0){
+        const HttpRouteNode *child = _node_find_child(node, *path);
+        if(child != NULL && child->prefix_len <= len && memcmp(child->prefix, path, child->prefix_len) == 0){
+            void *handle = _router_match(child, path + child->prefix_len, len - child->prefix_len, params);
+            if(handle != NULL){
+                return handle;
+            }
+        }
+
+        const HttpRouteNode *param = node->param;
+        if(param != NULL && params->count < HTTP_ROUTER_MAX_PARAMS){
+            const char *slash = memchr(path, '/', len);
+            size_t seg = slash ? (size_t)(slash - path) : len;
+            if(seg > 0){
+                HttpRouteParam *p = &params->items[params->count++];
+                p->name.data = param->name;
+                p->name.len = param->name_len;
+                p->value.data = path;
+                p->value.len = seg;
+                void *handle = _router_match(param, path + seg, len - seg, params);
+                if(handle != NULL){
+                    return handle;
+                }
+                params->count--;
+            }
+        }
+    }
+
+    const HttpRouteNode *wildcard = node->wildcard;
+    if(wildcard != NULL && params->count < HTTP_ROUTER_MAX_PARAMS){
+        HttpRouteParam *p = &params->items[params->count++];
+        p->name.data = wildcard->name;
+        p->name.len = wildcard->name_len;
+        p->value.data = path;
+        p->value.len = len;
+        return wildcard->handle;
+    }
+    return NULL;
+}
+
+/**
+ * @brief 匹配路由，只读，可以在多个线程中同时调用
+ * @return 匹配到的 handle，没有时返回NULL
+ */
+void *http_router_match(const HttpRouter *router, HttpMethod method, const char *path, size_t len, HttpRouteParams *params){
+    if(method < 0 || method >= HTTP_METHOD_COUNT || router->roots[method] == NULL){
+        return NULL;
+    }
+
+    const char *query = memchr(path, '?', len);
+    if(query != NULL){
+        len = query - path;
+    }
+
+    HttpRouteParams tmp;
+    if(params == NULL){
+        params = &tmp;
+    }
+    params->count = 0;
+
+    // 静态路由在树中也优先于参数，先查冻结表结果相同
+    if(router->table != NULL){
+        void *handle = _route_table_find(router->table, method, path, len);
+        if(handle != NULL){
+            return handle;
+        }
+    }
+    return _router_match(router->roots[method], path, len, params);
+}
@@ -0,0 +1,91 @@
+#ifndef HTTP_ROUTER_H_
+#define HTTP_ROUTER_H_
+
+// Description: Header file for router (按请求方法分开的压缩前缀树，匹配时不分配内存)
+
+#include <stddef.h>
+
+#include "parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HTTP_ROUTER_MAX_PARAMS 16
+
+/**
+ * @brief 请求方法
+ */
+typedef enum HttpMethod {
+    HTTP_GET = 0,
+    HTTP_HEAD,
+    HTTP_POST,
+    HTTP_PUT,
+    HTTP_DELETE,
+    HTTP_CONNECT,
+    HTTP_OPTIONS,
+    HTTP_TRACE,
+    HTTP_PATCH,
+    HTTP_METHOD_COUNT,
+    HTTP_METHOD_UNKNOWN = -1,
+} HttpMethod;
+
+/**
+ * @brief 路径参数，name 指向路由树(以\0结尾)，value 指向请求路径
+ */
+typedef struct HttpRouteParam {
+    HttpSlice name;
+    HttpSlice value;
+} HttpRouteParam;
+
+typedef struct HttpRouteParams {
+    HttpRouteParam items[HTTP_ROUTER_MAX_PARAMS];
+    int count;
+} HttpRouteParams;
+
+typedef struct HttpRouter HttpRouter;
+
+/**
+ * @brief 识别请求方法
+ * @return 不认识的方法返回 HTTP_METHOD_UNKNOWN
+ */
+HttpMethod http_method_parse(const char *method, size_t len);
+
+/**
+ * @brief 创建路由器
+ * @return 失败返回NULL
+ */
+HttpRouter *http_router_new();
+
+/**
+ * @brief 销毁路由器
+ */
+void http_router_destroy(HttpRouter *router);
+
+/**
+ * @brief 添加路由，只能在开始匹配之前、冻结之前调用
+ * @param pattern 以'/'开头，支持静态路径、":name" 匹配一段、"*name" 匹配剩余部分(只能在结尾)
+ * @return 成功返回0, 路由非法或与已有路由冲突返回-1
+ */
+int http_router_add(HttpRouter *router, HttpMethod method, const char *pattern, void *handle);
+
+/**
+ * @brief 把所有静态路由编译为只读的最小完美哈希表，完全匹配的请求只需一次哈希和一次比较。
+ *        冻结后不能再添加路由，可以由多个线程无锁共享
+ * @return 成功返回0, 失败返回-1(此时仍使用路由树匹配)
+ */
+int http_router_freeze(HttpRouter *router);
+
+/**
+ * @brief 匹配路由，静态路径优先于 :param，:param 优先于 *wildcard。
+ *        路径中 '?' 之后的部分忽略。只读，可以在多个线程中同时调用
+ * @param params 输出路径参数，可以为NULL
+ * @return 匹配到的 handle，没有时返回NULL
+ */
+void *http_router_match(const HttpRouter *router, HttpMethod method, const char *path, size_t len, HttpRouteParams *params);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HTTP_ROUTER_H_ */
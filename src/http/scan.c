@@ -0,0 +1,298 @@
+#include <stdlib.h>
+#include <immintrin.h>
+
+#include "scan.h"
+
+// ====================================================================
+// ============================ TABLES ================================
+// ====================================================================
+
+/**
+ * @brief RFC 9110 token 字符表
+ */
+const char http_token_chars[256] = {
+    ['!'] = 1, ['#'] = 1, ['$'] = 1, ['%'] = 1, ['&'] = 1, ['\''] = 1, ['*'] = 1,
+    ['+'] = 1, ['-'] = 1, ['.'] = 1, ['^'] = 1, ['_'] = 1, ['`'] = 1, ['|'] = 1, ['~'] = 1,
+    ['0' ... '9'] = 1, ['A' ... 'Z'] = 1, ['a' ... 'z'] = 1,
+};
+
+/**
+ * @brief 请求行中的 path/version 允许除空白和控制字符之外的所有字符
+ */
+static const char VCHARS[256] = {
+    [0x21 ... 0x7e] = 1, [0x80 ... 0xff] = 1,
+};
+
+/**
+ * @brief 请求头的值允许空格、制表符和 obs-text
+ */
+static const char VALUE_CHARS[256] = {
+    ['\t'] = 1, [0x20 ... 0x7e] = 1, [0x80 ... 0xff] = 1,
+};
+
+/**
+ * @brief token 字符按高低4位拆成的两张表，用 pshufb 查表分类
+ * @details 高4位只有 2~7 可能是 token，每个高4位占一个 bit；
+ *          某字节是 token 当且仅当 TOKEN_LO[低4位] & TOKEN_HI[高4位] 不为0。
+ *          由 http_token_chars 生成，修改 token 表时需要同步
+ */
+static const char TOKEN_LO[16] __attribute__((aligned(16))) = {
+    0x3a, 0x3f, 0x3e, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3e, 0x3e, 0x3d, 0x15, 0x34, 0x15, 0x3d, 0x1c,
+};
+static const char TOKEN_HI[16] __attribute__((aligned(16))) = {
+    0x00, 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20,
+};
+
+// ====================================================================
+// ============================ SCALAR ================================
+// ====================================================================
+
+static size_t _scan_token_scalar(const char *data, size_t len){
+    size_t i = 0;
+    while (i < len && http_token_chars[(unsigned char)data[i]]) i++;
+    return i;
+}
+
+static size_t _scan_vchar_scalar(const char *data, size_t len){
+    size_t i = 0;
+    while (i < len && VCHARS[(unsigned char)data[i]]) i++;
+    return i;
+}
+
+static size_t _scan_value_scalar(const char *data, size_t len){
+    size_t i = 0;
+    while (i < len && VALUE_CHARS[(unsigned char)data[i]]) i++;
+    return i;
+}
+
+// ====================================================================
+// ============================ SSE4.2 ================================
+// ====================================================================
+
+__attribute__((target("sse4.2")))
+static size_t _scan_token_sse42(const char *data, size_t len){
+    const __m128i lo_tbl = _mm_load_si128((const __m128i *)TOKEN_LO);
+    const __m128i hi_tbl = _mm_load_si128((const __m128i *)TOKEN_HI);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+
+    size_t i = 0;
+    for(; i + 16 <= len; i += 16){
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i lo = _mm_shuffle_epi8(lo_tbl, _mm_and_si128(v, nibble));
+        __m128i hi = _mm_shuffle_epi8(hi_tbl, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+        __m128i bad = _mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128());
+        unsigned mask = _mm_movemask_epi8(bad);
+        if(mask){
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + _scan_token_scalar(data + i, len - i);
+}
+
+/**
+ * @brief pcmpestri 按区间查找，ranges 中每两个字节是一个闭区间
+ */
+__attribute__((target("sse4.2")))
+static size_t _scan_ranges_sse42(const char *data, size_t len, const char *ranges, int ranges_len,
+    size_t (*tail)(const char *, size_t)){
+    const __m128i r = _mm_loadu_si128((const __m128i *)ranges);
+
+    size_t i = 0;
+    for(; i + 16 <= len; i += 16){
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        int idx = _mm_cmpestri(r, ranges_len, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+        if(idx != 16){
+            return i + idx;
+        }
+    }
+    return i + tail(data + i, len - i);
+}
+
+__attribute__((target("sse4.2")))
+static size_t _scan_vchar_sse42(const char *data, size_t len){
+    static const char ranges[16] = { 0x00, 0x20, 0x7f, 0x7f };
+    return _scan_ranges_sse42(data, len, ranges, 4, _scan_vchar_scalar);
+}
+
+__attribute__((target("sse4.2")))
+static size_t _scan_value_sse42(const char *data, size_t len){
+    static const char ranges[16] = { 0x00, 0x08, 0x0a, 0x1f, 0x7f, 0x7f };
+    return _scan_ranges_sse42(data, len, ranges, 6, _scan_value_scalar);
+}
+
+// ====================================================================
+// ============================= AVX2 =================================
+// ====================================================================
+
+// AVX2 实现的剩余部分也在 avx2 目标下编译(VEX 编码)，
+// 避免调用 SSE 实现时脏的高128位带来的状态切换开销
+
+__attribute__((target("avx2")))
+static inline unsigned _token_mask_avx2(__m256i v){
+    const __m256i lo_tbl = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)TOKEN_LO));
+    const __m256i hi_tbl = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)TOKEN_HI));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    __m256i lo = _mm256_shuffle_epi8(lo_tbl, _mm256_and_si256(v, nibble));
+    __m256i hi = _mm256_shuffle_epi8(hi_tbl, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256()));
+}
+
+__attribute__((target("avx2")))
+static inline unsigned _vchar_mask_avx2(__m256i v){
+    // 无符号 v <= 0x20 等价于 min(v, 0x20) == v
+    __m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x20)), v);
+    return _mm256_movemask_epi8(_mm256_or_si256(ctl, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7f))));
+}
+
+__attribute__((target("avx2")))
+static inline unsigned _value_mask_avx2(__m256i v){
+    __m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1f)), v);
+    ctl = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')), ctl);
+    return _mm256_movemask_epi8(_mm256_or_si256(ctl, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7f))));
+}
+
+/**
+ * @brief 每次32字节，不足32字节时把剩余部分放到一个零扩展的寄存器里，只看有效的位
+ */
+#define SCAN_AVX2_BODY(mask_fn, tail_fn)                                            \
+    size_t i = 0;                                                                   \
+    for(; i + 32 <= len; i += 32){                                                  \
+        unsigned mask = mask_fn(_mm256_loadu_si256((const __m256i *)(data + i)));   \
+        if(mask){                                                                   \
+            return i + __builtin_ctz(mask);                                         \
+        }                                                                           \
+    }                                                                               \
+    if(i + 16 <= len){                                                              \
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));                   \
+        unsigned mask = mask_fn(_mm256_zextsi128_si256(v)) & 0xffff;                \
+        if(mask){                                                                   \
+            return i + __builtin_ctz(mask);                                         \
+        }                                                                           \
+        i += 16;                                                                    \
+    }                                                                               \
+    return i + tail_fn(data + i, len - i);
+
+__attribute__((target("avx2")))
+static size_t _scan_token_avx2(const char *data, size_t len){
+    SCAN_AVX2_BODY(_token_mask_avx2, _scan_token_scalar)
+}
+
+__attribute__((target("avx2")))
+static size_t _scan_vchar_avx2(const char *data, size_t len){
+    SCAN_AVX2_BODY(_vchar_mask_avx2, _scan_vchar_scalar)
+}
+
+__attribute__((target("avx2")))
+static size_t _scan_value_avx2(const char *data, size_t len){
+    SCAN_AVX2_BODY(_value_mask_avx2, _scan_value_scalar)
+}
+
+// ====================================================================
+// =========================== DISPATCH ===============================
+// ====================================================================
+
+typedef size_t (*ScanHandle)(const char *, size_t);
+
+static size_t _scan_token_resolve(const char *data, size_t len);
+static size_t _scan_vchar_resolve(const char *data, size_t len);
+static size_t _scan_value_resolve(const char *data, size_t len);
+
+// 首次调用时替换为具体实现，重复选择的结果相同，不需要加锁
+static ScanHandle scan_token = _scan_token_resolve;
+static ScanHandle scan_vchar = _scan_vchar_resolve;
+static ScanHandle scan_value = _scan_value_resolve;
+static int scan_level = -1;
+
+/**
+ * @brief CPU 是否支持指定实现
+ */
+static int _http_scan_supported(HttpScanLevel level){
+    __builtin_cpu_init();
+    switch (level)
+    {
+        case HTTP_SCAN_AVX2:
+            return __builtin_cpu_supports("avx2");
+        case HTTP_SCAN_SSE42:
+            return __builtin_cpu_supports("sse4.2");
+        case HTTP_SCAN_SCALAR:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief 强制使用指定实现
+ */
+int http_scan_set_level(HttpScanLevel level){
+    if(!_http_scan_supported(level)){
+        return -1;
+    }
+
+    switch (level)
+    {
+        case HTTP_SCAN_AVX2:
+            scan_token = _scan_token_avx2;
+            scan_vchar = _scan_vchar_avx2;
+            scan_value = _scan_value_avx2;
+            break;
+        case HTTP_SCAN_SSE42:
+            scan_token = _scan_token_sse42;
+            scan_vchar = _scan_vchar_sse42;
+            scan_value = _scan_value_sse42;
+            break;
+        default:
+            scan_token = _scan_token_scalar;
+            scan_vchar = _scan_vchar_scalar;
+            scan_value = _scan_value_scalar;
+            break;
+    }
+    scan_level = level;
+    return 0;
+}
+
+/**
+ * @brief 按CPU特性选择最快的实现
+ */
+static void _http_scan_resolve(){
+    if(http_scan_set_level(HTTP_SCAN_AVX2) == 0) return;
+    if(http_scan_set_level(HTTP_SCAN_SSE42) == 0) return;
+    http_scan_set_level(HTTP_SCAN_SCALAR);
+}
+
+static size_t _scan_token_resolve(const char *data, size_t len){
+    _http_scan_resolve();
+    return scan_token(data, len);
+}
+
+static size_t _scan_vchar_resolve(const char *data, size_t len){
+    _http_scan_resolve();
+    return scan_vchar(data, len);
+}
+
+static size_t _scan_value_resolve(const char *data, size_t len){
+    _http_scan_resolve();
+    return scan_value(data, len);
+}
+
+/**
+ * @brief 当前使用的实现
+ */
+HttpScanLevel http_scan_level(){
+    if(scan_level < 0){
+        _http_scan_resolve();
+    }
+    return scan_level;
+}
+
+size_t http_scan_token(const char *data, size_t len){
+    return scan_token(data, len);
+}
+
+size_t http_scan_vchar(const char *data, size_t len){
+    return scan_vchar(data, len);
+}
+
+size_t http_scan_value(const char *data, size_t len){
+    return scan_value(data, len);
+}
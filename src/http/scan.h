@@ -0,0 +1,56 @@
+#ifndef HTTP_SCAN_H_
+#define HTTP_SCAN_H_
+
+// Description: Header file for scan (SIMD 分隔符扫描，运行时按CPU选择实现)
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief 扫描实现
+ */
+typedef enum HttpScanLevel {
+    HTTP_SCAN_SCALAR = 0,
+    HTTP_SCAN_SSE42,    // 每次16字节
+    HTTP_SCAN_AVX2,     // 每次32字节
+} HttpScanLevel;
+
+/**
+ * @brief RFC 9110 token 字符表，用于方法和请求头名称
+ */
+extern const char http_token_chars[256];
+
+/**
+ * @brief 返回第一个不是 token 字符的下标(通常是 ' ' 或 ':')，全部是时返回 len
+ */
+size_t http_scan_token(const char *data, size_t len);
+
+/**
+ * @brief 返回第一个空白或控制字符的下标，用于请求行中的 path 和 version
+ */
+size_t http_scan_vchar(const char *data, size_t len);
+
+/**
+ * @brief 返回第一个不允许出现在请求头值中的字符的下标(通常是 '\r' 或 '\n')
+ */
+size_t http_scan_value(const char *data, size_t len);
+
+/**
+ * @brief 当前使用的实现，首次调用时按CPU特性选择
+ */
+HttpScanLevel http_scan_level();
+
+/**
+ * @brief 强制使用指定实现，用于基准测试
+ * @return 成功返回0, CPU不支持返回-1
+ */
+int http_scan_set_level(HttpScanLevel level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HTTP_SCAN_H_ */
@@ -0,0 +1,187 @@
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include "deque.h"
+
+#define CACHE_LINE 64
+
+// =========================================================================
+// ==============================  DEQUE  ==================================
+// =========================================================================
+
+/**
+ * @brief 环形数组，扩容后旧数组可能仍在被窃取线程读取，保留到队列销毁时再释放
+ */
+typedef struct DequeArray {
+    long mask;
+    struct DequeArray *retired; // 被替换掉的旧数组
+    _Atomic(void *) data[];
+} DequeArray;
+
+/**
+ * @brief Chase-Lev 队列 (Lê et al., "Correct and Efficient Work-Stealing for Weak Memory Models")
+ */
+typedef struct Deque {
+    _Alignas(CACHE_LINE) atomic_long top;       // 窃取端
+    _Alignas(CACHE_LINE) atomic_long bottom;    // 拥有者端
+    _Atomic(DequeArray *) array;
+} Deque;
+
+static DequeArray *_deque_array_new(long capacity){
+    DequeArray *array = malloc(sizeof(DequeArray) + sizeof(void *) * capacity);
+    if(array == NULL){
+        return NULL;
+    }
+    array->mask = capacity - 1;
+    array->retired = NULL;
+    return array;
+}
+
+/**
+ * @brief 创建队列
+ * @return 失败返回NULL
+ */
+Deque *deque_new(int capacity){
+    long cap = 16;
+    while (cap < capacity) cap <<= 1;
+
+    Deque *deque = aligned_alloc(CACHE_LINE, sizeof(Deque));
+    if(deque == NULL){
+        return NULL;
+    }
+    DequeArray *array = _deque_array_new(cap);
+    if(array == NULL){
+        free(deque);
+        return NULL;
+    }
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    atomic_init(&deque->array, array);
+    return deque;
+}
+
+/**
+ * @brief 销毁队列，调用时不能有其他线程在访问
+ */
+void deque_destroy(Deque *deque, int free_entries){
+    if(deque == NULL) return;
+
+    DequeArray *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+    if(free_entries){
+        long t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+        long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+        for(; t < b; t++){
+            free(atomic_load_explicit(&array->data[t & array->mask], memory_order_relaxed));
+        }
+    }
+
+    while (array)
+    {
+        DequeArray *retired = array->retired;
+        free(array);
+        array = retired;
+    }
+    free(deque);
+}
+
+/**
+ * @brief 扩容为两倍，只由拥有者线程调用
+ */
+static DequeArray *_deque_grow(Deque *deque, DequeArray *array, long top, long bottom){
+    DequeArray *bigger = _deque_array_new((array->mask + 1) * 2);
+    if(bigger == NULL){
+        return NULL;
+    }
+    for(long i = top; i < bottom; i++){
+        void *entry = atomic_load_explicit(&array->data[i & array->mask], memory_order_relaxed);
+        atomic_store_explicit(&bigger->data[i & bigger->mask], entry, memory_order_relaxed);
+    }
+    bigger->retired = array;
+    atomic_store_explicit(&deque->array, bigger, memory_order_release);
+    return bigger;
+}
+
+/**
+ * @brief 拥有者线程在底部压入
+ * @return 成功返回0, 扩容失败返回-1
+ */
+int deque_push(Deque *deque, void *entry){
+    long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&deque->top, memory_order_acquire);
+    DequeArray *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+
+    if(b - t > array->mask){
+        array = _deque_grow(deque, array, t, b);
+        if(array == NULL){
+            return -1;
+        }
+    }
+    atomic_store_explicit(&array->data[b & array->mask], entry, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_release);
+    return 0;
+}
+
+/**
+ * @brief 拥有者线程从底部取出
+ * @return 成功返回1, 为空返回 DEQUE_EMPTY
+ */
+int deque_pop(Deque *deque, void **entry){
+    long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    DequeArray *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if(t > b){
+        // 已经为空
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+        *entry = NULL;
+        return DEQUE_EMPTY;
+    }
+
+    *entry = atomic_load_explicit(&array->data[b & array->mask], memory_order_relaxed);
+    if(t == b){
+        // 最后一个条目，和窃取线程竞争
+        int won = atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+            memory_order_seq_cst, memory_order_relaxed);
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+        if(!won){
+            *entry = NULL;
+            return DEQUE_EMPTY;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief 其他线程从顶部窃取
+ * @return 成功返回1, 为空返回 DEQUE_EMPTY, 竞争失败返回 DEQUE_ABORT
+ */
+int deque_steal(Deque *deque, void **entry){
+    long t = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+    *entry = NULL;
+    if(t >= b){
+        return DEQUE_EMPTY;
+    }
+
+    DequeArray *array = atomic_load_explicit(&deque->array, memory_order_acquire);
+    void *value = atomic_load_explicit(&array->data[t & array->mask], memory_order_relaxed);
+    if(!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+        memory_order_seq_cst, memory_order_relaxed)){
+        return DEQUE_ABORT;
+    }
+    *entry = value;
+    return 1;
+}
+
+/**
+ * @brief 当前条目数量的近似值
+ */
+int deque_size(Deque *deque){
+    long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+    return b > t ? (int)(b - t) : 0;
+}
@@ -0,0 +1,59 @@
+#ifndef DEQUE_H_
+#define DEQUE_H_
+
+// Description: Header file for deque (Chase-Lev 工作窃取双端队列)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DEQUE_EMPTY 0
+#define DEQUE_ABORT -1   // 与其他线程竞争失败，可以重试
+
+/**
+ * @brief 工作窃取队列，只有拥有者线程可以 push/pop(在底部，后进先出)，
+ *        其他线程可以并发 steal(在顶部，先进先出)。无锁，容量不够时自动扩容
+ */
+typedef struct Deque Deque;
+
+/**
+ * @brief 创建队列
+ * @param capacity 初始容量，会向上取整为2的幂
+ * @return 失败返回NULL
+ */
+Deque *deque_new(int capacity);
+
+/**
+ * @brief 销毁队列，调用时不能有其他线程在访问
+ * @param free_entries 释放所有条目 1:是，0:否
+ */
+void deque_destroy(Deque *deque, int free_entries);
+
+/**
+ * @brief 拥有者线程在底部压入
+ * @return 成功返回0, 扩容失败返回-1
+ */
+int deque_push(Deque *deque, void *entry);
+
+/**
+ * @brief 拥有者线程从底部取出
+ * @return 成功返回1, 为空返回 DEQUE_EMPTY
+ */
+int deque_pop(Deque *deque, void **entry);
+
+/**
+ * @brief 其他线程从顶部窃取
+ * @return 成功返回1, 为空返回 DEQUE_EMPTY, 竞争失败返回 DEQUE_ABORT
+ */
+int deque_steal(Deque *deque, void **entry);
+
+/**
+ * @brief 当前条目数量的近似值
+ */
+int deque_size(Deque *deque);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DEQUE_H_ */
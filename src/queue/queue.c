@@ -1,161 +1,262 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <pthread.h>
+#include <stddef.h>
+#include <stdatomic.h>
 
 #include "queue.h"
+
+#define CACHE_LINE 64
+
 // =========================================================================
 // ==============================  QUEUE  ==================================
 // =========================================================================
 
 /**
- * @brief 队列结构体，包含队列数据、前后指针、大小和容量
+ * @brief 队列中的一个位置
+ * @details seq 表示这个位置当前可以做什么：
+ *          seq == pos 时可以写入第 pos 个条目，seq == pos+1 时可以读出，
+ *          读出后设为 pos+capacity，供下一圈写入
+ */
+typedef struct QueueCell {
+    atomic_size_t seq;
+    void *data;
+} QueueCell;
+
+/**
+ * @brief Vyukov 有界多生产者多消费者队列，入队和出队位置各占一条缓存行
  */
 typedef struct Queue {
-    void **data;        // Pointer to the queue data
-    int front;       // Index of the front element
-    int rear;        // Index of the rear element
-    int size;        // Current size of the queue
+    _Alignas(CACHE_LINE) atomic_size_t enqueue_pos;
+    _Alignas(CACHE_LINE) atomic_size_t dequeue_pos;
+    _Alignas(CACHE_LINE) QueueCell *cells;
+    size_t mask;
     int capacity;    // Maximum capacity of the queue
-    pthread_mutex_t mutex; // Mutex for thread safety
-    int destroyed; // Flag to indicate if the queue is destroyed
 } Queue;
 
 /// @brief 创建一个队列
-/// @param capacity 
-/// @return 
+/// @param capacity
+/// @return
 Queue *queue_new(int capacity) {
-    Queue *queue = (Queue *)malloc(sizeof(Queue));
+    if (capacity <= 0) {
+        return NULL;
+    }
+    size_t cap = 2;
+    while (cap < (size_t)capacity) cap <<= 1;
+
+    Queue *queue = aligned_alloc(CACHE_LINE, sizeof(Queue));
     if (queue == NULL) {
         return NULL; // Memory allocation failed
     }
 
-    queue->data = (void *)malloc(capacity * sizeof(void *));
-    if (queue->data == NULL) {
+    queue->cells = aligned_alloc(CACHE_LINE, (cap * sizeof(QueueCell) + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1));
+    if (queue->cells == NULL) {
+        free(queue);
         return NULL; // Memory allocation failed
     }
 
-    pthread_mutex_init(&queue->mutex, NULL); // Initialize the mutex
-
-    queue->front = 0;
-    queue->rear = 0;
-    queue->size = 0;
-    queue->capacity = capacity;
-    queue->destroyed = 0; // Initialize the destroyed flag to 0
-    
+    for (size_t i = 0; i < cap; i++) {
+        atomic_init(&queue->cells[i].seq, i);
+        queue->cells[i].data = NULL;
+    }
+    atomic_init(&queue->enqueue_pos, 0);
+    atomic_init(&queue->dequeue_pos, 0);
+    queue->mask = cap - 1;
+    queue->capacity = (int)cap;
 
     return queue; // Return the pointer to the newly created queue
 }
 
-/// @brief 销毁一个队列
-/// @param queue 
+/// @brief 销毁一个队列，调用时不能有其他线程在访问
+/// @param queue
 void queue_destroy(Queue *queue,int free_entries) {
-    if (queue == NULL || queue->destroyed) {
-        return; // If the queue is NULL or already destroyed, do nothing
+    if (queue == NULL) {
+        return;
     }
 
-    queue->destroyed = 1; // Set the destroyed flag to 1
-
-    if (queue->data != NULL) {
-        if(free_entries){
-            for(int i=0; i< queue->capacity;i++){
-                if(queue->data[i] != NULL){
-                    free(queue->data[i]);
-                }
-            }
+    if(free_entries){
+        void *entry;
+        while (queue_dequeue(queue, &entry) == 0)
+        {
+            free(entry);
         }
-        
-
-        free(queue->data);
-        queue->data = NULL;
     }
-    pthread_mutex_destroy(&queue->mutex); // Destroy the mutex
 
-    queue->front = 0;
-    queue->rear = 0;
-    queue->size = 0;
-    queue->capacity = 0;
+    free(queue->cells);
+    queue->cells = NULL;
     free(queue);
 }
 
 /// @brief 将一个条目入队，加入队列最后一个
 /// @param queue 队列
 /// @param entry 条目
-/// @return 是否成功入列 0：是 !=：否
+/// @return 成功返回0, 队列已满返回-1
 int queue_enqueue(Queue *queue, void *entry) {
-    if (queue_is_full(queue)) {
-        return -1;
+    size_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+    for (;;) {
+        QueueCell *cell = &queue->cells[pos & queue->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)pos;
+        if (diff == 0) {
+            // 位置空闲，抢占这个位置；失败时 pos 被更新为最新值
+            if (atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &pos, pos + 1,
+                memory_order_relaxed, memory_order_relaxed)) {
+                cell->data = entry;
+                atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+                return 0;
+            }
+        } else if (diff < 0) {
+            return -1; // 上一圈的条目还没有被取走，队列已满
+        } else {
+            pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * @brief 批量入队，一次原子操作占用连续的位置
+ * @return 成功入队的数量
+ */
+int queue_enqueue_bulk(Queue *queue, void **entries, int count) {
+    if (count <= 0) {
+        return 0;
     }
 
-    pthread_mutex_lock(&queue->mutex); // Lock the mutex for thread safety
-    if (queue->destroyed) {
-        pthread_mutex_unlock(&queue->mutex); // Unlock the mutex before returning
-        return -1; // If the queue is destroyed, do not enqueue
+    size_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+    int n;
+    for (;;) {
+        // 数出从 pos 开始连续空闲的位置，位置只会从占用变为空闲，抢占成功后仍然空闲
+        for (n = 0; n < count; n++) {
+            QueueCell *cell = &queue->cells[(pos + n) & queue->mask];
+            size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+            if (seq != pos + n) {
+                break;
+            }
+        }
+
+        if (n == 0) {
+            QueueCell *cell = &queue->cells[pos & queue->mask];
+            ptrdiff_t diff = (ptrdiff_t)atomic_load_explicit(&cell->seq, memory_order_acquire) - (ptrdiff_t)pos;
+            if (diff < 0) {
+                return 0; // 已满
+            }
+            pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+            continue;
+        }
+
+        if (atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &pos, pos + n,
+            memory_order_relaxed, memory_order_relaxed)) {
+            break;
+        }
     }
 
-    queue->data[queue->rear] = entry;
-    queue->rear = (queue->rear + 1) % queue->capacity;
-    queue->size++;
-    pthread_mutex_unlock(&queue->mutex); // Unlock the mutex
-    return 0;
+    for (int i = 0; i < n; i++) {
+        QueueCell *cell = &queue->cells[(pos + i) & queue->mask];
+        cell->data = entries[i];
+        atomic_store_explicit(&cell->seq, pos + i + 1, memory_order_release);
+    }
+    return n;
 }
 
 /// @brief 将一个条目出队，取出丢列第一个条目
 /// @param queue 需要被出队的队列
 /// @param entry 成功
-/// @return 是否成功出列 1：是 0：否
+/// @return 成功返回0, 队列为空返回-1
 int queue_dequeue(Queue *queue, void **entry) {
-    if (queue_size(queue) == 0) {
-        *entry = NULL;
-        return -1;
+    size_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+    for (;;) {
+        QueueCell *cell = &queue->cells[pos & queue->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->dequeue_pos, &pos, pos + 1,
+                memory_order_relaxed, memory_order_relaxed)) {
+                *entry = cell->data;
+                cell->data = NULL;
+                atomic_store_explicit(&cell->seq, pos + queue->mask + 1, memory_order_release);
+                return 0;
+            }
+        } else if (diff < 0) {
+            *entry = NULL;
+            return -1; // 还没有写入，队列为空
+        } else {
+            pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+        }
     }
+}
 
-    pthread_mutex_lock(&queue->mutex); // Lock the mutex for thread safety
-    if (queue->destroyed) {
-        pthread_mutex_unlock(&queue->mutex); // Unlock the mutex before returning
-        *entry = NULL; // If the queue is destroyed, set entry to NULL
-        return -1; // If the queue is destroyed, do not dequeue
+/**
+ * @brief 批量出队，一次原子操作取走连续的多个条目
+ * @return 成功出队的数量
+ */
+int queue_dequeue_bulk(Queue *queue, void **entries, int max) {
+    if (max <= 0) {
+        return 0;
     }
-    *entry = queue->data[queue->front];
-    queue->front = (queue->front + 1) % queue->capacity;
-    queue->size--;
-    queue->data[queue->front]= NULL;
-    pthread_mutex_unlock(&queue->mutex); // Unlock the mutex
-    return 0;
+
+    size_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+    int n;
+    for (;;) {
+        // 数出从 pos 开始连续已写入的条目
+        for (n = 0; n < max; n++) {
+            QueueCell *cell = &queue->cells[(pos + n) & queue->mask];
+            size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+            if (seq != pos + n + 1) {
+                break;
+            }
+        }
+
+        if (n == 0) {
+            QueueCell *cell = &queue->cells[pos & queue->mask];
+            ptrdiff_t diff = (ptrdiff_t)atomic_load_explicit(&cell->seq, memory_order_acquire) - (ptrdiff_t)(pos + 1);
+            if (diff < 0) {
+                return 0; // 为空
+            }
+            pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+            continue;
+        }
+
+        if (atomic_compare_exchange_weak_explicit(&queue->dequeue_pos, &pos, pos + n,
+            memory_order_relaxed, memory_order_relaxed)) {
+            break;
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        QueueCell *cell = &queue->cells[(pos + i) & queue->mask];
+        entries[i] = cell->data;
+        cell->data = NULL;
+        atomic_store_explicit(&cell->seq, pos + i + queue->mask + 1, memory_order_release);
+    }
+    return n;
 }
 
 /**
- * @brief 获取队列的头部元素
+ * @brief 获取队列的头部元素，并发出队时结果只是一个快照
  * @param queue 需要获取头部元素的队列
  * @param entry 存储头部元素的指针
- * @return 如果队列不为空，返回1并将头部元素存储在entry中；如果队列为空，返回0并将entry设置为NULL
+ * @return 如果队列不为空，返回0并将头部元素存储在entry中；如果队列为空，返回-1并将entry设置为NULL
  */
 int queue_peek(Queue *queue, void **entry) {
-    if (queue == NULL || queue->destroyed) {
-        *entry = NULL; // If the queue is NULL or destroyed, set entry to NULL
-        return -1; 
+    if (queue == NULL) {
+        *entry = NULL;
+        return -1;
     }
 
-    if (queue->size == 0) {
+    size_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_acquire);
+    QueueCell *cell = &queue->cells[pos & queue->mask];
+    if (atomic_load_explicit(&cell->seq, memory_order_acquire) != pos + 1) {
         *entry = NULL;
-        return -1; 
-    }
-    pthread_mutex_lock(&queue->mutex); // Lock the mutex for thread safety
-    if (queue->destroyed) {
-        pthread_mutex_unlock(&queue->mutex); // Unlock the mutex before returning
-        free(entry);
-        *entry = NULL; // If the queue is destroyed, set entry to NULL
-        return -1; // If the queue is destroyed, do not peek
+        return -1;
     }
-    *entry = queue->data[queue->front]; // Get the front element
-    pthread_mutex_unlock(&queue->mutex); // Unlock the mutex
-    return 0; // Successfully retrieved the front element   
-}       
+    *entry = cell->data; // Get the front element
+    return 0; // Successfully retrieved the front element
+}
 
 /// @brief 判断队列是否为空
 /// @param queue 需要判断的队列
 /// @return >=1:空 0:非空
 int queue_is_empty(const Queue *queue) {
-    return queue->rear == queue->front;
+    return queue_size(queue) == 0;
 }
 
 
@@ -163,7 +264,7 @@ int queue_is_empty(const Queue *queue) {
 /// @param queue 需要判断的队列
 /// @return >=1:满 0:未满
 int queue_is_full(const Queue *queue){
-    return ((queue->rear+1)%queue->capacity) == queue->front;
+    return queue_size(queue) >= queue->capacity;
 }
 
 
@@ -173,9 +274,14 @@ int queue_is_full(const Queue *queue){
  * @return 队列的当前大小
  */
 int queue_size(const Queue *queue){
-    if (queue == NULL || queue->destroyed) {
-        return 0; // If the queue is NULL or destroyed, return 0
+    if (queue == NULL) {
+        return 0;
     }
-    return queue->size; // Return the current size of the queue
+    // 先读出队位置，保证结果不为负
+    size_t head = atomic_load_explicit((atomic_size_t *)&queue->dequeue_pos, memory_order_acquire);
+    size_t tail = atomic_load_explicit((atomic_size_t *)&queue->enqueue_pos, memory_order_acquire);
+    ptrdiff_t size = (ptrdiff_t)(tail - head);
+    if (size < 0) size = 0;
+    if (size > queue->capacity) size = queue->capacity;
+    return (int)size;
 }
-
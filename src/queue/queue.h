@@ -1,7 +1,7 @@
 #ifndef QUEUE_H_
 #define QUEUE_H_
 
-// Description: Header file for queue
+// Description: Header file for queue (有界无锁多生产者多消费者队列)
 
 #ifdef __cplusplus
 extern "C" {
@@ -9,19 +9,19 @@ extern "C" {
 
 
 /**
- * @brief 队列结构体，包含队列数据、前后指针、大小和容量
+ * @brief 队列结构体，所有操作都是线程安全且无锁的
  */
 typedef struct Queue Queue;
 
 /**
  * @brief 创建一个队列
- * @param capacity 队列的最大容量
+ * @param capacity 队列的最大容量，会向上取整为2的幂
  * @return 返回一个指向新创建队列的指针，创建失败时返回
  */
 Queue *queue_new(int capacity);
 
 /**
- * @brief 销毁队列
+ * @brief 销毁队列，调用时不能有其他线程在访问
  * @details 释放队列的内存，包括队列数据和队列本身
  * @param queue 需要销毁的队列
  * @param free_entries 释放所有条目 1:是，0:否
@@ -32,42 +32,54 @@ void queue_destroy(Queue *queue, int free_entries);
  * @brief 将一个条目入队，加入队列最后一个
  * @param queue 队列
  * @param entry 条目
- * @return 是否成功入列 1：是 0：否
+ * @return 成功返回0, 队列已满返回-1
  */
 int queue_enqueue(Queue *queue, void *entry);
 
+/**
+ * @brief 批量入队，一次原子操作占用连续的位置
+ * @return 成功入队的数量，队列空间不够时只入队前面一部分
+ */
+int queue_enqueue_bulk(Queue *queue, void **entries, int count);
+
 /**
  * @brief 将一个条目出队，取出丢列第一个条目
  * @param queue 需要被出队的队列
  * @param entry 成功出队的条目
- * @return 是否成功出列 1：是 0：否
+ * @return 成功返回0, 队列为空返回-1并将entry设置为NULL
  */
 int queue_dequeue(Queue *queue, void **entry);
 
 /**
- * @brief 获取队列的头部元素
+ * @brief 批量出队，一次原子操作取走连续的多个条目
+ * @return 成功出队的数量
+ */
+int queue_dequeue_bulk(Queue *queue, void **entries, int max);
+
+/**
+ * @brief 获取队列的头部元素，并发出队时结果只是一个快照
  * @param queue 需要获取头部元素的队列
  * @param entry 存储头部元素的指针
- * @return 如果队列不为空，返回1并将头部元素存储在task中；如果队列为空，返回0并将task设置为NULL
+ * @return 如果队列不为空，返回0并将头部元素存储在entry中；如果队列为空，返回-1并将entry设置为NULL
  */
 int queue_peek(Queue *queue, void **entry);
 
 /**
- * @brief 判断队列是否为空
+ * @brief 判断队列是否为空，并发时是近似值
  * @param queue 需要检查的队列
  * @return >=1:空 0:非空
  */
 int queue_is_empty(const Queue *queue);
 
 /**
- * @brief 判断队列是否已经满了
+ * @brief 判断队列是否已经满了，并发时是近似值
  * @param queue 需要判断的队列
  * @return >=1:满 0:未满
  */
 int queue_is_full(const Queue *queue);
 
 /**
- * @brief 获取队列的当前大小
+ * @brief 获取队列的当前大小，并发时是近似值
  * @param queue 需要获取大小的队列
  * @return 队列的当前大小
  */
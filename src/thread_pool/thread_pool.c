@@ -1,9 +1,16 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 #include "thread_pool.h"
 #include "../queue/queue.h"
+#include "../queue/deque.h"
 
 #define SUCCESS 0
 #define ERR_NONE -1
@@ -68,140 +75,262 @@ static void _task_destroy(ThreadTask *task){
 // ============================== THREAD POOL  =============================
 // =========================================================================
 
+#define CACHE_LINE 64
+#define DEQUE_CAPACITY 256
+#define SPIN_ROUNDS 16      // 休眠前重新查找任务的轮数
+
+typedef struct ThreadPool ThreadPool;
+
+/**
+ * @brief 工作线程，每个线程有自己的任务队列，空闲时从其他线程窃取
+ */
+typedef struct ThreadWorker {
+    _Alignas(CACHE_LINE) ThreadPool *pool;
+    int index;
+    pthread_t thread;
+    Deque *deque;       // 本线程提交的任务
+    unsigned int seed;  // 随机选择窃取对象
+} ThreadWorker;
+
 /// @brief 线程池结构体
 typedef struct ThreadPool{
-    pthread_t *threads;          // Pointer to the array of threads
-    pthread_mutex_t mutex;   // Mutex for thread synchronization
-    pthread_cond_t wakeup_cond; // Condition variable for waking up threads
-    Queue *queue;                // Pointer to the task queue
+    ThreadWorker *workers;
     int thread_count;            // Number of threads in the pool
+    Queue *queue;                // 池外线程提交的任务
     int queue_capacity;          // Maximum capacity of the task queue
-    int shutdown;
+    atomic_int shutdown;
     ThreadPoolAfterTaskHandle after_task_handle;
+
+    // 休眠/唤醒(eventcount): 休眠前先记下 epoch 再检查一次任务，
+    // 提交任务后若有线程休眠则增加 epoch 并唤醒，不需要全局锁
+    _Alignas(CACHE_LINE) atomic_uint epoch;
+    atomic_int sleepers;
 } ThreadPool;
 
 /**
- * @brief 线程函数，执行任务队列中的任务
- * @param pool 线程池指针
- * @return 返回 NULL
+ * @brief 当前线程所属的工作线程，池外线程为NULL
+ */
+static __thread ThreadWorker *current_worker;
+
+static void _futex_wait(atomic_uint *addr, unsigned int val){
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void _futex_wake(atomic_uint *addr, int count){
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+/**
+ * @brief 有新任务时唤醒一个休眠的线程，没有线程休眠时不做系统调用
  */
-static void *_thread_handle(ThreadPool *pool) {
-    
-    while (1) {
-        pthread_mutex_lock(&pool->mutex);
-        while (queue_is_empty(pool->queue) && !pool->shutdown) {
-            pthread_cond_wait(&pool->wakeup_cond, &pool->mutex);
+static void _thread_pool_notify(ThreadPool *pool){
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load_explicit(&pool->sleepers, memory_order_relaxed) > 0){
+        atomic_fetch_add_explicit(&pool->epoch, 1, memory_order_release);
+        _futex_wake(&pool->epoch, 1);
+    }
+}
+
+static unsigned int _thread_rand(ThreadWorker *worker){
+    unsigned int x = worker->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    worker->seed = x;
+    return x;
+}
+
+/**
+ * @brief 查找任务：先取自己的队列(后进先出)，再取池外提交的任务，最后从随机位置开始窃取
+ */
+static ThreadTask *_thread_find_task(ThreadWorker *worker){
+    ThreadPool *pool = worker->pool;
+    void *task;
+
+    if(deque_pop(worker->deque, &task) == 1){
+        return task;
+    }
+    if(queue_dequeue(pool->queue, &task) == 0 && task != NULL){
+        return task;
+    }
+
+    int n = pool->thread_count;
+    int retry;
+    do {
+        retry = 0;
+        int start = _thread_rand(worker) % n;
+        for(int i = 0; i < n; i++){
+            ThreadWorker *victim = &pool->workers[(start + i) % n];
+            if(victim == worker){
+                continue;
+            }
+            int rs = deque_steal(victim->deque, &task);
+            if(rs == 1){
+                return task;
+            }
+            if(rs == DEQUE_ABORT){
+                retry = 1;
+            }
         }
+    } while (retry);
+    return NULL;
+}
 
-        // 已经关闭直接推出
-        if (pool->shutdown) {
-            pthread_mutex_unlock(&pool->mutex);
-            break;
+/**
+ * @brief 执行任务并释放
+ */
+static void _thread_run_task(ThreadPool *pool, ThreadTask *task){
+    _task_run(task);
+    if(pool->after_task_handle != NULL){
+        pool->after_task_handle(task->arg);
+    }
+    _task_destroy(task);
+    free(task);
+}
+
+/**
+ * @brief 线程函数，执行任务队列中的任务，执行任务时不持有任何锁
+ * @param worker 工作线程
+ * @return 返回 NULL
+ */
+static void *_thread_handle(ThreadWorker *worker) {
+    ThreadPool *pool = worker->pool;
+    current_worker = worker;
+
+    while (!atomic_load_explicit(&pool->shutdown, memory_order_acquire)) {
+        ThreadTask *task = _thread_find_task(worker);
+        for(int spin = 0; task == NULL && spin < SPIN_ROUNDS; spin++){
+            sched_yield();
+            task = _thread_find_task(worker);
+        }
+        if(task != NULL){
+            _thread_run_task(pool, task);
+            continue;
         }
 
-       ThreadTask *task;
-       queue_dequeue(pool->queue, (void *)&task);
-        if(task != NULL) {
-           _task_run(task);
-           if(pool->after_task_handle != NULL){
-                pool->after_task_handle(task->arg);
-           }
-           _task_destroy(task);
-           free(task);
+        // 先登记为休眠再检查一次，和 _thread_pool_notify 配合不会丢失唤醒
+        unsigned int epoch = atomic_load_explicit(&pool->epoch, memory_order_acquire);
+        atomic_fetch_add_explicit(&pool->sleepers, 1, memory_order_seq_cst);
+        atomic_thread_fence(memory_order_seq_cst);
+        task = _thread_find_task(worker);
+        if(task == NULL && !atomic_load_explicit(&pool->shutdown, memory_order_acquire)){
+            _futex_wait(&pool->epoch, epoch);
         }
-        task = NULL;
+        atomic_fetch_sub_explicit(&pool->sleepers, 1, memory_order_relaxed);
 
-        pthread_mutex_unlock(&pool->mutex);
+        if(task != NULL){
+            _thread_run_task(pool, task);
+        }
     }
+    current_worker = NULL;
     return NULL;
 }
 
 /// @brief 创建线程池结构体
-/// @param thread_count 
-/// @param queue_capacity 
+/// @param thread_count 工作线程数
+/// @param queue_capacity 池外线程提交任务的队列容量
 /// @return 
 ThreadPool *threadpool_new(int thread_count, int queue_capacity, ThreadPoolAfterTaskHandle after_task_handle) {
-    ThreadPool *pool = (ThreadPool *)malloc(sizeof(ThreadPool));
+    if (thread_count <= 0) {
+        return NULL;
+    }
+
+    ThreadPool *pool = aligned_alloc(CACHE_LINE, sizeof(ThreadPool));
     if (pool == NULL) {
         return NULL; // Memory allocation failed
     }
 
-    pool->threads = (pthread_t *)malloc(thread_count * sizeof(pthread_t));
-    if (pool->threads == NULL) {
+    pool->workers = aligned_alloc(CACHE_LINE, thread_count * sizeof(ThreadWorker));
+    pool->queue = queue_new(queue_capacity);
+    if (pool->workers == NULL || pool->queue == NULL) {
+        free(pool->workers);
+        queue_destroy(pool->queue, 0);
         free(pool);
         return NULL; // Memory allocation failed
     }
 
-    pthread_mutex_init(&pool->mutex, NULL);
-    pthread_cond_init(&pool->wakeup_cond, NULL);
-
-    pool->queue = queue_new(queue_capacity);
     pool->thread_count = thread_count;
     pool->queue_capacity = queue_capacity;
-    pool->shutdown = 0; // Initialize shutdown flag to false
     pool->after_task_handle = after_task_handle;
+    atomic_init(&pool->shutdown, 0);
+    atomic_init(&pool->epoch, 0);
+    atomic_init(&pool->sleepers, 0);
+
+    for(int i = 0; i < thread_count; i++) {
+        ThreadWorker *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->index = i;
+        worker->seed = 2654435761u * (i + 1);
+        worker->deque = deque_new(DEQUE_CAPACITY);
+        if (worker->deque == NULL) {
+            for (int j = 0; j < i; j++) deque_destroy(pool->workers[j].deque, 0);
+            queue_destroy(pool->queue, 0);
+            free(pool->workers);
+            free(pool);
+            return NULL;
+        }
+    }
 
-    for(int i = 0; i < pool->thread_count; i++) {
-        pthread_create(&pool->threads[i], NULL, (void *(*)(void *))_thread_handle, pool);
+    // 所有队列就绪后再启动线程，工作线程会互相窃取
+    for(int i = 0; i < thread_count; i++) {
+        pthread_create(&pool->workers[i].thread, NULL, (void *(*)(void *))_thread_handle, &pool->workers[i]);
     }
 
     return pool;
 }
 
-/// @brief  销毁线程池
+/// @brief  销毁线程池，未执行的任务直接丢弃
 /// @param pool 
 void threadpool_destroy(ThreadPool *pool) {
     if (pool == NULL) return;
-    pthread_mutex_lock(&pool->mutex);
-    pool->shutdown = 1; // Set shutdown flag
-    pthread_cond_broadcast(&pool->wakeup_cond); // Wake up all threads
-    pthread_mutex_unlock(&pool->mutex);
+    atomic_store_explicit(&pool->shutdown, 1, memory_order_release);
+    atomic_fetch_add_explicit(&pool->epoch, 1, memory_order_release);
+    _futex_wake(&pool->epoch, INT_MAX); // Wake up all threads
 
     // 等待所有线程结束
     for (int i = 0; i < pool->thread_count; i++) {
-        pthread_join(pool->threads[i], NULL);
+        pthread_join(pool->workers[i].thread, NULL);
     }
 
     // Clean up resources
-    pthread_mutex_destroy(&pool->mutex);
-    pthread_cond_destroy(&pool->wakeup_cond);
-    free(pool->threads);
+    for (int i = 0; i < pool->thread_count; i++) {
+        deque_destroy(pool->workers[i].deque, 1);
+    }
+    free(pool->workers);
     queue_destroy(pool->queue, 1);
     free(pool);
 }
 
-/// @brief 添加任务到线程池
+/// @brief 添加任务到线程池。在工作线程中调用时放入本线程的队列，否则放入池外提交队列
 /// @param pool 
 /// @param task_handle 任务执行方法 
 /// @param arg 
 int threadpool_add_task(ThreadPool *pool, void *(*task_handle)(void *), void *arg) {
-     if (pool == NULL || task_handle == NULL) return ERR_NONE;
+    if (pool == NULL || task_handle == NULL) return ERR_NONE;
 
-    if(pool->shutdown) {
+    if(atomic_load_explicit(&pool->shutdown, memory_order_relaxed)) {
         return ERR_THREADPOOL_SHUTTING_DOWN;
     }
 
-    if(queue_is_full(pool->queue)) {
-        return ERR_THREADPOOL_QUEUE_FULL;
-    }
-
     ThreadTask *queue_task = _task_new(task_handle, arg);
     if (queue_task == NULL) {
         return ERR_THREADPOOL_MALLOC_TASK_FAIL;
     };
 
-    pthread_mutex_lock(&pool->mutex);
-    if(queue_enqueue(pool->queue, queue_task) < 0){
+    ThreadWorker *worker = current_worker;
+    int rs;
+    if(worker != NULL && worker->pool == pool){
+        rs = deque_push(worker->deque, queue_task);
+    }else{
+        rs = queue_enqueue(pool->queue, queue_task);
+    }
+    if(rs < 0){
         _task_destroy(queue_task);
         free(queue_task);
-        queue_task = NULL;
-        pthread_mutex_unlock(&pool->mutex);
         return ERR_THREADPOOL_QUEUE_FULL;
     }
 
-    queue_task = NULL;
-    pthread_cond_signal(&pool->wakeup_cond);
-    pthread_mutex_unlock(&pool->mutex);
+    _thread_pool_notify(pool);
     return SUCCESS;    
 }
 
@@ -0,0 +1,354 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "uring.h"
+
+// =========================================================================
+// ===============================  RING  ==================================
+// =========================================================================
+
+typedef struct Uring {
+    int fd;
+
+    // 提交队列，内核读取 head 之后的项; sqe_tail 是本地已填好的位置，提交时发布
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sqe_tail;
+    unsigned sqe_submitted;
+    struct io_uring_sqe *sqes;
+
+    // 完成队列，内核写入 tail 之前的项
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ptr;
+    size_t sq_size;
+    void *cq_ptr;       // 内核支持 IORING_FEAT_SINGLE_MMAP 时与 sq_ptr 相同
+    size_t cq_size;
+    size_t sqes_size;
+
+    // 提供给接收操作的缓冲环
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_size;
+    char *bufs;
+    size_t buf_size;
+    unsigned buf_mask;
+    unsigned short buf_tail;
+} Uring;
+
+static int _uring_setup(unsigned entries, struct io_uring_params *params){
+    return (int)syscall(SYS_io_uring_setup, entries, params);
+}
+
+static int _uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags){
+    return (int)syscall(SYS_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int _uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args){
+    return (int)syscall(SYS_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * @brief 创建 io_uring
+ * @return 内核不支持或被禁用时返回NULL
+ */
+Uring *uring_new(unsigned entries, unsigned cq_entries){
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    if(cq_entries > entries){
+        params.flags |= IORING_SETUP_CQSIZE;
+        params.cq_entries = cq_entries;
+    }
+
+    int fd = _uring_setup(entries, &params);
+    if(fd < 0){
+        return NULL;
+    }
+
+    Uring *ring = calloc(1, sizeof(Uring));
+    if(ring == NULL){
+        close(fd);
+        return NULL;
+    }
+    ring->fd = fd;
+
+    ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP){
+        if(ring->cq_size > ring->sq_size){
+            ring->sq_size = ring->cq_size;
+        }
+        ring->cq_size = ring->sq_size;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if(ring->sq_ptr == MAP_FAILED){
+        ring->sq_ptr = NULL;
+        uring_destroy(ring);
+        return NULL;
+    }
+    if(params.features & IORING_FEAT_SINGLE_MMAP){
+        ring->cq_ptr = ring->sq_ptr;
+    }else{
+        ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if(ring->cq_ptr == MAP_FAILED){
+            ring->cq_ptr = NULL;
+            uring_destroy(ring);
+            return NULL;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if(ring->sqes == MAP_FAILED){
+        ring->sqes = NULL;
+        uring_destroy(ring);
+        return NULL;
+    }
+
+    char *sq = ring->sq_ptr;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->sqe_tail = ring->sqe_submitted = *ring->sq_tail;
+    // 提交项和队列位置一一对应，之后不再修改
+    unsigned *array = (unsigned *)(sq + params.sq_off.array);
+    for(unsigned i = 0; i < params.sq_entries; i++){
+        array[i] = i;
+    }
+
+    char *cq = ring->cq_ptr;
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return ring;
+}
+
+/**
+ * @brief 销毁
+ */
+void uring_destroy(Uring *ring){
+    if(ring == NULL) return;
+
+    // 先关闭，内核取消未完成的操作后不再写入缓冲
+    close(ring->fd);
+    if(ring->buf_ring != NULL){
+        munmap(ring->buf_ring, ring->buf_ring_size);
+    }
+    free(ring->bufs);
+    if(ring->sqes != NULL){
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if(ring->cq_ptr != NULL && ring->cq_ptr != ring->sq_ptr){
+        munmap(ring->cq_ptr, ring->cq_size);
+    }
+    if(ring->sq_ptr != NULL){
+        munmap(ring->sq_ptr, ring->sq_size);
+    }
+    free(ring);
+}
+
+/**
+ * @brief 文件描述符
+ */
+int uring_fd(Uring *ring){
+    return ring->fd;
+}
+
+/**
+ * @brief 内核是否支持这些操作
+ */
+int uring_supports(Uring *ring, const int *ops, int count){
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    if(probe == NULL){
+        return 0;
+    }
+    int ok = _uring_register(ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for(int i = 0; ok && i < count; i++){
+        ok = ops[i] <= probe->last_op && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return ok;
+}
+
+/**
+ * @brief 提交队列的空位数
+ */
+static unsigned _uring_space(Uring *ring){
+    unsigned head = atomic_load_explicit((_Atomic unsigned *)ring->sq_head, memory_order_acquire);
+    return ring->sq_entries - (ring->sqe_tail - head);
+}
+
+/**
+ * @brief 保证接下来 count 次 uring_get_sqe 不会中途提交
+ */
+int uring_reserve(Uring *ring, unsigned count){
+    if(_uring_space(ring) >= count){
+        return 0;
+    }
+    uring_submit(ring);
+    return _uring_space(ring) >= count ? 0 : -1;
+}
+
+/**
+ * @brief 取一个清零的提交项
+ */
+struct io_uring_sqe *uring_get_sqe(Uring *ring){
+    if(uring_reserve(ring, 1) != 0){
+        return NULL;
+    }
+    struct io_uring_sqe *sqe = &ring->sqes[ring->sqe_tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sqe_tail++;
+    return sqe;
+}
+
+/**
+ * @brief 提交所有已填好的提交项
+ */
+int uring_submit(Uring *ring){
+    unsigned pending = ring->sqe_tail - ring->sqe_submitted;
+    if(pending == 0){
+        return 0;
+    }
+    // 提交项的内容要在内核看到新的 tail 之前写完
+    atomic_store_explicit((_Atomic unsigned *)ring->sq_tail, ring->sqe_tail, memory_order_release);
+    int n;
+    do{
+        n = _uring_enter(ring->fd, pending, 0, 0);
+    }while (n < 0 && errno == EINTR);
+    if(n < 0){
+        // EAGAIN/EBUSY 时留在队列里，下次提交时重试
+        return -1;
+    }
+    ring->sqe_submitted += n;
+    return n;
+}
+
+/**
+ * @brief 取下一个完成事件
+ */
+struct io_uring_cqe *uring_peek_cqe(Uring *ring){
+    unsigned head = *ring->cq_head;
+    if(head == atomic_load_explicit((_Atomic unsigned *)ring->cq_tail, memory_order_acquire)){
+        return NULL;
+    }
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+/**
+ * @brief 处理完一个完成事件
+ */
+void uring_cqe_seen(Uring *ring){
+    atomic_store_explicit((_Atomic unsigned *)ring->cq_head, *ring->cq_head + 1, memory_order_release);
+}
+
+/**
+ * @brief 注册空的固定文件表
+ */
+int uring_register_files(Uring *ring, unsigned count){
+    struct io_uring_rsrc_register reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.nr = count;
+    reg.flags = IORING_RSRC_REGISTER_SPARSE;
+    return _uring_register(ring->fd, IORING_REGISTER_FILES2, &reg, sizeof(reg)) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief 同步清空固定文件表中的一个位置
+ */
+int uring_unregister_file(Uring *ring, unsigned slot){
+    int fd = -1;
+    struct io_uring_files_update update;
+    memset(&update, 0, sizeof(update));
+    update.offset = slot;
+    update.fds = (unsigned long)&fd;
+    return _uring_register(ring->fd, IORING_REGISTER_FILES_UPDATE, &update, 1) == 1 ? 0 : -1;
+}
+
+// =========================================================================
+// =============================  BUFFERS  =================================
+// =========================================================================
+
+/**
+ * @brief 把缓冲放到环的末尾，由调用者发布 tail
+ */
+static void _uring_add_buffer(Uring *ring, unsigned bid, unsigned offset){
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[(ring->buf_tail + offset) & ring->buf_mask];
+    buf->addr = (unsigned long)(ring->bufs + bid * ring->buf_size);
+    buf->len = ring->buf_size;
+    buf->bid = bid;
+}
+
+/**
+ * @brief 注册缓冲环
+ */
+int uring_setup_buffers(Uring *ring, int group, unsigned count, size_t size){
+    if(count == 0 || (count & (count - 1)) != 0 || count > 32768){
+        return -1;
+    }
+
+    // 环必须按页对齐
+    ring->buf_ring_size = count * sizeof(struct io_uring_buf);
+    void *mem = mmap(NULL, ring->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mem == MAP_FAILED){
+        return -1;
+    }
+    ring->bufs = malloc(count * size);
+    if(ring->bufs == NULL){
+        munmap(mem, ring->buf_ring_size);
+        return -1;
+    }
+    ring->buf_ring = mem;
+    ring->buf_size = size;
+    ring->buf_mask = count - 1;
+    ring->buf_tail = 0;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long)mem;
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if(_uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0){
+        munmap(mem, ring->buf_ring_size);
+        free(ring->bufs);
+        ring->buf_ring = NULL;
+        ring->bufs = NULL;
+        return -1;
+    }
+
+    for(unsigned i = 0; i < count; i++){
+        _uring_add_buffer(ring, i, i);
+    }
+    ring->buf_tail += count;
+    atomic_store_explicit((_Atomic unsigned short *)&ring->buf_ring->tail, ring->buf_tail, memory_order_release);
+    return 0;
+}
+
+/**
+ * @brief 缓冲的地址
+ */
+char *uring_buffer(Uring *ring, unsigned bid){
+    return ring->bufs + bid * ring->buf_size;
+}
+
+/**
+ * @brief 把缓冲还给内核
+ */
+void uring_recycle_buffer(Uring *ring, unsigned bid){
+    _uring_add_buffer(ring, bid, 0);
+    ring->buf_tail++;
+    atomic_store_explicit((_Atomic unsigned short *)&ring->buf_ring->tail, ring->buf_tail, memory_order_release);
+}
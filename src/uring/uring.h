@@ -0,0 +1,104 @@
+#ifndef URING_H_
+#define URING_H_
+
+// Description: Header file for uring (io_uring 的最小封装，直接使用系统调用，不依赖 liburing)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+/**
+ * @brief 一个 io_uring 实例，只能在一个线程中使用
+ */
+typedef struct Uring Uring;
+
+/**
+ * @brief 创建 io_uring
+ * @param entries 提交队列长度，会向上取整为2的幂
+ * @param cq_entries 完成队列长度，不小于 entries
+ * @return 内核不支持或被禁用时返回NULL
+ */
+Uring *uring_new(unsigned entries, unsigned cq_entries);
+
+/**
+ * @brief 销毁，未完成的操作由内核取消
+ */
+void uring_destroy(Uring *ring);
+
+/**
+ * @brief 文件描述符，有完成事件时可读，可以注册到 epoll
+ */
+int uring_fd(Uring *ring);
+
+/**
+ * @brief 内核是否支持这些操作
+ * @return 都支持返回1,否则返回0
+ */
+int uring_supports(Uring *ring, const int *ops, int count);
+
+/**
+ * @brief 取一个清零的提交项，填好后由 uring_submit 一起提交; 队列满时先提交已有的
+ * @return 仍然满时返回NULL
+ */
+struct io_uring_sqe *uring_get_sqe(Uring *ring);
+
+/**
+ * @brief 保证接下来 count 次 uring_get_sqe 不会中途提交，链接在一起的提交项必须在同一次提交中
+ * @return 成功返回0, 队列仍然没有空间返回-1
+ */
+int uring_reserve(Uring *ring, unsigned count);
+
+/**
+ * @brief 提交所有已填好的提交项，不等待完成
+ * @return 提交的数量, 出错返回-1
+ */
+int uring_submit(Uring *ring);
+
+/**
+ * @brief 取下一个完成事件，不等待
+ * @return 没有时返回NULL
+ */
+struct io_uring_cqe *uring_peek_cqe(Uring *ring);
+
+/**
+ * @brief 处理完 uring_peek_cqe 返回的完成事件
+ */
+void uring_cqe_seen(Uring *ring);
+
+/**
+ * @brief 注册空的固定文件表，之后用 IORING_OP_FILES_UPDATE 填入
+ * @return 成功返回0,失败返回-1
+ */
+int uring_register_files(Uring *ring, unsigned count);
+
+/**
+ * @brief 同步清空固定文件表中的一个位置，用于无法提交异步关闭时
+ * @return 成功返回0,失败返回-1
+ */
+int uring_unregister_file(Uring *ring, unsigned slot);
+
+/**
+ * @brief 注册提供给接收操作的缓冲环，count 个 size 字节的缓冲，编号为 0..count-1
+ * @param count 2的幂, 不超过 32768
+ * @return 成功返回0, 内核不支持或分配失败返回-1
+ */
+int uring_setup_buffers(Uring *ring, int group, unsigned count, size_t size);
+
+/**
+ * @brief 缓冲的地址
+ */
+char *uring_buffer(Uring *ring, unsigned bid);
+
+/**
+ * @brief 数据取走后把缓冲还给内核
+ */
+void uring_recycle_buffer(Uring *ring, unsigned bid);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* URING_H_ */
@@ -0,0 +1,181 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN _Alignof(max_align_t)
+
+/**
+ * @brief 内存块
+ */
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;        // data 的大小
+    size_t used;
+    _Alignas(max_align_t) char data[];
+} ArenaBlock;
+
+typedef struct Arena {
+    size_t block_size;
+    ArenaBlock *head;       // 普通块链表，重置后保留
+    ArenaBlock *current;    // 正在分配的块, head 之后的块在重新用到时才清零 used
+    ArenaBlock *large;      // 单独申请的大块，重置时释放
+    size_t capacity;
+} Arena;
+
+static ArenaBlock *_arena_block_new(size_t size){
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + size);
+    if(block == NULL){
+        return NULL;
+    }
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+static void _arena_free_list(ArenaBlock *block){
+    while (block)
+    {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+/**
+ * @brief 创建内存池，第一个块在首次分配时才申请
+ * @return 失败返回NULL
+ */
+Arena *arena_new(size_t block_size){
+    Arena *arena = malloc(sizeof(Arena));
+    if(arena == NULL){
+        return NULL;
+    }
+    memset(arena, 0, sizeof(Arena));
+    arena->block_size = block_size;
+    return arena;
+}
+
+/**
+ * @brief 销毁内存池及其分配的所有内存
+ */
+void arena_destroy(Arena *arena){
+    if(arena == NULL) return;
+    arena_release(arena);
+    free(arena);
+}
+
+/**
+ * @brief 大块单独申请，避免浪费普通块的剩余空间
+ */
+static void *_arena_alloc_large(Arena *arena, size_t size){
+    ArenaBlock *block = _arena_block_new(size);
+    if(block == NULL){
+        return NULL;
+    }
+    block->used = size;
+    block->next = arena->large;
+    arena->large = block;
+    arena->capacity += size;
+    return block->data;
+}
+
+/**
+ * @brief 分配内存，按 max_align_t 对齐
+ * @return 失败返回NULL
+ */
+void *arena_alloc(Arena *arena, size_t size){
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if(size == 0){
+        size = ARENA_ALIGN;
+    }
+    if(size > arena->block_size / 4){
+        return _arena_alloc_large(arena, size);
+    }
+
+    ArenaBlock *block = arena->current;
+    if(block == NULL || block->size - block->used < size){
+        if(block != NULL && block->next != NULL){
+            // 重置前申请过的块
+            block = block->next;
+            block->used = 0;
+        }else{
+            ArenaBlock *new = _arena_block_new(arena->block_size);
+            if(new == NULL){
+                return NULL;
+            }
+            if(block == NULL){
+                arena->head = new;
+            }else{
+                block->next = new;
+            }
+            arena->capacity += new->size;
+            block = new;
+        }
+        arena->current = block;
+    }
+
+    void *ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+/**
+ * @brief 复制 len 个字符并以\0结尾
+ */
+char *arena_strndup(Arena *arena, const char *s, size_t len){
+    char *dup = arena_alloc(arena, len + 1);
+    if(dup == NULL){
+        return NULL;
+    }
+    memcpy(dup, s, len);
+    dup[len] = '\0';
+    return dup;
+}
+
+/**
+ * @brief 复制字符串
+ */
+char *arena_strdup(Arena *arena, const char *s){
+    return arena_strndup(arena, s, strlen(s));
+}
+
+/**
+ * @brief 释放所有已分配的内存，保留普通块供下次使用
+ */
+void arena_reset(Arena *arena){
+    if(arena->large != NULL){
+        ArenaBlock *block = arena->large;
+        while (block)
+        {
+            arena->capacity -= block->size;
+            block = block->next;
+        }
+        _arena_free_list(arena->large);
+        arena->large = NULL;
+    }
+
+    arena->current = arena->head;
+    if(arena->head != NULL){
+        arena->head->used = 0;
+    }
+}
+
+/**
+ * @brief 释放所有块
+ */
+void arena_release(Arena *arena){
+    _arena_free_list(arena->head);
+    _arena_free_list(arena->large);
+    arena->head = arena->current = arena->large = NULL;
+    arena->capacity = 0;
+}
+
+/**
+ * @brief 当前持有的块的总大小
+ */
+size_t arena_capacity(const Arena *arena){
+    return arena->capacity;
+}
@@ -0,0 +1,64 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+// Description: Header file for arena (按块分配的线性内存池，整体释放)
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief 内存池，非线程安全
+ */
+typedef struct Arena Arena;
+
+/**
+ * @brief 创建内存池，第一个块在首次分配时才申请
+ * @param block_size 每个块的大小，超过块大小1/4的分配单独申请
+ * @return 失败返回NULL
+ */
+Arena *arena_new(size_t block_size);
+
+/**
+ * @brief 销毁内存池及其分配的所有内存
+ */
+void arena_destroy(Arena *arena);
+
+/**
+ * @brief 分配内存，按 max_align_t 对齐，不需要单独释放
+ * @return 失败返回NULL
+ */
+void *arena_alloc(Arena *arena, size_t size);
+
+/**
+ * @brief 复制 len 个字符并以\0结尾
+ */
+char *arena_strndup(Arena *arena, const char *s, size_t len);
+
+/**
+ * @brief 复制字符串
+ */
+char *arena_strdup(Arena *arena, const char *s);
+
+/**
+ * @brief 释放所有已分配的内存，保留普通块供下次使用，O(1)
+ */
+void arena_reset(Arena *arena);
+
+/**
+ * @brief 释放所有块，内存池本身可以继续使用
+ */
+void arena_release(Arena *arena);
+
+/**
+ * @brief 当前持有的块的总大小
+ */
+size_t arena_capacity(const Arena *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ARENA_H_ */
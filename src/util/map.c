@@ -1,4 +1,4 @@
-/** 
+/**
  * Copyright (c) 2014 rxi
  *
  * This library is free software; you can redistribute it and/or modify it
@@ -6,194 +6,399 @@
  */
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/random.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "map.h"
 
-struct map_node_t {
-  // char *key;
-  unsigned hash;
-  void *value;
-  map_node_t *next;
-  /* char key[]; */
-  /* char value[]; */
+#define MAP_GROUP 16
+#define MAP_EMPTY 0x80
+#define MAP_MIN_BUCKETS MAP_GROUP
+
+struct map_entry_t {
+  uint64_t hash;
+  unsigned koff;   /* offset of the key in m->keys */
+  unsigned klen;
+};
+
+
+/* wyhash (Wang Yi, public domain), reading 8 bytes at a time. The seed is
+ * random per process so colliding keys can't be precomputed offline. */
+static const uint64_t map_secret[4] = {
+  0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+  0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
 };
+static uint64_t map_seed;
+static pthread_once_t map_seed_once = PTHREAD_ONCE_INIT;
 
 
-static unsigned map_hash(const char *str) {
-  unsigned hash = 5381;
-  while (*str) {
-    hash = ((hash << 5) + hash) ^ *str++;
+static void map_seed_init(void) {
+  uint64_t seed = 0;
+  if (getrandom(&seed, sizeof(seed), GRND_NONBLOCK) != sizeof(seed)) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    seed = (uint64_t) ts.tv_nsec ^ ((uint64_t) ts.tv_sec << 32) ^
+           (uint64_t) (uintptr_t) &seed ^ (uint64_t) getpid();
   }
-  return hash;
+  map_seed = seed;
 }
 
 
-static map_node_t *map_newnode(const char *key, void *value, int vsize) {
-  map_node_t *node;
-  int ksize = strlen(key) + 1;
-  int voffset = ksize + ((sizeof(void*) - ksize) % sizeof(void*));
-  node = malloc(sizeof(*node) + voffset + vsize);
-  if (!node) return NULL;
-  // printf("sizeof(*node):%ld key:%s, value:%s, node:%p, node+1:%p\n",sizeof(*node), key, value, node, node+1);
-  memcpy(node + 1, key, ksize);
-  node->hash = map_hash(key);
-  node->value = ((char*) (node + 1)) + voffset;
-  memcpy(node->value, value, vsize);
-  return node;
+static inline uint64_t map_mix(uint64_t a, uint64_t b) {
+  __uint128_t r = (__uint128_t) a * b;
+  return (uint64_t) r ^ (uint64_t) (r >> 64);
 }
 
 
-static int map_bucketidx(map_base_t *m, unsigned hash) {
-  /* If the implementation is changed to allow a non-power-of-2 bucket count,
-   * the line below should be changed to use mod instead of AND */
-  return hash & (m->nbuckets - 1);
+static inline uint64_t map_r8(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
 }
 
 
-static void map_addnode(map_base_t *m, map_node_t *node) {
-  int n = map_bucketidx(m, node->hash);
-  node->next = m->buckets[n];
-  m->buckets[n] = node;
+static inline uint64_t map_r4(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
 }
 
 
-static int map_resize(map_base_t *m, int nbuckets) {
-  map_node_t *nodes, *node, *next;
-  map_node_t **buckets;
-  int i; 
-  /* Chain all nodes together */
-  nodes = NULL;
-  i = m->nbuckets;
-  while (i--) {
-    node = (m->buckets)[i];
-    while (node) {
-      next = node->next;
-      node->next = nodes;
-      nodes = node;
-      node = next;
+static uint64_t map_hash(const char *str, unsigned *len) {
+  const unsigned char *p = (const unsigned char*) str;
+  size_t n = strlen(str), i = n;
+  uint64_t seed, a, b;
+  __uint128_t r;
+  pthread_once(&map_seed_once, map_seed_init);
+  *len = n;
+  seed = map_seed ^ map_mix(map_seed ^ map_secret[0], map_secret[1]);
+  if (n <= 16) {
+    if (n >= 4) {
+      a = (map_r4(p) << 32) | map_r4(p + ((n >> 3) << 2));
+      b = (map_r4(p + n - 4) << 32) | map_r4(p + n - 4 - ((n >> 3) << 2));
+    } else if (n > 0) {
+      a = ((uint64_t) p[0] << 16) | ((uint64_t) p[n >> 1] << 8) | p[n - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = map_mix(map_r8(p) ^ map_secret[1], map_r8(p + 8) ^ seed);
+        see1 = map_mix(map_r8(p + 16) ^ map_secret[2], map_r8(p + 24) ^ see1);
+        see2 = map_mix(map_r8(p + 32) ^ map_secret[3], map_r8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = map_mix(map_r8(p) ^ map_secret[1], map_r8(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
     }
+    a = map_r8(p + i - 16);
+    b = map_r8(p + i - 8);
   }
-  /* Reset buckets */
-  buckets = realloc(m->buckets, sizeof(*m->buckets) * nbuckets);
-  if (buckets != NULL) {
-    m->buckets = buckets;
-    m->nbuckets = nbuckets;
+  r = (__uint128_t) (a ^ map_secret[1]) * (b ^ seed);
+  return map_mix((uint64_t) r ^ map_secret[0] ^ n, (uint64_t) (r >> 64) ^ map_secret[1]);
+}
+
+
+#define map_h1(hash) ((unsigned) ((hash) >> 7))
+#define map_h2(hash) ((unsigned char) ((hash) & 0x7f))
+
+
+/**
+ * @brief 一次比较 16 个控制字节
+ * @param match 等于 h2 的位置
+ * @param empty 空位置
+ */
+static inline void map_group_scan(const unsigned char *ctrl, unsigned char h2,
+                                  unsigned *match, unsigned *empty) {
+#ifdef __SSE2__
+  __m128i group = _mm_loadu_si128((const __m128i*) ctrl);
+  *match = _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(h2)));
+  /* only MAP_EMPTY has the top bit set */
+  *empty = _mm_movemask_epi8(group);
+#else
+  unsigned m = 0, e = 0;
+  for (int i = 0; i < MAP_GROUP; i++) {
+    m |= (unsigned) (ctrl[i] == h2) << i;
+    e |= (unsigned) (ctrl[i] == MAP_EMPTY) << i;
   }
-  if (m->buckets) {
-    memset(m->buckets, 0, sizeof(*m->buckets) * m->nbuckets);
-    /* Re-add nodes to buckets */
-    node = nodes;
-    while (node) {
-      next = node->next;
-      map_addnode(m, node);
-      node = next;
-    }
+  *match = m;
+  *empty = e;
+#endif
+}
+
+
+static void map_setctrl(map_base_t *m, unsigned idx, unsigned char c) {
+  m->ctrl[idx] = c;
+  /* the first group is mirrored past the end so a group load never wraps */
+  if (idx < MAP_GROUP) {
+    m->ctrl[m->nbuckets + idx] = c;
   }
-  /* Return error code if realloc() failed */
-  return (buckets == NULL) ? -1 : 0;
 }
 
 
-static map_node_t **map_getref(map_base_t *m, const char *key) {
-  unsigned hash = map_hash(key);
-  map_node_t **next;
-  if (m->nbuckets > 0) {
-    next = &m->buckets[map_bucketidx(m, hash)];
-    while (*next) {
-      if ((*next)->hash == hash && !strcmp((char*) (*next + 1), key)) {
-        return next;
+#define map_value(m, idx) ((m)->values + (size_t) (idx) * (m)->vstride)
+
+
+/**
+ * @brief 查找 key，线性探测遇到空位置即结束
+ * @param slot 没找到时返回可以插入的位置
+ * @return 找到返回位置，否则返回-1
+ */
+static int map_find(map_base_t *m, const char *key, uint64_t hash,
+                    unsigned klen, unsigned *slot) {
+  unsigned mask = m->nbuckets - 1;
+  unsigned pos = map_h1(hash) & mask;
+  unsigned char h2 = map_h2(hash);
+  for (;;) {
+    unsigned match, empty;
+    map_group_scan(m->ctrl + pos, h2, &match, &empty);
+    /* a run never continues past an empty slot */
+    if (empty) {
+      match &= (empty & -empty) - 1;
+    }
+    while (match) {
+      unsigned idx = (pos + __builtin_ctz(match)) & mask;
+      map_entry_t *e = &m->entries[idx];
+      if (e->hash == hash && e->klen == klen &&
+          !memcmp(m->keys + e->koff, key, klen)) {
+        return idx;
       }
-      next = &(*next)->next;
+      match &= match - 1;
+    }
+    if (empty) {
+      if (slot) *slot = (pos + __builtin_ctz(empty)) & mask;
+      return -1;
     }
+    pos = (pos + MAP_GROUP) & mask;
   }
-  return NULL;
 }
 
 
-void map_deinit_(map_base_t *m) {
-  map_node_t *next, *node;
-  int i;
-  i = m->nbuckets;
-  while (i--) {
-    node = m->buckets[i];
-    while (node) {
-      next = node->next;
-      free(node);
-      node = next;
+/**
+ * @brief 找到 hash 所在探测序列的第一个空位置
+ */
+static unsigned map_findempty(map_base_t *m, uint64_t hash) {
+  unsigned mask = m->nbuckets - 1;
+  unsigned pos = map_h1(hash) & mask;
+  for (;;) {
+    unsigned match, empty;
+    map_group_scan(m->ctrl + pos, 0, &match, &empty);
+    if (empty) {
+      return (pos + __builtin_ctz(empty)) & mask;
     }
+    pos = (pos + MAP_GROUP) & mask;
   }
-  free(m->buckets);
+}
+
+
+/**
+ * @brief 重新整理 key 池，丢掉已删除的 key
+ */
+static int map_rebuild_keys(map_base_t *m, unsigned cap) {
+  char *keys = malloc(cap);
+  unsigned len = 0, i;
+  if (!keys) return -1;
+  for (i = 0; i < m->nbuckets; i++) {
+    if (m->ctrl[i] != MAP_EMPTY) {
+      map_entry_t *e = &m->entries[i];
+      memcpy(keys + len, m->keys + e->koff, e->klen + 1);
+      e->koff = len;
+      len += e->klen + 1;
+    }
+  }
+  free(m->keys);
+  m->keys = keys;
+  m->keys_len = len;
+  m->keys_cap = cap;
+  m->keys_dead = 0;
+  return 0;
+}
+
+
+static int map_addkey(map_base_t *m, const char *key, unsigned klen) {
+  unsigned need = klen + 1, cap = 256;
+  if (m->keys_cap - m->keys_len < need) {
+    if (m->keys_dead > 0) {
+      /* compact, leaving as much room again as the live keys use */
+      while (cap < (m->keys_len - m->keys_dead + need) * 2) cap <<= 1;
+      if (map_rebuild_keys(m, cap) != 0) return -1;
+    } else {
+      char *keys;
+      if (m->keys_cap) cap = m->keys_cap;
+      while (cap < m->keys_len + need) cap <<= 1;
+      keys = realloc(m->keys, cap);
+      if (!keys) return -1;
+      m->keys = keys;
+      m->keys_cap = cap;
+    }
+  }
+  memcpy(m->keys + m->keys_len, key, need);
+  m->keys_len += need;
+  return m->keys_len - need;
+}
+
+
+static int map_resize(map_base_t *m, unsigned nbuckets, unsigned vstride) {
+  map_base_t old = *m;
+  size_t esize = sizeof(map_entry_t) * nbuckets;
+  size_t vsize = ((size_t) vstride * nbuckets + 15) & ~(size_t) 15;
+  char *mem = malloc(esize + vsize + nbuckets + MAP_GROUP);
+  unsigned i;
+  if (!mem) return -1;
+  m->entries = (map_entry_t*) mem;
+  m->values = mem + esize;
+  m->ctrl = (unsigned char*) mem + esize + vsize;
+  m->nbuckets = nbuckets;
+  m->vstride = vstride;
+  memset(m->ctrl, MAP_EMPTY, nbuckets + MAP_GROUP);
+  /* re-insert; keys stay where they are */
+  for (i = 0; i < old.nbuckets; i++) {
+    unsigned slot;
+    if (old.ctrl[i] == MAP_EMPTY) continue;
+    slot = map_findempty(m, old.entries[i].hash);
+    m->entries[slot] = old.entries[i];
+    memcpy(map_value(m, slot), map_value(&old, i), vstride);
+    map_setctrl(m, slot, map_h2(old.entries[i].hash));
+  }
+  free(old.entries);
+  return 0;
+}
+
+
+void map_deinit_(map_base_t *m) {
+  free(m->entries);
+  free(m->keys);
 }
 
 
 void *map_get_(map_base_t *m, const char *key) {
-  map_node_t **next = map_getref(m, key);
-  return next ? (*next)->value : NULL;
+  unsigned klen;
+  uint64_t hash;
+  int idx;
+  if (m->nbuckets == 0) return NULL;
+  hash = map_hash(key, &klen);
+  idx = map_find(m, key, hash, klen, NULL);
+  return idx >= 0 ? map_value(m, idx) : NULL;
 }
 
 
 /**
- * @brief 
+ * @brief
  * @param value 传入数据的指针
  */
 int map_set_(map_base_t *m, const char *key, void *value, int vsize) {
-  int n, err;
-  map_node_t **next, *node;
-  /* Find & replace existing node */
-  next = map_getref(m, key);
-  if (next) {
-    memcpy((*next)->value, value, vsize);
-    return 0;
+  unsigned klen, slot;
+  uint64_t hash = map_hash(key, &klen);
+  int idx, koff;
+  /* Find & replace existing entry */
+  if (m->nbuckets > 0) {
+    idx = map_find(m, key, hash, klen, &slot);
+    if (idx >= 0) {
+      memcpy(map_value(m, idx), value, vsize);
+      return 0;
+    }
   }
-  /* Add new node */
-  node = map_newnode(key, value, vsize);
-  if (node == NULL) goto fail;
-  if (m->nnodes >= m->nbuckets) {
-    n = (m->nbuckets > 0) ? (m->nbuckets << 1) : 1;
-    err = map_resize(m, n);
-    if (err) goto fail;
+  /* Keep the load factor at or below 7/8 */
+  if ((m->nnodes + 1) * 8 > m->nbuckets * 7) {
+    unsigned n = m->nbuckets ? m->nbuckets << 1 : MAP_MIN_BUCKETS;
+    /* values are aligned to their size, up to a pointer */
+    unsigned vstride = m->vstride;
+    if (!vstride) {
+      vstride = 1;
+      while (vstride < (unsigned) vsize && vstride < sizeof(void*)) vstride <<= 1;
+      vstride = (vsize + vstride - 1) & ~(vstride - 1);
+    }
+    if (map_resize(m, n, vstride) != 0) return -1;
+    map_find(m, key, hash, klen, &slot);
   }
-  map_addnode(m, node);
+  /* Add new entry */
+  koff = map_addkey(m, key, klen);
+  if (koff < 0) return -1;
+  m->entries[slot].hash = hash;
+  m->entries[slot].koff = koff;
+  m->entries[slot].klen = klen;
+  memcpy(map_value(m, slot), value, vsize);
+  map_setctrl(m, slot, map_h2(hash));
   m->nnodes++;
   return 0;
-  fail:
-  if (node) free(node);
-  return -1;
 }
 
 
 void map_remove_(map_base_t *m, const char *key) {
-  map_node_t *node;
-  map_node_t **next = map_getref(m, key);
-  if (next) {
-    node = *next;
-    *next = (*next)->next;
-    free(node);
-    m->nnodes--;
+  unsigned klen, mask, i, j;
+  uint64_t hash;
+  int idx;
+  if (m->nbuckets == 0) return;
+  hash = map_hash(key, &klen);
+  idx = map_find(m, key, hash, klen, NULL);
+  if (idx < 0) return;
+  m->keys_dead += klen + 1;
+  m->nnodes--;
+  /* Backward shift: pull later entries of the run into the hole so no
+   * tombstone is needed */
+  mask = m->nbuckets - 1;
+  i = idx;
+  for (j = (i + 1) & mask; m->ctrl[j] != MAP_EMPTY; j = (j + 1) & mask) {
+    unsigned home = map_h1(m->entries[j].hash) & mask;
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      m->entries[i] = m->entries[j];
+      memcpy(map_value(m, i), map_value(m, j), m->vstride);
+      map_setctrl(m, i, m->ctrl[j]);
+      i = j;
+    }
   }
+  map_setctrl(m, i, MAP_EMPTY);
 }
 
 
 map_iter_t map_iter_(void) {
   map_iter_t iter;
   iter.bucketidx = -1;
-  iter.node = NULL;
+  iter.full = 0;
   return iter;
 }
 
 
 const char *map_next_(map_base_t *m, map_iter_t *iter) {
-  if (iter->node) {
-    iter->node = iter->node->next;
-    if (iter->node == NULL) goto nextBucket;
+  unsigned i = iter->bucketidx + 1;
+  if (iter->full) {
+    unsigned step = __builtin_ctz(iter->full);
+    i += step;
+    iter->full >>= step + 1;
   } else {
-    nextBucket:
-    do {
-      if (++iter->bucketidx >= m->nbuckets) {
-        return NULL;
+    while (i < m->nbuckets) {
+      unsigned match, full;
+      map_group_scan(m->ctrl + i, 0, &match, &full);
+      full = ~full & 0xffff;
+      if (full) {
+        unsigned step = __builtin_ctz(full);
+        i += step;
+        iter->full = full >> (step + 1);
+        break;
       }
-      iter->node = m->buckets[iter->bucketidx];
-    } while (iter->node == NULL);
+      i += MAP_GROUP;
+    }
+  }
+  /* a hit past the end is the mirrored first group */
+  if (i >= m->nbuckets) {
+    iter->bucketidx = m->nbuckets;
+    iter->full = 0;
+    return NULL;
   }
-  return (char*) (iter->node + 1);
-}
\ No newline at end of file
+  iter->bucketidx = i;
+  return m->keys + m->entries[i].koff;
+}
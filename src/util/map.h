@@ -12,17 +12,27 @@
 
 #define MAP_VERSION "0.1.0"
 
-struct map_node_t;
-typedef struct map_node_t map_node_t;
-
+struct map_entry_t;
+typedef struct map_entry_t map_entry_t;
+
+/* Open addressing: one control byte per bucket (7 bits of the hash, or
+ * MAP_EMPTY), probed 16 at a time. Keys are hashed with a per-process
+ * random seed, so bucket layout differs between runs. Keys live in one string pool, values in
+ * one flat array, so pointers returned by map_get()/map_next() are only
+ * valid until the next map_set() or map_remove(). */
 typedef struct {
-  map_node_t **buckets;
+  unsigned char *ctrl;
+  map_entry_t *entries;
+  char *values;
+  char *keys;
   unsigned nbuckets, nnodes;
+  unsigned vstride;
+  unsigned keys_len, keys_cap, keys_dead;
 } map_base_t;
 
 typedef struct {
   unsigned bucketidx;
-  map_node_t *node;
+  unsigned full;   /* occupied buckets after bucketidx in the current group */
 } map_iter_t;
 
 